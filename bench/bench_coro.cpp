@@ -0,0 +1,267 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014, Stephen Scott
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+
+/* 
+ * Coroutine benchmark: pthread_ext::recv and pthread_ext::wait on a small thread pool.
+ *
+ * Queue: N coroutines wait in recv on one Queue, and the main thread sends them messages.
+ * Each message wakes one waiting receiver, so posts/msg (retries handed to the executor per
+ * message) stays at most 1 as N grows.
+ *
+ * Event: N coroutines each wait on their own bit of one event. The main thread sets the
+ * bits in turn and waits for each waiter to answer on a second event, as
+ * bench_event_waiters does with threads.
+ *
+ * This is also the build check for pthread_queue.hpp and pthread_coro.hpp.
+ *
+ * c++ -std=c++20 -O2 -pthread -I.. bench_coro.cpp ../pthread_*.c
+ *
+ * usage: bench_coro [max_waiters] [executor_threads] [msgs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "pthread_coro.hpp"
+
+#define MAX_EVENT_WAITERS	PTHREAD_EVENT_WORD_BITS
+
+/* runs posted callables on a fixed set of threads, and counts them */
+class Pool
+{
+public:
+	explicit Pool(int nthreads)
+	{
+		for (int i = 0; i < nthreads; i++)
+			threads_.emplace_back([this] { run(); });
+	}
+
+	~Pool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stop_ = true;
+		}
+		cond_.notify_all();
+		for (auto & t : threads_)
+			t.join();
+	}
+
+	void post(std::function<void()> fn)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			queue_.push_back(std::move(fn));
+		}
+		posts.fetch_add(1, std::memory_order_relaxed);
+		cond_.notify_one();
+	}
+
+	std::atomic<long>		posts{0};
+
+private:
+	void run()
+	{
+		for (;;)
+		{
+			std::function<void()> fn;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				cond_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+				if (queue_.empty())
+					return;
+				fn = std::move(queue_.front());
+				queue_.pop_front();
+			}
+			fn();
+		}
+	}
+
+	std::mutex				mutex_;
+	std::condition_variable	cond_;
+	std::deque<std::function<void()>> queue_;
+	std::vector<std::thread> threads_;
+	bool					stop_ = false;
+};
+
+static_assert(pthread_ext::Executor<Pool>, "Pool is an executor");
+
+/* a coroutine that starts at once and frees itself when it returns */
+struct Detached
+{
+	struct promise_type
+	{
+		Detached get_return_object() { return {}; }
+		std::suspend_never initial_suspend() { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { abort(); }
+	};
+};
+
+typedef pthread_ext::Queue<uint64_t, 1024> MsgQueue;
+
+static std::atomic<int>	finished;
+
+/**************************************************************************************************/
+static Detached receiver(MsgQueue & queue, Pool & ex, long msgs)
+{
+	uint64_t		msg;
+
+	for (long i = 0; i < msgs; i++)
+		if (co_await pthread_ext::recv(queue, msg, ex))
+			abort();
+	finished++;
+}
+
+/**************************************************************************************************/
+static Detached waiter(pthread_event_t * event, pthread_event_t * answer, pthread_event_mask64 bit,
+					   Pool & ex, int rounds)
+{
+	for (int r = 0; r < rounds; r++)
+	{
+		if (co_await pthread_ext::wait(event, bit, PTHREAD_EVENT_ANY, ex))
+			abort();
+		pthread_event_set64(answer, bit);
+	}
+	finished++;
+}
+
+/**************************************************************************************************/
+static double seconds_since(const struct timespec & start)
+{
+	struct timespec	end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/**************************************************************************************************/
+static void run_queue(int nwaiters, int nthreads, long msgs)
+{
+	MsgQueue	  *	queue = new MsgQueue;
+	Pool			ex(nthreads);
+	struct timespec	start;
+	long			per = msgs / nwaiters;
+	long			posts;
+	double			secs;
+
+	finished = 0;
+	for (int i = 0; i < nwaiters; i++)
+		receiver(*queue, ex, per);
+
+	posts = ex.posts;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (long i = 0; i < per * nwaiters; i++)
+		queue->send((uint64_t) i);
+	while (finished < nwaiters)
+		std::this_thread::yield();
+	secs = seconds_since(start);
+	posts = ex.posts - posts;
+
+	printf("%8d %16.0f %16.2f\n", nwaiters, per * nwaiters / secs, (double) posts / (per * nwaiters));
+	delete queue;
+}
+
+/**************************************************************************************************/
+static void run_event(int nwaiters, int nthreads, int rounds)
+{
+	pthread_event_t	  *	event = NULL;
+	pthread_event_t	  *	answer = NULL;
+	Pool			ex(nthreads);
+	struct timespec	start;
+	long			posts;
+	double			secs;
+
+	if (pthread_event_create(&event) || pthread_event_create(&answer))
+	{
+		fprintf(stderr, "event create failed\n");
+		exit(1);
+	}
+
+	finished = 0;
+	for (int i = 0; i < nwaiters; i++)
+		waiter(event, answer, PTHREAD_EVENT_BIT_MASK(i), ex, rounds);
+
+	posts = ex.posts;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int r = 0; r < rounds; r++)
+	{
+		for (int i = 0; i < nwaiters; i++)
+		{
+			pthread_event_set64(event, PTHREAD_EVENT_BIT_MASK(i));
+			pthread_event_wait64(answer, PTHREAD_EVENT_BIT_MASK(i), PTHREAD_EVENT_ALL,
+								 PTHREAD_EVENT_CLEAR, PTHREAD_WAIT);
+		}
+	}
+	while (finished < nwaiters)
+		std::this_thread::yield();
+	secs = seconds_since(start);
+	posts = ex.posts - posts;
+
+	printf("%8d %16.0f %16.2f\n", nwaiters, (double) rounds * nwaiters / secs,
+		   (double) posts / ((double) rounds * nwaiters));
+
+	pthread_event_destroy(event);
+	pthread_event_destroy(answer);
+}
+
+/**************************************************************************************************/
+int main(int argc, char *argv[])
+{
+	int				max_waiters = (argc > 1) ? atoi(argv[1]) : 256;
+	int				nthreads = (argc > 2) ? atoi(argv[2]) : 2;
+	long			msgs = (argc > 3) ? atol(argv[3]) : 20000;
+	int				n;
+
+	if ((max_waiters < 1) || (nthreads < 1) || (msgs < max_waiters))
+	{
+		fprintf(stderr, "usage: bench_coro [max_waiters] [executor_threads] [msgs]\n");
+		return 1;
+	}
+
+	printf("queue, %d executor threads\n", nthreads);
+	printf("%8s %16s %16s\n", "waiters", "msgs/s", "posts/msg");
+	for (n = 1; n <= max_waiters; n *= 4)
+		run_queue(n, nthreads, msgs);
+
+	printf("\nevent, %d executor threads\n", nthreads);
+	printf("%8s %16s %16s\n", "waiters", "handoffs/s", "posts/set");
+	for (n = 1; (n <= max_waiters) && (n <= MAX_EVENT_WAITERS); n *= 4)
+		run_event(n, nthreads, (int) (msgs / n));
+
+	return 0;
+}
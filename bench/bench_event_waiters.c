@@ -0,0 +1,138 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014, Stephen Scott
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/* 
+ * Waiter benchmark: many threads blocked on disjoint bits of one pthread_event_t.
+ *
+ * For each thread count N, N waiters each wait (PTHREAD_EVENT_CLEAR) on their own bit. The
+ * main thread sets the bits in turn and waits for each waiter to answer on a second event,
+ * so every set has exactly one interested waiter. The handoff rate and the number of
+ * context switches per set are reported; with per-waiter wakeups neither should depend on
+ * N, where a broadcast to every waiter costs O(N) context switches per set.
+ *
+ * cc -O2 -pthread -I.. bench_event_waiters.c ../pthread_event.c ../pthread_ext_wait.c ../pthread_ext_common.c
+ *
+ * usage: bench_event_waiters [max_threads] [rounds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "pthread_event.h"
+
+#define MAX_WAITERS	32
+
+static pthread_event_t	  *	event;
+static pthread_event_t	  *	answer;
+static int				rounds;
+
+/**************************************************************************************************/
+static void *waiter(void *arg)
+{
+	pthread_event_mask	bit = 1u << (long) arg;
+	int				r;
+
+	for (r = 0; r < rounds; r++)
+	{
+		pthread_event_wait(event, bit, PTHREAD_EVENT_ANY, PTHREAD_EVENT_CLEAR, PTHREAD_WAIT);
+		pthread_event_set(answer, bit);
+	}
+
+	return NULL;
+}
+
+/**************************************************************************************************/
+static long context_switches(void)
+{
+	struct rusage	ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+
+	return ru.ru_nvcsw + ru.ru_nivcsw;
+}
+
+/**************************************************************************************************/
+static void run(int nthreads)
+{
+	pthread_t		threads[MAX_WAITERS];
+	struct timespec	start, end;
+	double			secs;
+	long			csw;
+	long			i;
+	int				r;
+
+	for (i = 0; i < nthreads; i++)
+		pthread_create(&threads[i], NULL, waiter, (void *) i);
+
+	csw = context_switches();
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (r = 0; r < rounds; r++)
+	{
+		for (i = 0; i < nthreads; i++)
+		{
+			pthread_event_set(event, 1u << i);
+			pthread_event_wait(answer, 1u << i, PTHREAD_EVENT_ALL, PTHREAD_EVENT_CLEAR, PTHREAD_WAIT);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	csw = context_switches() - csw;
+
+	for (i = 0; i < nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	printf("%8d %16.0f %16.2f\n", nthreads, (double) rounds * nthreads / secs,
+		   (double) csw / ((double) rounds * nthreads));
+}
+
+/**************************************************************************************************/
+int main(int argc, char *argv[])
+{
+	int				max_threads = (argc > 1) ? atoi(argv[1]) : MAX_WAITERS;
+	int				n;
+
+	rounds = (argc > 2) ? atoi(argv[2]) : 2000;
+	if (max_threads > MAX_WAITERS)
+		max_threads = MAX_WAITERS;
+
+	if (pthread_event_create(&event) || pthread_event_create(&answer))
+	{
+		fprintf(stderr, "event create failed\n");
+		return 1;
+	}
+
+	printf("%8s %16s %16s\n", "waiters", "handoffs/s", "csw/set");
+	for (n = 1; n <= max_threads; n *= 2)
+		run(n);
+
+	pthread_event_destroy(event);
+	pthread_event_destroy(answer);
+
+	return 0;
+}
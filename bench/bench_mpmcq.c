@@ -0,0 +1,136 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014, Stephen Scott
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/* 
+ * Contention benchmark: pthread_mpmcq_t against the mutex based pthread_queue_t.
+ *
+ * For each thread count N, N producers and N consumers move a fixed total number of 8 byte
+ * messages through one queue, and the aggregate throughput is reported.
+ *
+ * cc -O2 -pthread -I.. bench_mpmcq.c ../pthread_queue.c ../pthread_mpmcq.c ../pthread_ext_wait.c ../pthread_ext_common.c
+ *
+ * usage: bench_mpmcq [max_threads] [total_msgs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "pthread_queue.h"
+#include "pthread_mpmcq.h"
+
+#define QUEUE_SIZE	1024
+
+typedef struct {
+	int			(*send)(void *queue, void *msg, long timeout);
+	int			(*get)(void *queue, void *msg, long timeout);
+	void		  *	queue;
+	uint64_t		count;
+} worker_t;
+
+static int queue_send(void *queue, void *msg, long timeout) { return pthread_queue_sendmsg(queue, msg, timeout); }
+static int queue_get(void *queue, void *msg, long timeout)  { return pthread_queue_getmsg(queue, msg, timeout); }
+static int mpmcq_send(void *queue, void *msg, long timeout) { return pthread_mpmcq_sendmsg(queue, msg, timeout); }
+static int mpmcq_get(void *queue, void *msg, long timeout)  { return pthread_mpmcq_getmsg(queue, msg, timeout); }
+
+/**************************************************************************************************/
+static void *producer(void *arg)
+{
+	worker_t	  *	w = (worker_t *) arg;
+	uint64_t		i;
+
+	for (i = 0; i < w->count; i++)
+		w->send(w->queue, &i, PTHREAD_WAIT);
+
+	return NULL;
+}
+
+/**************************************************************************************************/
+static void *consumer(void *arg)
+{
+	worker_t	  *	w = (worker_t *) arg;
+	uint64_t		i, msg;
+
+	for (i = 0; i < w->count; i++)
+		w->get(w->queue, &msg, PTHREAD_WAIT);
+
+	return NULL;
+}
+
+/**************************************************************************************************/
+static double run(worker_t *proto, int nthreads, uint64_t total)
+{
+	pthread_t		threads[2 * nthreads];
+	worker_t		w = *proto;
+	struct timespec	start, end;
+	int				i;
+
+	w.count = total / nthreads;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < nthreads; i++)
+	{
+		pthread_create(&threads[2*i], NULL, consumer, &w);
+		pthread_create(&threads[2*i+1], NULL, producer, &w);
+	}
+	for (i = 0; i < 2 * nthreads; i++)
+		pthread_join(threads[i], NULL);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return (double)(w.count * nthreads) /
+		((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+}
+
+/**************************************************************************************************/
+int main(int argc, char *argv[])
+{
+	int				max_threads = (argc > 1) ? atoi(argv[1]) : 32;
+	uint64_t		total = (argc > 2) ? strtoull(argv[2], NULL, 0) : 4000000;
+	pthread_queue_t	  *	queue = NULL;
+	pthread_mpmcq_t	  *	mpmcq = NULL;
+	worker_t		wq = { queue_send, queue_get, NULL, 0 };
+	worker_t		wm = { mpmcq_send, mpmcq_get, NULL, 0 };
+	int				n;
+
+	if (pthread_queue_create(&queue, NULL, QUEUE_SIZE, sizeof(uint64_t)) ||
+		pthread_mpmcq_create(&mpmcq, NULL, QUEUE_SIZE, sizeof(uint64_t)))
+	{
+		fprintf(stderr, "queue create failed\n");
+		return 1;
+	}
+	wq.queue = queue;
+	wm.queue = mpmcq;
+
+	printf("%8s %16s %16s\n", "threads", "mutex msg/s", "mpmc msg/s");
+	for (n = 1; n <= max_threads; n *= 2)
+		printf("%8d %16.0f %16.0f\n", n, run(&wq, n, total), run(&wm, n, total));
+
+	pthread_queue_destroy(queue);
+	pthread_mpmcq_destroy(mpmcq);
+
+	return 0;
+}
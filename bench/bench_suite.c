@@ -0,0 +1,549 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014, Stephen Scott
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/* 
+ * Benchmark suite: queue and event primitives, with the results written as JSON so they can
+ * be kept and compared from one build to the next.
+ *
+ * Scenarios, all run by default or those named on the command line:
+ *
+ *   spsc_pingpong   round trip latency between two threads over a pair of SPSC queues, for
+ *                   each wait policy
+ *   mpmc_scaling    throughput of N producers and N consumers on one queue, N = 1, 2, 4 ..
+ *                   max_threads, for the mutex queue and pthread_mpmcq_t
+ *   msg_size        throughput of one producer and one consumer for messages of 8 bytes to
+ *                   64 KB, mutex and SPSC queues
+ *   event_latency   cost of an uncontended set and clear, and round trip latency of a set
+ *                   answered by a waiting thread, for each wait policy
+ *   timeout         cost of passing a timeout to a send and get that need not wait, of a
+ *                   PTHREAD_NOWAIT get of an empty queue, and how late a short timed wait
+ *                   returns
+ *
+ * Each result is one object in "results", naming the scenario, the case, the thread count
+ * and message length, and the measurements. Latencies are in ns, with percentiles read
+ * from a pthread_ext_hist histogram.
+ *
+ * Built by CMake as bench_suite, or:
+ * cc -O2 -pthread -I.. bench_suite.c ../pthread_queue.c ../pthread_mpmcq.c ../pthread_event.c ../pthread_ext_wait.c ../pthread_ext_common.c
+ *
+ * usage: bench_suite [-n msgs] [-t max_threads] [-o file] [scenario ...]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "pthread_queue.h"
+#include "pthread_mpmcq.h"
+#include "pthread_event.h"
+
+#define QUEUE_SIZE		1024
+#define SWEEP_QUEUE_SIZE	64
+#define SWEEP_MAX_BYTES	(256u << 20)		/* data moved per message size, at most */
+#define MAX_MSG_LEN		65536
+#define MAX_THREADS		64
+
+static const struct { const char *name; pthread_ext_wait_mode mode; } policies[] = {
+	{ "park",		PTHREAD_EXT_WAIT_PARK },
+	{ "spin",		PTHREAD_EXT_WAIT_SPIN },
+	{ "adaptive",	PTHREAD_EXT_WAIT_ADAPTIVE },
+};
+#define NPOLICIES	(sizeof(policies) / sizeof(policies[0]))
+
+typedef struct {
+	int			(*send)(void *queue, void *msg, long timeout);
+	int			(*get)(void *queue, void *msg, long timeout);
+	void		  *	queue;
+	uint32_t		msg_len;
+	uint64_t		count;
+} worker_t;
+
+static int queue_send(void *queue, void *msg, long timeout) { return pthread_queue_sendmsg(queue, msg, timeout); }
+static int queue_get(void *queue, void *msg, long timeout)  { return pthread_queue_getmsg(queue, msg, timeout); }
+static int mpmcq_send(void *queue, void *msg, long timeout) { return pthread_mpmcq_sendmsg(queue, msg, timeout); }
+static int mpmcq_get(void *queue, void *msg, long timeout)  { return pthread_mpmcq_getmsg(queue, msg, timeout); }
+
+static FILE			  *	out;
+static uint64_t			msgs = 1000000;
+static int				max_threads;
+static int				nresults;
+static int				stop;
+
+/**************************************************************************************************/
+/* result_begin
+ * open a result object. Values are added with result_value and it is closed by result_end.
+ */
+static void result_begin(const char *scenario, const char *name, int threads, uint32_t msg_len)
+{
+	fprintf(out, "%s\n    {\"scenario\": \"%s\", \"case\": \"%s\", \"threads\": %d, \"msg_len\": %u",
+			nresults++ ? "," : "", scenario, name, threads, msg_len);
+}
+
+/**************************************************************************************************/
+static void result_value(const char *key, double value)
+{
+	fprintf(out, ", \"%s\": %.1f", key, value);
+}
+
+/**************************************************************************************************/
+static void result_end(void)
+{
+	fprintf(out, "}");
+	fflush(out);
+}
+
+/**************************************************************************************************/
+/* result_hist
+ * mean and percentiles of a latency histogram.
+ */
+static void result_hist(const uint64_t *hist, double total_ns, uint64_t n)
+{
+	result_value("mean_ns", total_ns / n);
+	result_value("p50_ns", (double) pthread_ext_hist_percentile(hist, 50.0));
+	result_value("p99_ns", (double) pthread_ext_hist_percentile(hist, 99.0));
+	result_value("p999_ns", (double) pthread_ext_hist_percentile(hist, 99.9));
+}
+
+/**************************************************************************************************/
+static void *producer(void *arg)
+{
+	worker_t	  *	w = (worker_t *) arg;
+	char			msg[MAX_MSG_LEN] = { 0 };
+	uint64_t		i;
+
+	for (i = 0; i < w->count; i++)
+		w->send(w->queue, msg, PTHREAD_WAIT);
+
+	return NULL;
+}
+
+/**************************************************************************************************/
+static void *consumer(void *arg)
+{
+	worker_t	  *	w = (worker_t *) arg;
+	char			msg[MAX_MSG_LEN];
+	uint64_t		i;
+
+	for (i = 0; i < w->count; i++)
+		w->get(w->queue, msg, PTHREAD_WAIT);
+
+	return NULL;
+}
+
+/**************************************************************************************************/
+/* run_threads
+ * nthreads producers and nthreads consumers each move w->count messages. Returns seconds.
+ */
+static double run_threads(worker_t *w, int nthreads)
+{
+	pthread_t		threads[2 * MAX_THREADS];
+	uint64_t		start = pthread_ext_now_ns();
+	int				i;
+
+	for (i = 0; i < nthreads; i++)
+	{
+		pthread_create(&threads[2*i], NULL, consumer, w);
+		pthread_create(&threads[2*i+1], NULL, producer, w);
+	}
+	for (i = 0; i < 2 * nthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	return (pthread_ext_now_ns() - start) / 1e9;
+}
+
+/**************************************************************************************************/
+static void *echo(void *arg)
+{
+	pthread_queue_t	  **queues = (pthread_queue_t **) arg;
+	uint64_t		msg;
+
+	for (;;)
+	{
+		pthread_queue_getmsg(queues[0], &msg, PTHREAD_WAIT);
+		pthread_queue_sendmsg(queues[1], &msg, PTHREAD_WAIT);
+		if (UINT64_MAX == msg)
+			return NULL;
+	}
+}
+
+/**************************************************************************************************/
+/* bench_spsc_pingpong
+ * one 8 byte message bounces between two threads; each round trip is timed.
+ */
+static void bench_spsc_pingpong(void)
+{
+	static uint64_t	hist[PTHREAD_EXT_HIST_BUCKETS];
+	pthread_queue_attr_t	attr;
+	pthread_queue_t	  *	queues[2];
+	pthread_t		thread;
+	uint64_t		rounds = msgs / 10;
+	uint64_t		msg, t, start;
+	unsigned		p;
+
+	for (p = 0; p < NPOLICIES; p++)
+	{
+		pthread_queue_attr_init(&attr);
+		attr.flags = PTHREAD_QUEUE_SPSC | PTHREAD_QUEUE_POW2;
+		attr.wait.mode = policies[p].mode;
+		queues[0] = queues[1] = NULL;
+		if (pthread_queue_create_ex(&queues[0], NULL, 64, sizeof(uint64_t), &attr) ||
+			pthread_queue_create_ex(&queues[1], NULL, 64, sizeof(uint64_t), &attr))
+		{
+			fprintf(stderr, "queue create failed\n");
+			exit(1);
+		}
+
+		memset(hist, 0, sizeof(hist));
+		pthread_create(&thread, NULL, echo, queues);
+		start = pthread_ext_now_ns();
+		for (msg = 0; msg < rounds; msg++)
+		{
+			t = pthread_ext_now_ns();
+			pthread_queue_sendmsg(queues[0], &msg, PTHREAD_WAIT);
+			pthread_queue_getmsg(queues[1], &msg, PTHREAD_WAIT);
+			hist[pthread_ext_hist_bucket(pthread_ext_now_ns() - t)]++;
+		}
+		t = pthread_ext_now_ns() - start;
+
+		msg = UINT64_MAX;
+		pthread_queue_sendmsg(queues[0], &msg, PTHREAD_WAIT);
+		pthread_queue_getmsg(queues[1], &msg, PTHREAD_WAIT);
+		pthread_join(thread, NULL);
+		pthread_queue_destroy(queues[0]);
+		pthread_queue_destroy(queues[1]);
+
+		result_begin("spsc_pingpong", policies[p].name, 2, sizeof(uint64_t));
+		result_hist(hist, (double) t, rounds);
+		result_end();
+	}
+}
+
+/**************************************************************************************************/
+/* bench_mpmc_scaling
+ * aggregate throughput against the number of producer/consumer pairs.
+ */
+static void bench_mpmc_scaling(void)
+{
+	pthread_queue_t	  *	queue = NULL;
+	pthread_mpmcq_t	  *	mpmcq = NULL;
+	worker_t		w;
+	int				n;
+
+	if (pthread_queue_create(&queue, NULL, QUEUE_SIZE, sizeof(uint64_t)) ||
+		pthread_mpmcq_create(&mpmcq, NULL, QUEUE_SIZE, sizeof(uint64_t)))
+	{
+		fprintf(stderr, "queue create failed\n");
+		exit(1);
+	}
+
+	for (n = 1; n <= max_threads; n *= 2)
+	{
+		w = (worker_t) { queue_send, queue_get, queue, sizeof(uint64_t), msgs / n };
+		result_begin("mpmc_scaling", "mutex", n, sizeof(uint64_t));
+		result_value("msgs_per_s", (w.count * n) / run_threads(&w, n));
+		result_end();
+
+		w = (worker_t) { mpmcq_send, mpmcq_get, mpmcq, sizeof(uint64_t), msgs / n };
+		result_begin("mpmc_scaling", "mpmcq", n, sizeof(uint64_t));
+		result_value("msgs_per_s", (w.count * n) / run_threads(&w, n));
+		result_end();
+	}
+
+	pthread_queue_destroy(queue);
+	pthread_mpmcq_destroy(mpmcq);
+}
+
+/**************************************************************************************************/
+/* bench_msg_size
+ * one producer, one consumer, message sizes 8 bytes to 64 KB by powers of 4 and the largest.
+ */
+static void bench_msg_size(void)
+{
+	static const struct { const char *name; uint32_t flags; } modes[] = {
+		{ "mutex",	PTHREAD_QUEUE_POW2 },
+		{ "spsc",	PTHREAD_QUEUE_SPSC | PTHREAD_QUEUE_POW2 },
+	};
+	pthread_queue_attr_t	attr;
+	pthread_queue_t	  *	queue;
+	worker_t		w;
+	uint32_t		len;
+	double			secs;
+	unsigned		m;
+
+	for (len = 8; len <= MAX_MSG_LEN; len = (len < MAX_MSG_LEN / 4) ? len * 4 : len * 2)
+	{
+		for (m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+		{
+			pthread_queue_attr_init(&attr);
+			attr.flags = modes[m].flags;
+			queue = NULL;
+			if (pthread_queue_create_ex(&queue, NULL, SWEEP_QUEUE_SIZE, len, &attr))
+			{
+				fprintf(stderr, "queue create failed\n");
+				exit(1);
+			}
+
+			w = (worker_t) { queue_send, queue_get, queue, len, msgs };
+			if (w.count > SWEEP_MAX_BYTES / len)
+				w.count = SWEEP_MAX_BYTES / len;
+			secs = run_threads(&w, 1);
+			pthread_queue_destroy(queue);
+
+			result_begin("msg_size", modes[m].name, 1, len);
+			result_value("msgs_per_s", w.count / secs);
+			result_value("mb_per_s", w.count * (double) len / secs / 1e6);
+			result_end();
+		}
+	}
+}
+
+/**************************************************************************************************/
+static void *answer(void *arg)
+{
+	pthread_event_t	  **events = (pthread_event_t **) arg;
+
+	for (;;)
+	{
+		pthread_event_wait(events[0], 1, PTHREAD_EVENT_ANY, PTHREAD_EVENT_CLEAR, PTHREAD_WAIT);
+		if (__atomic_load_n(&stop, __ATOMIC_ACQUIRE))
+			return NULL;
+		pthread_event_set(events[1], 1);
+	}
+}
+
+/**************************************************************************************************/
+/* bench_event_latency
+ * set and clear with nobody waiting, then a set answered by a thread blocked on the bit.
+ */
+static void bench_event_latency(void)
+{
+	static uint64_t	hist[PTHREAD_EXT_HIST_BUCKETS];
+	pthread_event_attr_t	attr;
+	pthread_event_t	  *	events[2];
+	pthread_t		thread;
+	uint64_t		rounds = msgs / 10;
+	uint64_t		i, t, start;
+	unsigned		p;
+
+	for (p = 0; p < NPOLICIES; p++)
+	{
+		pthread_event_attr_init(&attr);
+		attr.wait.mode = policies[p].mode;
+		events[0] = events[1] = NULL;
+		if (pthread_event_create_ex(&events[0], &attr) || pthread_event_create_ex(&events[1], &attr))
+		{
+			fprintf(stderr, "event create failed\n");
+			exit(1);
+		}
+
+		if (0 == p)
+		{
+			start = pthread_ext_now_ns();
+			for (i = 0; i < msgs; i++)
+			{
+				pthread_event_set(events[0], 1);
+				pthread_event_clr(events[0], 1);
+			}
+			result_begin("event_latency", "set_clr", 1, 0);
+			result_value("ns", (pthread_ext_now_ns() - start) / (double) msgs);
+			result_end();
+		}
+
+		memset(hist, 0, sizeof(hist));
+		pthread_create(&thread, NULL, answer, events);
+		start = pthread_ext_now_ns();
+		for (i = 0; i < rounds; i++)
+		{
+			t = pthread_ext_now_ns();
+			pthread_event_set(events[0], 1);
+			pthread_event_wait(events[1], 1, PTHREAD_EVENT_ALL, PTHREAD_EVENT_CLEAR, PTHREAD_WAIT);
+			hist[pthread_ext_hist_bucket(pthread_ext_now_ns() - t)]++;
+		}
+		t = pthread_ext_now_ns() - start;
+
+		__atomic_store_n(&stop, 1, __ATOMIC_RELEASE);
+		pthread_event_set(events[0], 1);
+		pthread_join(thread, NULL);
+		stop = 0;
+		pthread_event_destroy(events[0]);
+		pthread_event_destroy(events[1]);
+
+		result_begin("event_latency", policies[p].name, 2, 0);
+		result_hist(hist, (double) t, rounds);
+		result_end();
+	}
+}
+
+/**************************************************************************************************/
+/* bench_timeout
+ * what a timeout costs when the call does not have to wait, and how precise a timed wait is.
+ */
+static void bench_timeout(void)
+{
+	static uint64_t	hist[PTHREAD_EXT_HIST_BUCKETS];
+	static const char *names[] = { "wait", "timeout_ms", "timeout_ns", "nowait_empty" };
+	pthread_queue_t	  *	queue = NULL;
+	uint64_t		msg = 0;
+	uint64_t		i, t, start, late;
+	uint64_t		rounds = msgs / 5000 + 1;
+	int				c;
+
+	if (pthread_queue_create(&queue, NULL, QUEUE_SIZE, sizeof(uint64_t)))
+	{
+		fprintf(stderr, "queue create failed\n");
+		exit(1);
+	}
+
+	for (c = 0; c < 4; c++)
+	{
+		start = pthread_ext_now_ns();
+		for (i = 0; i < msgs; i++)
+		{
+			switch (c)
+			{
+			case 0:
+				pthread_queue_sendmsg(queue, &msg, PTHREAD_WAIT);
+				pthread_queue_getmsg(queue, &msg, PTHREAD_WAIT);
+				break;
+			case 1:
+				pthread_queue_sendmsg(queue, &msg, 1000);
+				pthread_queue_getmsg(queue, &msg, 1000);
+				break;
+			case 2:
+				pthread_queue_sendmsg_ns(queue, &msg, 1000000000ll);
+				pthread_queue_getmsg_ns(queue, &msg, 1000000000ll);
+				break;
+			default:
+				pthread_queue_getmsg(queue, &msg, PTHREAD_NOWAIT);
+				break;
+			}
+		}
+		result_begin("timeout", names[c], 1, sizeof(uint64_t));
+		result_value("ns", (pthread_ext_now_ns() - start) / (double) msgs);
+		result_end();
+	}
+
+	/* lateness of a 50 us timed wait on an empty queue */
+	memset(hist, 0, sizeof(hist));
+	late = 0;
+	for (i = 0; i < rounds; i++)
+	{
+		start = pthread_ext_now_ns();
+		pthread_queue_getmsg_ns(queue, &msg, 50000);
+		t = pthread_ext_now_ns() - start;
+		t = (t > 50000) ? t - 50000 : 0;
+		hist[pthread_ext_hist_bucket(t)]++;
+		late += t;
+	}
+	result_begin("timeout", "expiry_lateness", 1, sizeof(uint64_t));
+	result_hist(hist, (double) late, rounds);
+	result_end();
+
+	pthread_queue_destroy(queue);
+}
+
+static const struct { const char *name; void (*run)(void); } scenarios[] = {
+	{ "timeout",		bench_timeout },
+	{ "event_latency",	bench_event_latency },
+	{ "spsc_pingpong",	bench_spsc_pingpong },
+	{ "mpmc_scaling",	bench_mpmc_scaling },
+	{ "msg_size",		bench_msg_size },
+};
+#define NSCENARIOS	(sizeof(scenarios) / sizeof(scenarios[0]))
+
+/**************************************************************************************************/
+static void usage(void)
+{
+	unsigned		s;
+
+	fprintf(stderr, "usage: bench_suite [-n msgs] [-t max_threads] [-o file] [scenario ...]\nscenarios:");
+	for (s = 0; s < NSCENARIOS; s++)
+		fprintf(stderr, " %s", scenarios[s].name);
+	fprintf(stderr, "\n");
+	exit(2);
+}
+
+/**************************************************************************************************/
+int main(int argc, char *argv[])
+{
+	int				run[NSCENARIOS] = { 0 };
+	unsigned		s;
+	int				c, i;
+
+	out = stdout;
+	max_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+
+	while (-1 != (c = getopt(argc, argv, "n:t:o:")))
+	{
+		switch (c)
+		{
+		case 'n':
+			msgs = strtoull(optarg, NULL, 0);
+			break;
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 'o':
+			out = fopen(optarg, "w");
+			if (NULL == out)
+			{
+				perror(optarg);
+				return 1;
+			}
+			break;
+		default:
+			usage();
+		}
+	}
+	if ((0 == msgs) || (max_threads < 1))
+		usage();
+	if (max_threads > MAX_THREADS)
+		max_threads = MAX_THREADS;
+
+	for (i = optind; i < argc; i++)
+	{
+		for (s = 0; (s < NSCENARIOS) && strcmp(argv[i], scenarios[s].name); s++)
+			;
+		if (NSCENARIOS == s)
+			usage();
+		run[s] = 1;
+	}
+
+	fprintf(out, "{\n  \"suite\": \"pthread_ext\",\n  \"time\": %lld,\n  \"cpus\": %ld,\n  \"msgs\": %llu,\n"
+			"  \"results\": [", (long long) time(NULL), sysconf(_SC_NPROCESSORS_ONLN), (unsigned long long) msgs);
+	for (s = 0; s < NSCENARIOS; s++)
+		if (run[s] || (optind == argc))
+			scenarios[s].run();
+	fprintf(out, "\n  ]\n}\n");
+
+	if (out != stdout)
+		fclose(out);
+
+	return 0;
+}
@@ -0,0 +1,427 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014, Stephen Scott
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/* 
+ * pthread_bcast implementation
+ *
+ * Disruptor style ring. The writer copies message number seq into cell seq & mask, stamps
+ * the cell with seq and then publishes tail = seq+1; each subscriber reads up to tail and
+ * publishes its own cursor. The gated writer only scans the cursors when it catches up
+ * with the lowest one it last saw.
+ *
+ * In LOSSY mode the writer may overwrite a cell while a subscriber copies it out, so the
+ * cell sequence works as a seqlock: the writer marks the cell BCAST_WRITING before it
+ * copies, and the subscriber checks the cell sequence before and after its copy.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+
+#include "pthread_bcast.h"
+#include "pthread_ext_common.h"
+#include "pthread_ext_wait.h"
+
+#define BCAST_WRITING	UINT64_MAX	/* cell sequence while the writer copies a message in */
+
+/**************************************************************************************************/
+/* bcast_room
+ * writer: check that the cell at tail is free, scanning the subscriber cursors if the
+ * lowest one seen last time is too far behind. Returns ETIMEDOUT if the ring is full.
+ */
+static int bcast_room(pthread_bcast_t *bcast)
+{
+	uint64_t		tail = bcast->tail;
+	uint64_t		gate;
+	uint64_t		cursor;
+	uint32_t		i;
+
+	if ((bcast->flags & PTHREAD_BCAST_LOSSY) || (tail - bcast->gate < bcast->qsize))
+		return 0;
+
+	pthread_mutex_lock(&bcast->subs_lock);
+	gate = tail;
+	for (i = 0; i < bcast->max_subs; i++)
+	{
+		if (bcast->subs[i].active)
+		{
+			cursor = __atomic_load_n(&bcast->subs[i].cursor, __ATOMIC_ACQUIRE);
+			if (cursor < gate)
+				gate = cursor;
+		}
+	}
+	pthread_mutex_unlock(&bcast->subs_lock);
+
+	bcast->gate = gate;
+
+	return (tail - gate < bcast->qsize) ? 0 : ETIMEDOUT;
+}
+
+/**************************************************************************************************/
+/* bcast_put
+ * writer: copy the message into the cell at tail and publish it.
+ */
+static void bcast_put(pthread_bcast_t *bcast, void *msg)
+{
+	uint64_t		tail = bcast->tail;
+	uint64_t	  *	cell = (uint64_t *) &bcast->buffer[(tail & bcast->mask) * bcast->cell_len];
+
+	if (bcast->flags & PTHREAD_BCAST_LOSSY)
+	{
+		__atomic_store_n(cell, BCAST_WRITING, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+	}
+
+	memcpy(cell + 1, msg, bcast->msg_len);
+	__atomic_store_n(cell, tail, __ATOMIC_RELEASE);
+	__atomic_store_n(&bcast->tail, tail+1, __ATOMIC_RELEASE);
+}
+
+/**************************************************************************************************/
+/* bcast_try_get
+ * subscriber: copy out the message at the cursor. Returns ETIMEDOUT if there is nothing new.
+ */
+static int bcast_try_get(pthread_bcast_sub_t *sub, void *msg)
+{
+	pthread_bcast_t * bcast = sub->bcast;
+	uint64_t		pos = sub->cursor;
+	uint64_t		tail;
+	uint64_t	  *	cell;
+
+	for (;;)
+	{
+		tail = __atomic_load_n(&bcast->tail, __ATOMIC_ACQUIRE);
+		if (pos == tail)
+			return ETIMEDOUT;
+
+		cell = (uint64_t *) &bcast->buffer[(pos & bcast->mask) * bcast->cell_len];
+		if (0 == (bcast->flags & PTHREAD_BCAST_LOSSY))
+		{
+			memcpy(msg, cell + 1, bcast->msg_len);
+			break;
+		}
+
+		/* lapped: skip to the oldest message still in the ring */
+		if (tail - pos > bcast->qsize)
+		{
+			sub->drops += tail - bcast->qsize - pos;
+			pos = tail - bcast->qsize;
+			continue;
+		}
+
+		/* the writer may be reusing the cell: check its sequence around the copy */
+		if (__atomic_load_n(cell, __ATOMIC_ACQUIRE) != pos)
+			continue;
+		memcpy(msg, cell + 1, bcast->msg_len);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(cell, __ATOMIC_RELAXED) == pos)
+			break;
+	}
+
+	__atomic_store_n(&sub->cursor, pos+1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* pthread_bcast_create
+ * create and initialize a new broadcast ring.
+ */
+int pthread_bcast_create(pthread_bcast_t ** ppbcast, uint32_t num_msg, uint32_t msg_len_bytes,
+						 uint32_t max_subs, uint32_t flags)
+{
+	pthread_bcast_t * bcast;
+
+	if ((0 == num_msg) || (num_msg & (num_msg - 1)) || (0 == max_subs) || (flags & ~PTHREAD_BCAST_LOSSY))
+		return EINVAL;
+
+	if (0 != posix_memalign((void **) &bcast, PTHREAD_EXT_CACHE_LINE, sizeof(pthread_bcast_t)))
+		return ENOMEM;
+
+	bcast->buffer = (char *) malloc(PTHREAD_BCAST_BUFFER_SIZE(num_msg, msg_len_bytes));
+	if ( (NULL == bcast->buffer) ||
+		 (0 != posix_memalign((void **) &bcast->subs, PTHREAD_EXT_CACHE_LINE, max_subs * sizeof(pthread_bcast_sub_t))) )
+	{
+		free(bcast->buffer);
+		free(bcast);
+		return ENOMEM;
+	}
+	memset(bcast->subs, 0, max_subs * sizeof(pthread_bcast_sub_t));
+
+	pthread_mutex_init(&bcast->subs_lock, NULL);
+	pthread_ext_waitq_init(&bcast->space);
+	pthread_ext_waitq_init(&bcast->data);
+	bcast->qsize = num_msg;
+	bcast->mask = num_msg - 1;
+	bcast->msg_len = msg_len_bytes;
+	bcast->cell_len = PTHREAD_BCAST_CELL_LEN(msg_len_bytes);
+	bcast->max_subs = max_subs;
+	bcast->flags = flags;
+	bcast->tail = 0;
+	bcast->gate = 0;
+
+	*ppbcast = bcast;
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* pthread_bcast_destroy
+ * free a broadcast ring.
+ */
+void pthread_bcast_destroy(pthread_bcast_t *bcast)
+{
+	pthread_mutex_destroy(&bcast->subs_lock);
+	pthread_ext_waitq_destroy(&bcast->space);
+	pthread_ext_waitq_destroy(&bcast->data);
+	free(bcast->buffer);
+	free(bcast->subs);
+	free(bcast);
+
+} /* pthread_bcast_destroy */
+
+
+/**************************************************************************************************/
+/* pthread_bcast_subscribe
+ * take a free subscriber slot, starting at the current tail.
+ * The writer scans cursors under subs_lock, so the tail read here is at least the tail of
+ * its last scan, and the lowest cursor it keeps cannot be ahead of the new one.
+ */
+int pthread_bcast_subscribe(pthread_bcast_t *bcast, pthread_bcast_sub_t ** psub)
+{
+	pthread_bcast_sub_t * sub;
+	uint32_t		i;
+
+	pthread_mutex_lock(&bcast->subs_lock);
+	for (i = 0; i < bcast->max_subs; i++)
+	{
+		sub = &bcast->subs[i];
+		if (0 == sub->active)
+		{
+			sub->cursor = __atomic_load_n(&bcast->tail, __ATOMIC_ACQUIRE);
+			sub->drops = 0;
+			sub->bcast = bcast;
+			sub->active = 1;
+			pthread_mutex_unlock(&bcast->subs_lock);
+
+			*psub = sub;
+			return 0;
+		}
+	}
+	pthread_mutex_unlock(&bcast->subs_lock);
+
+	return EAGAIN;
+
+} /* pthread_bcast_subscribe */
+
+
+/**************************************************************************************************/
+/* pthread_bcast_unsubscribe
+ * free the subscriber slot and let the writer look at the cursors again.
+ */
+void pthread_bcast_unsubscribe(pthread_bcast_sub_t *sub)
+{
+	pthread_bcast_t * bcast = sub->bcast;
+
+	pthread_mutex_lock(&bcast->subs_lock);
+	sub->active = 0;
+	pthread_mutex_unlock(&bcast->subs_lock);
+
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	pthread_ext_waitq_wake(&bcast->space, 1);
+
+} /* pthread_bcast_unsubscribe */
+
+
+/**************************************************************************************************/
+/* pthread_bcast_sendmsg
+ * puts new message in the ring for every subscriber.
+ * timeout is PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ */
+int pthread_bcast_sendmsg(pthread_bcast_t *bcast, void *msg, long timeout)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout) && (timeout < 0) )
+		return EINVAL;
+
+	return pthread_bcast_sendmsg_until(bcast, msg, pthread_ext_deadline_ms(timeout, &abstime));
+
+} /* pthread_bcast_sendmsg */
+
+
+/**************************************************************************************************/
+/* pthread_bcast_sendmsg_ns
+ * as pthread_bcast_sendmsg, with the timeout in nanoseconds.
+ */
+int pthread_bcast_sendmsg_ns(pthread_bcast_t *bcast, void *msg, long long timeout_ns)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0) )
+		return EINVAL;
+
+	return pthread_bcast_sendmsg_until(bcast, msg, pthread_ext_deadline_ns(timeout_ns, &abstime));
+
+} /* pthread_bcast_sendmsg_ns */
+
+
+/**************************************************************************************************/
+/* pthread_bcast_sendmsg_until
+ * as pthread_bcast_sendmsg, waiting until an absolute PTHREAD_EXT_CLOCK deadline.
+ */
+int pthread_bcast_sendmsg_until(pthread_bcast_t *bcast, void *msg, const struct timespec *deadline)
+{
+	uint32_t		seq;
+	int				result;
+
+	result = bcast_room(bcast);
+	if ( (0 != result) && (PTHREAD_EXT_DEADLINE_NOW != deadline) )
+	{
+		/* wait while the slowest subscriber is a whole ring behind */
+		for (;;)
+		{
+			seq = pthread_ext_waitq_prepare(&bcast->space);
+			result = bcast_room(bcast);
+			if (0 == result)
+			{
+				pthread_ext_waitq_cancel(&bcast->space);
+				break;
+			}
+
+			result = pthread_ext_waitq_wait(&bcast->space, seq, deadline);
+			if (ETIMEDOUT == result)
+				break;
+		}
+	}
+
+	/* publish and signal waiting subscribers */
+	if (0 == result)
+	{
+		bcast_put(bcast, msg);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		pthread_ext_waitq_wake(&bcast->data, PTHREAD_EXT_WAKE_ALL);
+	}
+
+	return result;
+
+} /* pthread_bcast_sendmsg_until */
+
+
+/**************************************************************************************************/
+/* pthread_bcast_getmsg
+ * gets the next message for a subscriber.
+ * timeout is PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ */
+int pthread_bcast_getmsg(pthread_bcast_sub_t *sub, void *msg, long timeout)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout) && (timeout < 0) )
+		return EINVAL;
+
+	return pthread_bcast_getmsg_until(sub, msg, pthread_ext_deadline_ms(timeout, &abstime));
+
+} /* pthread_bcast_getmsg */
+
+
+/**************************************************************************************************/
+/* pthread_bcast_getmsg_ns
+ * as pthread_bcast_getmsg, with the timeout in nanoseconds.
+ */
+int pthread_bcast_getmsg_ns(pthread_bcast_sub_t *sub, void *msg, long long timeout_ns)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0) )
+		return EINVAL;
+
+	return pthread_bcast_getmsg_until(sub, msg, pthread_ext_deadline_ns(timeout_ns, &abstime));
+
+} /* pthread_bcast_getmsg_ns */
+
+
+/**************************************************************************************************/
+/* pthread_bcast_getmsg_until
+ * as pthread_bcast_getmsg, waiting until an absolute PTHREAD_EXT_CLOCK deadline.
+ */
+int pthread_bcast_getmsg_until(pthread_bcast_sub_t *sub, void *msg, const struct timespec *deadline)
+{
+	pthread_bcast_t * bcast = sub->bcast;
+	uint32_t		seq;
+	int				result;
+
+	result = bcast_try_get(sub, msg);
+	if ( (0 != result) && (PTHREAD_EXT_DEADLINE_NOW != deadline) )
+	{
+		/* wait while there is nothing new */
+		for (;;)
+		{
+			seq = pthread_ext_waitq_prepare(&bcast->data);
+			result = bcast_try_get(sub, msg);
+			if (0 == result)
+			{
+				pthread_ext_waitq_cancel(&bcast->data);
+				break;
+			}
+
+			result = pthread_ext_waitq_wait(&bcast->data, seq, deadline);
+			if (ETIMEDOUT == result)
+				break;
+		}
+	}
+
+	/* signal waiting writer */
+	if ( (0 == result) && (0 == (bcast->flags & PTHREAD_BCAST_LOSSY)) )
+	{
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		pthread_ext_waitq_wake(&bcast->space, 1);
+	}
+
+	return result;
+
+} /* pthread_bcast_getmsg_until */
+
+/**************************************************************************************************/
+/* pthread_bcast_count
+ * return number of messages left to read
+ */
+uint32_t pthread_bcast_count(pthread_bcast_sub_t *sub)
+{
+	uint64_t		unread = __atomic_load_n(&sub->bcast->tail, __ATOMIC_ACQUIRE) - sub->cursor;
+
+	return (unread > sub->bcast->qsize) ? sub->bcast->qsize : (uint32_t) unread;
+}
+
+/**************************************************************************************************/
+/* pthread_bcast_drops
+ * return number of messages the subscriber missed
+ */
+uint64_t pthread_bcast_drops(pthread_bcast_sub_t *sub)
+{
+	return sub->drops;
+}
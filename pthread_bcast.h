@@ -0,0 +1,222 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014, Stephen Scott
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/** @file pthread_bcast.h
+ * @brief pthread single-writer broadcast ring with a read cursor per subscriber
+ */
+
+#ifndef PTHREAD_BCAST_H
+#define PTHREAD_BCAST_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "pthread_ext_common.h"
+#include "pthread_ext_wait.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Flags for pthread_bcast_create */
+#define PTHREAD_BCAST_LOSSY		0x0001	/* writer never waits, slow subscribers lose messages */
+
+/** Bytes of ring buffer needed for num_msg messages of msg_len bytes */
+#define PTHREAD_BCAST_CELL_LEN(msg_len)				(8 + (((msg_len) + 7) & ~7u))
+#define PTHREAD_BCAST_BUFFER_SIZE(num_msg, msg_len)	((size_t)(num_msg) * PTHREAD_BCAST_CELL_LEN(msg_len))
+
+struct pthread_bcast_s;
+
+typedef struct pthread_bcast_sub_s {
+	uint64_t		cursor PTHREAD_EXT_CACHE_ALIGNED;	/* next sequence to read */
+	uint64_t		drops;		/* LOSSY: messages overwritten before they were read */
+	struct pthread_bcast_s * bcast;	/* ring subscribed to */
+	uint32_t		active;		/* 1 = slot in use */
+} pthread_bcast_sub_t;
+
+typedef struct pthread_bcast_s {
+	char		  *	buffer;		/* ring of cells, each a sequence number and a message */
+	pthread_bcast_sub_t * subs;	/* subscriber slots */
+	pthread_mutex_t	subs_lock;	/* lock subscribe, unsubscribe and the writer's scan of cursors */
+	pthread_ext_waitq_t	space;	/* writer waits for the slowest subscriber */
+	pthread_ext_waitq_t	data;	/* subscribers wait for the writer */
+	uint32_t		qsize;		/* max number of messages in the ring */
+	uint32_t		mask;		/* qsize - 1 */
+	uint32_t		msg_len;	/* length of each message */
+	uint32_t		cell_len;	/* length of each cell */
+	uint32_t		max_subs;	/* number of subscriber slots */
+	uint32_t		flags;		/* PTHREAD_BCAST_xxx */
+
+	uint64_t		tail PTHREAD_EXT_CACHE_ALIGNED;	/* next sequence to write */
+	uint64_t		gate;		/* writer: lowest subscriber cursor when last scanned */
+} pthread_bcast_t;
+
+
+/** Create a broadcast ring with fixed length messages.
+ *
+ * One writer puts each message in the ring once, and every subscriber reads every message
+ * through a cursor of its own, so fan-out costs one copy whatever the number of
+ * subscribers. A subscriber sees the messages sent after it subscribed.
+ *
+ * By default the writer is gated by the slowest subscriber: it waits while that subscriber
+ * is num_msg messages behind. The writer keeps the lowest cursor it saw and only scans
+ * the subscribers again when that one is reached. With PTHREAD_BCAST_LOSSY the writer
+ * never waits, and a subscriber which falls more than num_msg messages behind skips to
+ * the oldest message still in the ring, counting what it missed (see pthread_bcast_drops).
+ *
+ * @param[out]   ppbcast		returns the ring pointer
+ * @param[in]    num_msg        number of messages in the ring, a power of two
+ * @param[in]    msg_len_bytes  size of each message in bytes
+ * @param[in]    max_subs		most subscribers at any one time
+ * @param[in]    flags			PTHREAD_BCAST_xxx
+ * @returns                   0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ENOMEM]            	memory for ring not available
+ *      [EINVAL]            	num_msg is not a power of two, max_subs is 0, or flags are invalid
+ */
+int pthread_bcast_create(pthread_bcast_t ** ppbcast, uint32_t num_msg, uint32_t msg_len_bytes,
+						 uint32_t max_subs, uint32_t flags);
+
+
+
+/** Destroy a broadcast ring. Subscribers must not be used afterwards.
+ *
+ * @param[in]  bcast          pointer to the ring to destroy
+ * @returns                   nothing
+ */
+void pthread_bcast_destroy(pthread_bcast_t *bcast);
+
+
+
+/** Subscribe to a broadcast ring.
+ *
+ * The subscriber reads the messages sent from now on. A subscriber is used by one thread
+ * at a time.
+ *
+ * @param[in]  bcast		pointer to the ring
+ * @param[out] psub			returns the subscriber
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [EAGAIN]            max_subs subscribers already
+ */
+int pthread_bcast_subscribe(pthread_bcast_t *bcast, pthread_bcast_sub_t ** psub);
+
+
+
+/** Unsubscribe from a broadcast ring, releasing a writer gated by this subscriber.
+ *
+ * @param[in]  sub			subscriber from pthread_bcast_subscribe
+ */
+void pthread_bcast_unsubscribe(pthread_bcast_sub_t *sub);
+
+
+
+/** Send message to every subscriber. Only one thread at a time may send.
+ *
+ * Same semantics as pthread_queue_sendmsg. A ring without subscribers drops the message.
+ *
+ * @param[in] bcast         pointer to the ring
+ * @param[in] msg           message to place in the ring
+ * @param[in] timeout       PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ETIMEDOUT]         timeout has passed (or, if PTHREAD_NOWAIT, the slowest subscriber
+ *                          is num_msg messages behind)
+ *      [EINVAL]            timeout value is invalid
+ */
+int pthread_bcast_sendmsg(pthread_bcast_t *bcast, void *msg, long timeout);
+
+
+
+/** Same as pthread_bcast_sendmsg, with the timeout in nanoseconds.
+ *
+ * @param[in] timeout_ns	PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ns
+ */
+int pthread_bcast_sendmsg_ns(pthread_bcast_t *bcast, void *msg, long long timeout_ns);
+
+
+
+/** Same as pthread_bcast_sendmsg, waiting until an absolute deadline.
+ *
+ * @param[in] deadline		absolute PTHREAD_EXT_CLOCK time, NULL to wait forever, or
+ *                          PTHREAD_EXT_DEADLINE_NOW not to wait
+ */
+int pthread_bcast_sendmsg_until(pthread_bcast_t *bcast, void *msg, const struct timespec * deadline);
+
+
+
+/** Get the next message for a subscriber.
+ *
+ * Same semantics as pthread_queue_getmsg.
+ *
+ * @param[in]  sub			subscriber from pthread_bcast_subscribe
+ * @param[out] msg			buffer to receive message from the ring
+ * @param[in]  timeout		PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ETIMEDOUT]         timeout has passed (or, if PTHREAD_NOWAIT, nothing new to read)
+ *      [EINVAL]            timeout value is invalid
+ */
+int pthread_bcast_getmsg(pthread_bcast_sub_t *sub, void *msg, long timeout);
+
+
+
+/** Same as pthread_bcast_getmsg, with the timeout in nanoseconds.
+ *
+ * @param[in] timeout_ns	PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ns
+ */
+int pthread_bcast_getmsg_ns(pthread_bcast_sub_t *sub, void *msg, long long timeout_ns);
+
+
+
+/** Same as pthread_bcast_getmsg, waiting until an absolute deadline.
+ *
+ * @param[in] deadline		absolute PTHREAD_EXT_CLOCK time, NULL to wait forever, or
+ *                          PTHREAD_EXT_DEADLINE_NOW not to wait
+ */
+int pthread_bcast_getmsg_until(pthread_bcast_sub_t *sub, void *msg, const struct timespec * deadline);
+
+
+
+/** Return number of messages a subscriber has still to read, at most num_msg.
+ *
+ * @param[in] sub			subscriber from pthread_bcast_subscribe
+ */
+uint32_t pthread_bcast_count(pthread_bcast_sub_t *sub);
+
+
+
+/** Return number of messages a subscriber of a PTHREAD_BCAST_LOSSY ring has missed.
+ *
+ * @param[in] sub			subscriber from pthread_bcast_subscribe
+ */
+uint64_t pthread_bcast_drops(pthread_bcast_sub_t *sub);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PTHREAD_BCAST_H */
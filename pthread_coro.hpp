@@ -0,0 +1,316 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014, Stephen Scott
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/** @file pthread_coro.hpp
+ * @brief C++20 coroutine awaitables for pthread queues and events
+ */
+
+#ifndef PTHREAD_CORO_HPP
+#define PTHREAD_CORO_HPP
+
+#if !defined(__cpp_impl_coroutine)
+#error "pthread_coro.hpp needs C++20 coroutines"
+#endif
+
+#include <errno.h>
+#include <atomic>
+#include <coroutine>
+#include <functional>
+#include <utility>
+
+#include "pthread_ext_wait.h"
+#include "pthread_event.h"
+#include "pthread_queue.hpp"
+
+namespace pthread_ext {
+
+/** An executor runs callables posted to it, on some thread of its own.
+ *
+ * post takes a std::function<void()>, or any callable (the awaiters post a lambda). It is
+ * called by the thread that makes a wait complete, under a spin lock of the wait queue: it
+ * must only queue the callable, not run it, and should not block for long.
+ */
+template <typename E>
+concept Executor = requires(E & ex, std::function<void()> fn) {
+	ex.post(std::move(fn));
+};
+
+/** Awaiter that retries a non-blocking call each time a wait queue is woken.
+ *
+ * Derived::attempt() makes the call and returns ETIMEDOUT while it would block.
+ * Derived::watch(watch, notify) adds a one-shot watch to the wait queue (see
+ * pthread_ext_waitq_notify). A suspended coroutine holds no thread: it is registered on the
+ * wait queue with the watch. The wake posts a retry to the executor, which resumes the
+ * coroutine once the call succeeds or fails for good, or arms the watch again.
+ *
+ * The wait queue must outlive the suspended coroutine, and a suspended coroutine must not
+ * be destroyed. Watches only work within one process, so not for PTHREAD_QUEUE_PSHARED.
+ */
+template <typename Derived, Executor Ex>
+class WaitqAwaiter
+{
+public:
+	WaitqAwaiter(pthread_ext_waitq_t * wq, Ex & ex) : wq_(wq), ex_(ex)
+	{
+		node_.self = this;
+	}
+
+	WaitqAwaiter(const WaitqAwaiter &) = delete;
+	WaitqAwaiter & operator=(const WaitqAwaiter &) = delete;
+
+	bool await_ready()
+	{
+		result_ = derived().attempt();
+		return ETIMEDOUT != result_;
+	}
+
+	bool await_suspend(std::coroutine_handle<> h)
+	{
+		handle_ = h;
+		return arm();
+	}
+
+	int await_resume() const
+	{
+		return result_;
+	}
+
+private:
+	enum { ARMING, WAITING, FIRED };
+
+	/* the watch is the first member, so the notify function finds the awaiter from it */
+	struct node_t {
+		pthread_ext_waitq_watch_t	watch;
+		WaitqAwaiter		  *	self;
+	};
+
+	Derived & derived()
+	{
+		return static_cast<Derived &>(*this);
+	}
+
+	/* register on the wait queue, link the watch and try again. Returns true if the
+	 * coroutine stays suspended, false if the call completed. A wake between the watch and
+	 * the state change finds ARMING and leaves the retry to this loop */
+	bool arm()
+	{
+		for (;;)
+		{
+			state_.store(ARMING, std::memory_order_relaxed);
+			pthread_ext_waitq_prepare(wq_);
+			derived().watch(&node_.watch, notify);
+
+			result_ = derived().attempt();
+			if (ETIMEDOUT != result_)
+			{
+				/* a wake taken by the watch meanwhile may have been meant for another waiter */
+				if (!pthread_ext_waitq_unwatch(wq_, &node_.watch))
+				{
+					pthread_ext_waitq_cancel(wq_);
+					pthread_ext_waitq_wake(wq_, 1);
+				}
+				else
+					pthread_ext_waitq_cancel(wq_);
+				return false;
+			}
+
+			int		expected = ARMING;
+
+			if (state_.compare_exchange_strong(expected, WAITING, std::memory_order_acq_rel))
+				return true;
+			pthread_ext_waitq_cancel(wq_);
+		}
+	}
+
+	/* runs on the executor after a wake */
+	void retry()
+	{
+		pthread_ext_waitq_cancel(wq_);
+		if (!arm())
+			handle_.resume();
+	}
+
+	/* runs in the waking thread, with the watch already unlinked */
+	static void notify(pthread_ext_waitq_watch_t * watch)
+	{
+		WaitqAwaiter  *	self = reinterpret_cast<node_t *>(watch)->self;
+
+		if (WAITING == self->state_.exchange(FIRED, std::memory_order_acq_rel))
+			self->ex_.post([self] { self->retry(); });
+	}
+
+	node_t					node_;
+	pthread_ext_waitq_t	  *	wq_;
+	Ex					  &	ex_;
+	std::coroutine_handle<>	handle_;
+	std::atomic<int>		state_{ARMING};
+	int						result_ = ETIMEDOUT;
+};
+
+/** Awaiter returned by recv. */
+template <typename T, uint32_t Capacity, uint32_t Flags, Executor Ex>
+class QueueRecv : public WaitqAwaiter<QueueRecv<T, Capacity, Flags, Ex>, Ex>
+{
+public:
+	QueueRecv(Queue<T, Capacity, Flags> & queue, T & msg, Ex & ex)
+		: WaitqAwaiter<QueueRecv, Ex>(&queue.native_handle()->empty, ex), queue_(queue), msg_(msg)
+	{
+	}
+
+	int attempt()
+	{
+		return queue_.get(msg_, PTHREAD_NOWAIT);
+	}
+
+	/* counted for the release of a peeked slot, if the watch is added during a peek */
+	void watch(pthread_ext_waitq_watch_t * watch, void (* notify)(pthread_ext_waitq_watch_t * watch))
+	{
+		pthread_queue_notify(queue_.native_handle(), watch, notify);
+	}
+
+private:
+	Queue<T, Capacity, Flags> & queue_;
+	T					  &	msg_;
+};
+
+/** Awaiter returned by wait.
+ *
+ * A suspended coroutine is a waiter record in the event's list (see pthread_event_notify),
+ * so only the set which satisfies its test resumes it.
+ */
+template <Executor Ex>
+class EventWait
+{
+public:
+	EventWait(pthread_event_t * event, pthread_event_mask64 mask, pthread_event_test test,
+			  pthread_event_action action, Ex & ex)
+		: event_(event), ex_(ex), mask_(mask), test_(test), action_(action)
+	{
+		node_.self = this;
+	}
+
+	EventWait(const EventWait &) = delete;
+	EventWait & operator=(const EventWait &) = delete;
+
+	bool await_ready()
+	{
+		result_ = pthread_event_wait64(event_, mask_, test_, action_, PTHREAD_NOWAIT);
+		return ETIMEDOUT != result_;
+	}
+
+	/* once the record is linked, a set may resume the coroutine on ex before this returns,
+	 * so nothing of the awaiter is used after pthread_event_notify */
+	bool await_suspend(std::coroutine_handle<> h)
+	{
+		int				result;
+
+		handle_ = h;
+		result = pthread_event_notify(event_, &node_.waiter, &mask_, 1, test_, action_, notify);
+		if (EINPROGRESS == result)
+			return true;
+
+		result_ = result;
+		return false;
+	}
+
+	int await_resume() const
+	{
+		return result_;
+	}
+
+private:
+	/* the waiter record is the first member, so the notify function finds the awaiter */
+	struct node_t {
+		pthread_event_waiter_t	waiter;
+		EventWait			  *	self;
+	};
+
+	/* runs in the setting thread, after the event mutex is released */
+	static void notify(pthread_event_waiter_t * w, int result)
+	{
+		EventWait	  *	self = reinterpret_cast<node_t *>(w)->self;
+
+		self->result_ = result;
+		self->ex_.post([h = self->handle_] { h.resume(); });
+	}
+
+	node_t					node_;
+	pthread_event_t		  *	event_;
+	Ex					  &	ex_;
+	pthread_event_mask64	mask_;
+	pthread_event_test		test_;
+	pthread_event_action	action_;
+	std::coroutine_handle<>	handle_;
+	int						result_ = ETIMEDOUT;
+};
+
+/** Get the oldest message of a queue without blocking a thread.
+ *
+ * int result = co_await pthread_ext::recv(queue, msg, ex);
+ *
+ * Completes at once if there is a message. Otherwise the coroutine is suspended until a
+ * send wakes it, and resumed on ex with the message; the result is 0 then. Like a thread
+ * blocked in get, a waiting coroutine is not cancelled by pthread_queue_reset. Any number
+ * of coroutines may wait on one queue. Each message sent wakes the oldest to retry, and the
+ * end of a peek wakes those which waited for the peeked slot (see pthread_queue_notify).
+ * With PTHREAD_QUEUE_SPSC only one coroutine or thread may receive.
+ *
+ * @param[in] queue			queue to receive from
+ * @param[out] msg			the message, when the result is 0
+ * @param[in] ex			executor to resume the coroutine on
+ */
+template <typename T, uint32_t Capacity, uint32_t Flags, Executor Ex>
+QueueRecv<T, Capacity, Flags, Ex> recv(Queue<T, Capacity, Flags> & queue, T & msg, Ex & ex)
+{
+	return QueueRecv<T, Capacity, Flags, Ex>(queue, msg, ex);
+}
+
+/** Wait for event bits without blocking a thread.
+ *
+ * int result = co_await pthread_ext::wait(event, mask, PTHREAD_EVENT_ANY, ex);
+ *
+ * Completes at once if the test is satisfied. Otherwise the coroutine waits in line with
+ * threads blocked in pthread_event_wait: the set which satisfies its test applies the
+ * action for it and resumes it on ex, and other sets do not touch it. The result is 0, or
+ * ECANCELED if the event was reset. The event must outlive the suspended coroutine, and a
+ * suspended coroutine must not be destroyed.
+ *
+ * @param[in] event			pointer to the event
+ * @param[in] mask			bits to test
+ * @param[in] test			PTHREAD_EVENT_ANY (logical OR), PTHREAD_EVENT_ALL (logical AND)
+ * @param[in] ex			executor to resume the coroutine on
+ * @param[in] action		PTHREAD_EVENT_CLEAR (clear event bits) or PTHREAD_EVENT_KEEP (leave as is)
+ */
+template <Executor Ex>
+EventWait<Ex> wait(pthread_event_t * event, pthread_event_mask64 mask, pthread_event_test test, Ex & ex,
+				   pthread_event_action action = PTHREAD_EVENT_CLEAR)
+{
+	return EventWait<Ex>(event, mask, test, action, ex);
+}
+
+} /* namespace pthread_ext */
+
+#endif /* PTHREAD_CORO_HPP */
@@ -32,14 +32,191 @@ THE SOFTWARE.
 #include <string.h>
 #include <pthread.h>
 #include <errno.h>
+#include <sched.h>
 
 #include "pthread_event.h"
 #include "pthread_ext_common.h"
 
+/* waiter state */
+#define WAITER_WAITING	0
+#define WAITER_DONE		1		/* test satisfied, action applied by the setter */
+#define WAITER_RESET	2		/* event was reset */
+
 /**************************************************************************************************/
-static void cleanup_handler(void *arg)
+/* event_test
+ * return nonzero if the event mask words satisfy the test. The loop has no early exit,
+ * so the compiler can vectorize it across the words.
+ */
+static inline int event_test(const pthread_event_mask64 *current, const pthread_event_mask64 *mask,
+							 unsigned nwords, pthread_event_test test)
 {
-	pthread_mutex_unlock((pthread_mutex_t*)arg);
+	pthread_event_mask64 any = 0;
+	pthread_event_mask64 missing = 0;
+	unsigned		i;
+
+	for (i = 0; i < nwords; i++)
+	{
+		any |= current[i] & mask[i];
+		missing |= mask[i] & ~current[i];
+	}
+
+	return (PTHREAD_EVENT_ANY == test) ? (0 != any) : (0 == missing);
+}
+
+/**************************************************************************************************/
+/* event_take
+ * test the event mask and, for PTHREAD_EVENT_CLEAR, clear the tested bits. Returns
+ * nonzero if the test was satisfied. One word is tested and cleared atomically. Several
+ * words are tested on a snapshot and cleared word by word, so on a bitmap event a
+ * PTHREAD_EVENT_CLEAR take must hold the mutex to keep other takers out; bits set
+ * meanwhile only add to the test, and a clear meanwhile is ordered after the take.
+ */
+static int event_take(pthread_event_t *event, const pthread_event_mask64 *mask, unsigned nwords,
+					  pthread_event_test test, pthread_event_action action)
+{
+	pthread_event_mask64 current[PTHREAD_EVENT_MAX_WORDS];
+	unsigned		i;
+
+	if (1 == nwords)
+	{
+		current[0] = __atomic_load_n(&event->bits[0], __ATOMIC_SEQ_CST);
+		do {
+			if (!event_test(current, mask, 1, test))
+				return 0;
+			if (PTHREAD_EVENT_CLEAR != action)
+				return 1;
+		} while (!__atomic_compare_exchange_n(&event->bits[0], &current[0], current[0] & ~mask[0], 1,
+											  __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+		return 1;
+	}
+
+	for (i = 0; i < nwords; i++)
+		current[i] = __atomic_load_n(&event->bits[i], __ATOMIC_SEQ_CST);
+
+	if (!event_test(current, mask, nwords, test))
+		return 0;
+
+	if (PTHREAD_EVENT_CLEAR == action)
+		for (i = 0; i < nwords; i++)
+			if (mask[i])
+				__atomic_fetch_and(&event->bits[i], ~mask[i], __ATOMIC_SEQ_CST);
+
+	return 1;
+}
+
+/**************************************************************************************************/
+/* waiter_unlink
+ * called with the mutex held. Remove a waiter from the list.
+ */
+static void waiter_unlink(pthread_event_t *event, pthread_event_waiter_t *w)
+{
+	if (w->prev)
+		w->prev->next = w->next;
+	else
+		event->waiters = w->next;
+
+	if (w->next)
+		w->next->prev = w->prev;
+	else
+		event->waiters_tail = w->prev;
+
+	__atomic_store_n(&event->nwaiters, event->nwaiters - 1, __ATOMIC_RELAXED);
+}
+
+/**************************************************************************************************/
+/* waiter_finish
+ * called with the mutex held. Complete a waiter and add it to the list *pwake of waiters
+ * to wake once the mutex is released. The waiter does not return before waiters_wake
+ * posts its park word.
+ */
+static void waiter_finish(pthread_event_t *event, pthread_event_waiter_t *w, uint32_t state,
+						  pthread_event_waiter_t ***pwake)
+{
+	waiter_unlink(event, w);
+	w->next = NULL;
+	w->state = state;
+
+	**pwake = w;
+	*pwake = &w->next;
+}
+
+/**************************************************************************************************/
+/* waiter_link
+ * called with the mutex held. Append a waiter record, counted already in nwaiters.
+ */
+static void waiter_link(pthread_event_t *event, pthread_event_waiter_t *w)
+{
+	w->next = NULL;
+	w->prev = event->waiters_tail;
+	if (w->prev)
+		w->prev->next = w;
+	else
+		event->waiters = w;
+	event->waiters_tail = w;
+}
+
+/**************************************************************************************************/
+/* waiters_wake
+ * wake the waiters completed by waiter_finish, without the mutex held. The post or the
+ * notify call is the last use of each record, which may be gone as soon as its waiter
+ * sees it.
+ */
+static void waiters_wake(pthread_event_waiter_t *w)
+{
+	pthread_event_waiter_t *next;
+
+	for ( ; NULL != w; w = next)
+	{
+		next = w->next;
+		if (w->notify)
+			w->notify(w, (WAITER_RESET == w->state) ? ECANCELED : 0);
+		else
+			pthread_ext_park_post(&w->word, w->state, 0);
+	}
+}
+
+/**************************************************************************************************/
+/* waiter_cleanup
+ * cancellation handler: take a cancelled waiter off the list, or if a setter completed it
+ * already, let the setter finish with the record first.
+ */
+static void waiter_cleanup(void *arg)
+{
+	pthread_event_waiter_t *w = (pthread_event_waiter_t *) arg;
+	uint32_t		state;
+
+	pthread_mutex_lock(&w->event->mutex);
+	state = w->state;
+	if (WAITER_WAITING == state)
+		waiter_unlink(w->event, w);
+	pthread_mutex_unlock(&w->event->mutex);
+
+	if (WAITER_WAITING != state)
+		while (state != __atomic_load_n(&w->word, __ATOMIC_ACQUIRE))
+			sched_yield();
+}
+
+/**************************************************************************************************/
+/* event_notify
+ * post the notification descriptor unless it is posted already.
+ */
+static void event_notify(pthread_event_t *event)
+{
+	int				efd = __atomic_load_n(&event->efd, __ATOMIC_RELAXED);
+
+	if ((efd >= 0) && (0 == __atomic_exchange_n(&event->efd_posted, 1, __ATOMIC_SEQ_CST)))
+		pthread_ext_notify_fd(efd);
+}
+
+/**************************************************************************************************/
+/* pthread_event_attr_init
+ * default attributes.
+ */
+int pthread_event_attr_init(pthread_event_attr_t * attr)
+{
+	pthread_ext_wait_policy_init(&attr->wait);
+
+	return 0;
 }
 
 /**************************************************************************************************/
@@ -47,14 +224,42 @@ static void cleanup_handler(void *arg)
  * create and initialize a new event.
  */
 int pthread_event_create(pthread_event_t ** ppevent)
+{
+	return pthread_event_create_ex(ppevent, NULL);
+}
+
+/**************************************************************************************************/
+/* pthread_event_create_ex
+ * create and initialize a new event with a wait policy.
+ */
+int pthread_event_create_ex(pthread_event_t ** ppevent, const pthread_event_attr_t * attr)
 {
 	pthread_event_t * event;
+	pthread_event_mask64 * bits = NULL;
+	unsigned		nwords = 1;
+
+	if (attr && ((unsigned) attr->wait.mode > PTHREAD_EXT_WAIT_ADAPTIVE))
+		return EINVAL;
+
+	if (attr && (attr->nbits > PTHREAD_EVENT_WORD_BITS))
+	{
+		if (attr->nbits > PTHREAD_EVENT_MAX_BITS)
+			return EINVAL;
+
+		nwords = (attr->nbits + PTHREAD_EVENT_WORD_BITS - 1) / PTHREAD_EVENT_WORD_BITS;
+		if (posix_memalign((void **) &bits, PTHREAD_EXT_CACHE_LINE, nwords * sizeof(pthread_event_mask64)))
+			return ENOMEM;
+		memset(bits, 0, nwords * sizeof(pthread_event_mask64));
+	}
 
 	if (NULL == *ppevent)
 	{
 		event = (pthread_event_t *) malloc(sizeof(pthread_event_t));
 		if (NULL == event)
+		{
+			free(bits);
 			return ENOMEM;
+		}
 
 		*ppevent = event;
 		event->destroyFree = 1;
@@ -66,13 +271,22 @@ int pthread_event_create(pthread_event_t ** ppevent)
 	}
 
 	pthread_mutex_init(&event->mutex, NULL);
-	pthread_cond_init(&event->cond, NULL);
+	pthread_ext_waitq_init(&event->cond);
+	pthread_ext_waitq_set_policy(&event->cond, attr ? &attr->wait : NULL);
 	event->mask = 0;
+	event->bits = bits ? bits : &event->mask;
+	event->nwords = nwords;
+	event->nwaiters = 0;
+	event->waiters = NULL;
+	event->waiters_tail = NULL;
+	event->efd = -1;
+	event->efd_posted = 0;
+	event->efd_mask = 0;
 	event->reset = 0;
 
 	return 0;
 
-} // pthread_event_create
+} // pthread_event_create_ex
 
 /**************************************************************************************************/
 /* pthread_event_destroy
@@ -81,7 +295,9 @@ int pthread_event_create(pthread_event_t ** ppevent)
 void pthread_event_destroy(pthread_event_t *event)
 {
 	pthread_mutex_destroy(&event->mutex);
-	pthread_cond_destroy(&event->cond);
+	pthread_ext_waitq_destroy(&event->cond);
+	if (event->bits != &event->mask)
+		free(event->bits);
 	if (event->destroyFree)
 		free(event);
 
@@ -94,17 +310,69 @@ void pthread_event_destroy(pthread_event_t *event)
  */
 int pthread_event_set(pthread_event_t *event, pthread_event_mask mask)
 {
-	pthread_mutex_lock(&event->mutex);
+	return pthread_event_set64(event, mask);
 
-	event->mask |= mask;
+} /* pthread_event_set */
 
-	/* signal waiters */
-	pthread_mutex_unlock(&event->mutex);
-	pthread_cond_broadcast(&event->cond);
+
+/**************************************************************************************************/
+/* pthread_event_set64
+ * set event flags in the first 64 bits.
+ */
+int pthread_event_set64(pthread_event_t *event, pthread_event_mask64 mask)
+{
+	return pthread_event_setv(event, &mask, 1);
+
+} /* pthread_event_set64 */
+
+
+/**************************************************************************************************/
+/* pthread_event_setv
+ * set event flags in mask words. The bits are set with one atomic operation per word; the
+ * mutex is only taken when there are blocked waiters to test. A waiter counts itself
+ * before its final test of the mask, and both sides use sequentially consistent
+ * operations, so either the setter sees the waiter or the waiter sees the bits.
+ */
+int pthread_event_setv(pthread_event_t *event, const pthread_event_mask64 * mask, unsigned nwords)
+{
+	pthread_event_waiter_t *w;
+	pthread_event_waiter_t *next;
+	pthread_event_waiter_t *wake = NULL;
+	pthread_event_waiter_t **pwake = &wake;
+	unsigned		i;
+
+	if (nwords > event->nwords)
+		return EINVAL;
+
+	for (i = 0; i < nwords; i++)
+		if (mask[i])
+			__atomic_fetch_or(&event->bits[i], mask[i], __ATOMIC_SEQ_CST);
+
+	/* wait sets blocked on the event (a single load if there are none) */
+	pthread_ext_waitq_wake(&event->cond, PTHREAD_EXT_WAKE_ALL);
+
+	if (0 != __atomic_load_n(&event->nwaiters, __ATOMIC_SEQ_CST))
+	{
+		pthread_mutex_lock(&event->mutex);
+
+		/* wake only the waiters whose test is now satisfied, oldest first */
+		for (w = event->waiters; NULL != w; w = next)
+		{
+			next = w->next;
+			if (event_take(event, w->mask, w->nwords, w->test, w->action))
+				waiter_finish(event, w, WAITER_DONE, &pwake);
+		}
+
+		pthread_mutex_unlock(&event->mutex);
+		waiters_wake(wake);
+	}
+
+	if (nwords && (mask[0] & __atomic_load_n(&event->efd_mask, __ATOMIC_RELAXED)))
+		event_notify(event);
 
 	return 0;
 
-} /* pthread_event_set */
+} /* pthread_event_setv */
 
 
 /**************************************************************************************************/
@@ -113,16 +381,40 @@ int pthread_event_set(pthread_event_t *event, pthread_event_mask mask)
  */
 int pthread_event_clr(pthread_event_t *event, pthread_event_mask mask)
 {
-	pthread_mutex_lock(&event->mutex);
+	return pthread_event_clr64(event, mask);
+
+} /* pthread_event_clr */
 
-	event->mask &= ~mask;
 
-	/* signal waiters */
-	pthread_mutex_unlock(&event->mutex);
+/**************************************************************************************************/
+/* pthread_event_clr64
+ * clear event flags in the first 64 bits.
+ */
+int pthread_event_clr64(pthread_event_t *event, pthread_event_mask64 mask)
+{
+	return pthread_event_clrv(event, &mask, 1);
+
+} /* pthread_event_clr64 */
+
+/**************************************************************************************************/
+/* pthread_event_clrv
+ * clear event flags in mask words.
+ */
+int pthread_event_clrv(pthread_event_t *event, const pthread_event_mask64 * mask, unsigned nwords)
+{
+	unsigned		i;
+
+	if (nwords > event->nwords)
+		return EINVAL;
+
+	/* clearing bits never satisfies a waiter */
+	for (i = 0; i < nwords; i++)
+		if (mask[i])
+			__atomic_fetch_and(&event->bits[i], ~mask[i], __ATOMIC_SEQ_CST);
 
 	return 0;
 
-} /* pthread_event_clr */
+} /* pthread_event_clrv */
 
 /**************************************************************************************************/
 /* pthread_event_wait
@@ -133,57 +425,303 @@ int pthread_event_clr(pthread_event_t *event, pthread_event_mask mask)
 
 int pthread_event_wait(pthread_event_t *event, pthread_event_mask mask, pthread_event_test test,
 						pthread_event_action action, long timeout)
+{
+	return pthread_event_wait64(event, mask, test, action, timeout);
+
+} /* pthread_event_wait */
+
+
+/**************************************************************************************************/
+/* pthread_event_wait64
+ * as pthread_event_wait, testing the first 64 bits.
+ */
+int pthread_event_wait64(pthread_event_t *event, pthread_event_mask64 mask, pthread_event_test test,
+						  pthread_event_action action, long timeout)
+{
+	return pthread_event_waitv(event, &mask, 1, test, action, timeout);
+
+} /* pthread_event_wait64 */
+
+
+/**************************************************************************************************/
+/* pthread_event_wait_ns
+ * as pthread_event_wait, with the timeout in nanoseconds.
+ */
+int pthread_event_wait_ns(pthread_event_t *event, pthread_event_mask mask, pthread_event_test test,
+						  pthread_event_action action, long long timeout_ns)
+{
+	return pthread_event_wait64_ns(event, mask, test, action, timeout_ns);
+
+} /* pthread_event_wait_ns */
+
+
+/**************************************************************************************************/
+/* pthread_event_wait64_ns
+ * as pthread_event_wait_ns, testing the first 64 bits.
+ */
+int pthread_event_wait64_ns(pthread_event_t *event, pthread_event_mask64 mask, pthread_event_test test,
+						    pthread_event_action action, long long timeout_ns)
+{
+	return pthread_event_waitv_ns(event, &mask, 1, test, action, timeout_ns);
+
+} /* pthread_event_wait64_ns */
+
+
+/**************************************************************************************************/
+/* pthread_event_wait_until
+ * as pthread_event_wait, waiting until an absolute PTHREAD_EXT_CLOCK deadline.
+ */
+int pthread_event_wait_until(pthread_event_t *event, pthread_event_mask mask, pthread_event_test test,
+							 pthread_event_action action, const struct timespec *deadline)
+{
+	return pthread_event_wait64_until(event, mask, test, action, deadline);
+
+} /* pthread_event_wait_until */
+
+
+/**************************************************************************************************/
+/* pthread_event_wait64_until
+ * as pthread_event_wait_until, testing the first 64 bits.
+ */
+int pthread_event_wait64_until(pthread_event_t *event, pthread_event_mask64 mask, pthread_event_test test,
+							   pthread_event_action action, const struct timespec *deadline)
+{
+	return pthread_event_waitv_until(event, &mask, 1, test, action, deadline);
+
+} /* pthread_event_wait64_until */
+
+/**************************************************************************************************/
+/* pthread_event_waitv
+ * wait for a test on mask words, see pthread_event_wait.
+ */
+int pthread_event_waitv(pthread_event_t *event, const pthread_event_mask64 * mask, unsigned nwords,
+						pthread_event_test test, pthread_event_action action, long timeout)
 {
 	struct timespec abstime;
-	uint8_t			done;
-	int				result = 0;
 
 	if ( (PTHREAD_WAIT != timeout) && (timeout < 0) )
 		return EINVAL;
 
-	// convert wait to absolute system time
-	if (timeout > 0)
-		pthread_ext_ms2abs_time(timeout, &abstime);
+	return pthread_event_waitv_until(event, mask, nwords, test, action,
+									 pthread_ext_deadline_ms(timeout, &abstime));
+
+} /* pthread_event_waitv */
+
+
+/**************************************************************************************************/
+/* pthread_event_waitv_ns
+ * as pthread_event_waitv, with the timeout in nanoseconds.
+ */
+int pthread_event_waitv_ns(pthread_event_t *event, const pthread_event_mask64 * mask, unsigned nwords,
+						pthread_event_test test, pthread_event_action action, long long timeout_ns)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0) )
+		return EINVAL;
+
+	return pthread_event_waitv_until(event, mask, nwords, test, action,
+									 pthread_ext_deadline_ns(timeout_ns, &abstime));
+
+} /* pthread_event_waitv_ns */
+
+
+/**************************************************************************************************/
+/* pthread_event_waitv_until
+ * as pthread_event_waitv, waiting until an absolute PTHREAD_EXT_CLOCK deadline.
+ */
+int pthread_event_waitv_until(pthread_event_t *event, const pthread_event_mask64 * mask, unsigned nwords,
+						pthread_event_test test, pthread_event_action action, const struct timespec *deadline)
+{
+	pthread_event_waiter_t	w;
+	int				result;
+
+	if ( (0 == nwords) || (nwords > event->nwords) )
+		return EINVAL;
+
+	/* event test is already satisfied; a bitmap event clears under the mutex */
+	if ( ((1 == event->nwords) || (PTHREAD_EVENT_KEEP == action)) &&
+		 event_take(event, mask, nwords, test, action) )
+		return 0;
 
 	pthread_mutex_lock(&event->mutex);
 
-	/* handle nowait and event test is not satisfied */
-	done = (PTHREAD_EVENT_ANY == mask) ? ((event->mask & mask) != 0) : ((event->mask & mask) == mask) ;
-	
-	if ( (PTHREAD_NOWAIT == timeout) && (!done) )
+	if (event->reset)
 	{
 		pthread_mutex_unlock(&event->mutex);
-		return ETIMEDOUT;
+		return ECANCELED;
 	}
 
-	/* wait for the event test to be satisfied */
-	while (!done && !event->reset) {
+	/* count this waiter before testing again, so a setter from now on takes the slow path */
+	__atomic_store_n(&event->nwaiters, event->nwaiters + 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
 
-		pthread_cleanup_push(cleanup_handler, &event->mutex);
-		if (PTHREAD_WAIT == timeout)
-			result = pthread_cond_wait(&event->cond, &event->mutex);
+	result = event_take(event, mask, nwords, test, action) ? 0 : ETIMEDOUT;
+
+	/* satisfied after all, or nowait */
+	if ( (0 == result) || (PTHREAD_EXT_DEADLINE_NOW == deadline) )
+	{
+		__atomic_store_n(&event->nwaiters, event->nwaiters - 1, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&event->mutex);
+		return result;
+	}
+
+	/* queue a wait record for pthread_event_set to test */
+	w.mask = mask;
+	w.nwords = nwords;
+	w.test = test;
+	w.action = action;
+	w.state = WAITER_WAITING;
+	w.word = 0;
+	w.notify = NULL;
+	w.event = event;
+	waiter_link(event, &w);
+
+	pthread_mutex_unlock(&event->mutex);
+
+	/* the event's wait queue only supplies the wait policy */
+	pthread_cleanup_push(waiter_cleanup, &w);
+	result = pthread_ext_park_wait(&w.word, &event->cond, deadline);
+	pthread_cleanup_pop(0);
+
+	/* withdraw the record after a timeout, unless a setter completed it meanwhile */
+	if (ETIMEDOUT == result)
+	{
+		pthread_mutex_lock(&event->mutex);
+		if (WAITER_WAITING == w.state)
+			waiter_unlink(event, &w);
 		else
-			result = pthread_cond_timedwait(&event->cond, &event->mutex, &abstime);
-		pthread_cleanup_pop(0);
+			result = 0;
+		pthread_mutex_unlock(&event->mutex);
 
-		if (ETIMEDOUT == result)
-		{
-			pthread_mutex_unlock(&event->mutex);
-			return ETIMEDOUT;
-		}
+		if (0 == result)
+			pthread_ext_park_wait(&w.word, &event->cond, NULL);
+	}
+
+	if (0 == result)
+		result = (WAITER_RESET == w.word) ? ECANCELED : 0;
 
-		result = event->reset ? ECANCELED : 0;	// if we woke up because of reset
-		done = (PTHREAD_EVENT_ANY == mask) ? ((event->mask & mask) != 0) : ((event->mask & mask) == mask) ;
+	return result;
+
+} /* pthread_event_waitv_until */
+
+/**************************************************************************************************/
+/* pthread_event_notify
+ * test the event, or add a waiter record which a set or reset completes with a call to
+ * notify. The same steps as pthread_event_waitv_until, without the thread.
+ */
+int pthread_event_notify(pthread_event_t * event, pthread_event_waiter_t * w,
+						 const pthread_event_mask64 * mask, unsigned nwords, pthread_event_test test,
+						 pthread_event_action action, void (* notify)(pthread_event_waiter_t * w, int result))
+{
+	if ( (0 == nwords) || (nwords > event->nwords) )
+		return EINVAL;
+
+	if ( ((1 == event->nwords) || (PTHREAD_EVENT_KEEP == action)) &&
+		 event_take(event, mask, nwords, test, action) )
+		return 0;
+
+	pthread_mutex_lock(&event->mutex);
+
+	if (event->reset)
+	{
+		pthread_mutex_unlock(&event->mutex);
+		return ECANCELED;
 	}
 
-	if (PTHREAD_EVENT_CLEAR == action)
-		event->mask &= ~mask;
+	__atomic_store_n(&event->nwaiters, event->nwaiters + 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if (event_take(event, mask, nwords, test, action))
+	{
+		__atomic_store_n(&event->nwaiters, event->nwaiters - 1, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&event->mutex);
+		return 0;
+	}
 
+	w->mask = mask;
+	w->nwords = nwords;
+	w->test = test;
+	w->action = action;
+	w->state = WAITER_WAITING;
+	w->word = 0;
+	w->notify = notify;
+	w->event = event;
+	waiter_link(event, w);
+
+	/* w may be completed and gone as soon as the mutex is released */
 	pthread_mutex_unlock(&event->mutex);
 
-	return (result);
+	return EINPROGRESS;
 
-} /* pthread_event_wait */
+} /* pthread_event_notify */
+
+
+/**************************************************************************************************/
+/* pthread_event_unnotify
+ * withdraw a waiter record, unless a set or reset completed it already.
+ */
+int pthread_event_unnotify(pthread_event_t * event, pthread_event_waiter_t * w)
+{
+	int				linked;
+
+	pthread_mutex_lock(&event->mutex);
+	linked = (WAITER_WAITING == w->state);
+	if (linked)
+	{
+		waiter_unlink(event, w);
+		w->state = WAITER_DONE;
+	}
+	pthread_mutex_unlock(&event->mutex);
+
+	return linked;
+
+} /* pthread_event_unnotify */
+
+/**************************************************************************************************/
+/* pthread_event_set_eventfd
+ * attach or detach a notification descriptor.
+ */
+int pthread_event_set_eventfd(pthread_event_t *event, int fd, pthread_event_mask mask)
+{
+	return pthread_event_set_eventfd64(event, fd, mask);
+
+} /* pthread_event_set_eventfd */
+
+
+/**************************************************************************************************/
+/* pthread_event_set_eventfd64
+ * attach or detach a notification descriptor for any of the first 64 bits.
+ */
+int pthread_event_set_eventfd64(pthread_event_t *event, int fd, pthread_event_mask64 mask)
+{
+	pthread_mutex_lock(&event->mutex);
+	__atomic_store_n(&event->efd_posted, 0, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&event->efd, fd, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&event->efd_mask, mask, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&event->mutex);
+
+	/* bits already set */
+	pthread_event_eventfd_ack(event);
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* pthread_event_eventfd_ack
+ * re-enable notifications, and post again if watched bits are still set. The exchange
+ * pairs with the one in event_notify, so a set which found the descriptor posted is seen
+ * by the test below.
+ */
+int pthread_event_eventfd_ack(pthread_event_t *event)
+{
+	__atomic_exchange_n(&event->efd_posted, 0, __ATOMIC_SEQ_CST);
+
+	if (pthread_event_current64(event) & __atomic_load_n(&event->efd_mask, __ATOMIC_RELAXED))
+		event_notify(event);
+
+	return 0;
+}
 
 /**************************************************************************************************/
 /* pthread_event_current
@@ -191,7 +729,52 @@ int pthread_event_wait(pthread_event_t *event, pthread_event_mask mask, pthread_
  */
 pthread_event_mask pthread_event_current(pthread_event_t * event)
 {
-	return event->mask;
+	return (pthread_event_mask) pthread_event_current64(event);
+}
+
+/**************************************************************************************************/
+/* pthread_event_current64
+ * return the first 64 bits of the current event mask
+ */
+pthread_event_mask64 pthread_event_current64(pthread_event_t * event)
+{
+	return __atomic_load_n(&event->bits[0], __ATOMIC_SEQ_CST);
+}
+
+/**************************************************************************************************/
+/* pthread_event_currentv
+ * copy the current mask words
+ */
+int pthread_event_currentv(pthread_event_t * event, pthread_event_mask64 * mask, unsigned nwords)
+{
+	unsigned		i;
+
+	if (nwords > event->nwords)
+		return EINVAL;
+
+	for (i = 0; i < nwords; i++)
+		mask[i] = __atomic_load_n(&event->bits[i], __ATOMIC_SEQ_CST);
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* pthread_event_poll
+ * test the current mask words without waiting or clearing
+ */
+int pthread_event_poll(pthread_event_t * event, const pthread_event_mask64 * mask, unsigned nwords,
+					   pthread_event_test test)
+{
+	pthread_event_mask64 current[PTHREAD_EVENT_MAX_WORDS];
+	unsigned		i;
+
+	if (nwords > event->nwords)
+		nwords = event->nwords;
+
+	for (i = 0; i < nwords; i++)
+		current[i] = __atomic_load_n(&event->bits[i], __ATOMIC_SEQ_CST);
+
+	return event_test(current, mask, nwords, test);
 }
 
 /**************************************************************************************************/
@@ -201,11 +784,21 @@ pthread_event_mask pthread_event_current(pthread_event_t * event)
  */
 int pthread_event_reset(pthread_event_t * event)
 {
+	pthread_event_waiter_t *wake = NULL;
+	pthread_event_waiter_t **pwake = &wake;
+	unsigned		i;
+
 	pthread_mutex_lock(&event->mutex);
-	event->mask = 0;
+	for (i = 0; i < event->nwords; i++)
+		__atomic_store_n(&event->bits[i], 0, __ATOMIC_SEQ_CST);
 	event->reset = 1;
+	while (NULL != event->waiters)
+		waiter_finish(event, event->waiters, WAITER_RESET, &pwake);
 	pthread_mutex_unlock(&event->mutex);
-	pthread_cond_broadcast(&event->cond);
+	waiters_wake(wake);
+
+	/* wait sets and other watchers of the event re-check it and see the reset */
+	pthread_ext_waitq_wake(&event->cond, PTHREAD_EXT_WAKE_ALL);
 
 	return 0;
 }
@@ -32,16 +32,65 @@ THE SOFTWARE.
 #define PTHREAD_EVENT_H
 
 #include <stdint.h>
+#include <pthread.h>
+
+#include "pthread_ext_common.h"
+#include "pthread_ext_wait.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 typedef enum { PTHREAD_EVENT_ANY, PTHREAD_EVENT_ALL } pthread_event_test;
 typedef enum { PTHREAD_EVENT_CLEAR, PTHREAD_EVENT_KEEP } pthread_event_action;
 
 typedef uint32_t	pthread_event_mask;
+typedef uint64_t	pthread_event_mask64;
+
+/* bitmap events: pthread_event_attr_t.nbits up to PTHREAD_EVENT_MAX_BITS, addressed as an
+ * array of mask words with the *v functions */
+#define PTHREAD_EVENT_WORD_BITS		64
+#define PTHREAD_EVENT_MAX_BITS		4096
+#define PTHREAD_EVENT_MAX_WORDS		(PTHREAD_EVENT_MAX_BITS / PTHREAD_EVENT_WORD_BITS)
+
+/* word index and mask of bit number b in a bitmap */
+#define PTHREAD_EVENT_BIT_WORD(b)	((b) / PTHREAD_EVENT_WORD_BITS)
+#define PTHREAD_EVENT_BIT_MASK(b)	((pthread_event_mask64) 1 << ((b) % PTHREAD_EVENT_WORD_BITS))
+
+typedef struct pthread_event_attr_s {
+	pthread_ext_wait_policy_t	wait;		/* how blocked waiters wait */
+	unsigned					nbits;		/* bits in the event, 0 for one mask word */
+} pthread_event_attr_t;
+
+struct pthread_event_s;
+
+/* a waiter for an event test: a thread blocked in pthread_event_wait, on its stack, or a
+ * record added with pthread_event_notify, owned by the caller */
+typedef struct pthread_event_waiter_s {
+	struct pthread_event_waiter_s * next;
+	struct pthread_event_waiter_s * prev;
+	const pthread_event_mask64 * mask;		/* bits to test, owned by the waiter */
+	unsigned				nwords;			/* words in mask */
+	pthread_event_test		test;			/* PTHREAD_EVENT_ANY or PTHREAD_EVENT_ALL */
+	pthread_event_action	action;			/* PTHREAD_EVENT_CLEAR or PTHREAD_EVENT_KEEP */
+	uint32_t				state;			/* waiting, done or reset, under the event mutex */
+	uint32_t				word;			/* thread: park word, posted with the final state */
+	void				 (*	notify)(struct pthread_event_waiter_s * w, int result);	/* or NULL */
+	struct pthread_event_s * event;
+} pthread_event_waiter_t;
 
 typedef struct pthread_event_s {
 	pthread_mutex_t			mutex;			/* lock the structure */
-	pthread_cond_t			cond;			/* condition variable*/
-	pthread_event_mask		mask;			/* event mask */
+	pthread_ext_waitq_t		cond;			/* wait policy for waiters, wakes wait sets */
+	struct pthread_event_waiter_s * waiters;	/* blocked waiters, oldest first */
+	struct pthread_event_waiter_s * waiters_tail;	/* newest blocked waiter */
+	pthread_event_mask64	  *	bits;			/* event mask words, updated atomically */
+	pthread_event_mask64		mask;			/* the only mask word, unless a bitmap */
+	unsigned				nwords;			/* number of mask words */
+	uint32_t				nwaiters;		/* blocked waiters, 0 = set needs no lock */
+	int						efd;			/* notification descriptor, or -1 */
+	uint32_t				efd_posted;		/* 1 = efd posted and not yet acknowledged */
+	pthread_event_mask64		efd_mask;		/* bits of word 0 which post efd */
 	uint8_t					reset;			/* 0 = not reset, otherwise reset */
 	uint8_t					destroyFree;	/* 1 = free memory on destroy */
 } pthread_event_t;
@@ -59,6 +108,36 @@ int pthread_event_create(pthread_event_t ** ppevent);
 
 
 
+/** Initialize event attributes to the defaults used by pthread_event_create.
+ *
+ * @param[out] attr			pointer to the attributes
+ * @returns                 0 for success
+ */
+int pthread_event_attr_init(pthread_event_attr_t * attr);
+
+
+
+/** Create an event with attributes.
+ *
+ * Same as pthread_event_create, with the wait policy taken from attr (NULL for defaults).
+ * attr->wait sets how a blocked pthread_event_wait waits: park at once (the default), or
+ * spin and yield first, for a fixed or adaptive number of spins. See pthread_ext_wait.h.
+ *
+ * attr->nbits above PTHREAD_EVENT_WORD_BITS makes a bitmap event of that many bits
+ * (rounded up to whole words), used with pthread_event_setv, _clrv, _waitv and
+ * _currentv. The single word functions address word 0 of a bitmap event.
+ *
+ * @param[inout] ppevent	if *ppevent == NULL, allocate memory for event. Returns event pointer.
+ * @param[in]    attr		event attributes, or NULL for defaults
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ENOMEM]            memory for event not available
+ *      [EINVAL]            attributes are invalid
+ */
+int pthread_event_create_ex(pthread_event_t ** ppevent, const pthread_event_attr_t * attr);
+
+
+
 /** Destroy an event.
  * 
  * @param[in] queue			pointer to the event
@@ -70,6 +149,8 @@ void pthread_event_destroy(pthread_event_t *event);
 
 /** Set event flags.
  * 
+ * A single atomic operation when no thread is blocked in pthread_event_wait.
+ *
  * @param[in] event         pointer to the event
  * @param[in] mask          event flags to set
  * @returns                 0 for success
@@ -78,8 +159,16 @@ int pthread_event_set(pthread_event_t *event, pthread_event_mask mask);
 
 
 
+/** Same as pthread_event_set, for the first 64 event flags.
+ */
+int pthread_event_set64(pthread_event_t *event, pthread_event_mask64 mask);
+
+
+
 /** Clear event flags.
  * 
+ * A single atomic operation; never blocks.
+ *
  * @param[in] event         pointer to the event
  * @param[in] mask          event flags to clear
  * @returns                 0 for success
@@ -88,6 +177,12 @@ int pthread_event_clr(pthread_event_t *event, pthread_event_mask mask);
 
 
 
+/** Same as pthread_event_clr, for the first 64 event flags.
+ */
+int pthread_event_clr64(pthread_event_t *event, pthread_event_mask64 mask);
+
+
+
 /** Wait for an event.
  *
  * If the event test is not satisfied, and timeout == PTHREAD_NOWAIT, function returns immediately
@@ -101,6 +196,11 @@ int pthread_event_clr(pthread_event_t *event, pthread_event_mask mask);
  * Function clears event flags which caused successful return if 'action' = PTHREAD_EVENT_CLEAR.
  * Function does not clear any event flags if 'action' = PTHREAD_EVENT_KEEP.
  *
+ * A blocked waiter is only woken when its own test is satisfied (or the event is reset).
+ * pthread_event_set tests each blocked waiter in the order they blocked, and applies
+ * PTHREAD_EVENT_CLEAR for the waiter it wakes, so a later waiter does not see bits an
+ * earlier one has taken.
+ *
  * @param[in] event			pointer to the event
  * @param[in] mask			bits to test
  * @param[in] test			PTHREAD_EVENT_ANY (logical OR), PTHREAD_EVENT_ALL (logical AND)
@@ -117,7 +217,158 @@ int pthread_event_wait(pthread_event_t *event, pthread_event_mask mask, pthread_
 
 
 
+/** Same as pthread_event_wait, with the timeout in nanoseconds.
+ *
+ * @param[in] timeout_ns	PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ns
+ */
+int pthread_event_wait_ns(pthread_event_t *event, pthread_event_mask mask, pthread_event_test test,
+						  pthread_event_action action, long long timeout_ns);
+
+
+
+/** Same as pthread_event_wait, waiting until an absolute deadline.
+ *
+ * @param[in] deadline		absolute PTHREAD_EXT_CLOCK time, NULL to wait forever, or
+ *                          PTHREAD_EXT_DEADLINE_NOW not to wait
+ */
+int pthread_event_wait_until(pthread_event_t *event, pthread_event_mask mask, pthread_event_test test,
+							 pthread_event_action action, const struct timespec * deadline);
+
+
+
+/** Same as pthread_event_wait, testing the first 64 event flags.
+ */
+int pthread_event_wait64(pthread_event_t *event, pthread_event_mask64 mask, pthread_event_test test,
+						  pthread_event_action action, long timeout);
+
+
+
+/** Same as pthread_event_wait_ns, testing the first 64 event flags.
+ */
+int pthread_event_wait64_ns(pthread_event_t *event, pthread_event_mask64 mask, pthread_event_test test,
+						    pthread_event_action action, long long timeout_ns);
+
+
+
+/** Same as pthread_event_wait_until, testing the first 64 event flags.
+ */
+int pthread_event_wait64_until(pthread_event_t *event, pthread_event_mask64 mask, pthread_event_test test,
+							   pthread_event_action action, const struct timespec * deadline);
+
+
+
+/** Set event flags in a bitmap event.
+ *
+ * mask[i] holds bits i * PTHREAD_EVENT_WORD_BITS and up. Each word is set atomically, but
+ * not all words at once.
+ *
+ * @param[in] event         pointer to the event
+ * @param[in] mask          event flags to set
+ * @param[in] nwords        number of words in mask, at most the words in the event
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [EINVAL]            nwords is larger than the event
+ */
+int pthread_event_setv(pthread_event_t *event, const pthread_event_mask64 * mask, unsigned nwords);
+
+
+
+/** Clear event flags in a bitmap event.
+ *
+ * @param[in] event         pointer to the event
+ * @param[in] mask          event flags to clear
+ * @param[in] nwords        number of words in mask, at most the words in the event
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [EINVAL]            nwords is larger than the event
+ */
+int pthread_event_clrv(pthread_event_t *event, const pthread_event_mask64 * mask, unsigned nwords);
+
+
+
+/** Wait for an event test on a bitmap event.
+ *
+ * Same as pthread_event_wait, with the bits to test spread over nwords mask words. The
+ * test covers all the words at once, and PTHREAD_EVENT_CLEAR clears the tested bits of
+ * every word.
+ *
+ * @param[in] event			pointer to the event
+ * @param[in] mask			bits to test
+ * @param[in] nwords        number of words in mask, 1 up to the words in the event
+ * @param[in] test			PTHREAD_EVENT_ANY (logical OR), PTHREAD_EVENT_ALL (logical AND)
+ * @param[in] action		PTHREAD_EVENT_CLEAR (clear event bits) or PTHREAD_EVENT_KEEP (leave as is)
+ * @param[in] timeout		PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ETIMEDOUT]         timeout has passed
+ *      [EINVAL]            timeout value or nwords is invalid
+ *      [ECANCELED]         event was reset
+ */
+int pthread_event_waitv(pthread_event_t *event, const pthread_event_mask64 * mask, unsigned nwords,
+						pthread_event_test test, pthread_event_action action, long timeout);
+
+
+
+/** Same as pthread_event_waitv, with the timeout in nanoseconds.
+ *
+ * @param[in] timeout_ns	PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ns
+ */
+int pthread_event_waitv_ns(pthread_event_t *event, const pthread_event_mask64 * mask, unsigned nwords,
+						   pthread_event_test test, pthread_event_action action, long long timeout_ns);
+
+
+
+/** Same as pthread_event_waitv, waiting until an absolute deadline.
+ *
+ * @param[in] deadline		absolute PTHREAD_EXT_CLOCK time, NULL to wait forever, or
+ *                          PTHREAD_EXT_DEADLINE_NOW not to wait
+ */
+int pthread_event_waitv_until(pthread_event_t *event, const pthread_event_mask64 * mask, unsigned nwords,
+							  pthread_event_test test, pthread_event_action action,
+							  const struct timespec * deadline);
+
+
+
+/** Attach a notification descriptor, so an event can be waited for in poll/epoll.
+ *
+ * fd is normally an eventfd (EFD_NONBLOCK). It becomes readable when any of the bits in
+ * mask are set, including bits already set when it is attached. Notifications are
+ * coalesced: after one write to fd, further sets do not write again until
+ * pthread_event_eventfd_ack. A reactor thread:
+ *
+ *   1. waits for fd to become readable and reads it,
+ *   2. takes the bits with pthread_event_wait(..., PTHREAD_EVENT_CLEAR, PTHREAD_NOWAIT),
+ *   3. calls pthread_event_eventfd_ack, which posts fd again if watched bits are still set.
+ *
+ * The caller owns fd and closes it after detaching it (fd = -1) or destroying the event.
+ *
+ * @param[in] event			pointer to the event
+ * @param[in] fd			eventfd (or any descriptor that takes an 8 byte write), or -1 to detach
+ * @param[in] mask			bits which post fd when set
+ * @returns                 0 for success
+ */
+int pthread_event_set_eventfd(pthread_event_t *event, int fd, pthread_event_mask mask);
+
+
+
+/** Same as pthread_event_set_eventfd, watching any of the first 64 event flags.
+ */
+int pthread_event_set_eventfd64(pthread_event_t *event, int fd, pthread_event_mask64 mask);
+
+
+
+/** Acknowledge a notification, see pthread_event_set_eventfd.
+ *
+ * @param[in] event			pointer to the event
+ * @returns                 0 for success
+ */
+int pthread_event_eventfd_ack(pthread_event_t *event);
+
+
+
 /** Return current event mask.
+ *
+ * An atomic load of the mask, which other threads may change at any time.
  *
  * @param[in] event			pointer to the event
  */
@@ -125,6 +376,79 @@ pthread_event_mask pthread_event_current(pthread_event_t * event);
 
 
 
+/** Return the first 64 bits of the current event mask.
+ *
+ * @param[in] event			pointer to the event
+ */
+pthread_event_mask64 pthread_event_current64(pthread_event_t * event);
+
+
+
+/** Copy the current mask words of a bitmap event.
+ *
+ * @param[in]  event		pointer to the event
+ * @param[out] mask			receives the words
+ * @param[in]  nwords		number of words to copy, at most the words in the event
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [EINVAL]            nwords is larger than the event
+ */
+int pthread_event_currentv(pthread_event_t * event, pthread_event_mask64 * mask, unsigned nwords);
+
+
+
+/** Test the current event mask without waiting or clearing any bits.
+ *
+ * @param[in] event			pointer to the event
+ * @param[in] mask			bits to test
+ * @param[in] nwords		number of words in mask
+ * @param[in] test			PTHREAD_EVENT_ANY (logical OR), PTHREAD_EVENT_ALL (logical AND)
+ * @returns                 nonzero if the test is satisfied
+ */
+int pthread_event_poll(pthread_event_t * event, const pthread_event_mask64 * mask, unsigned nwords,
+					   pthread_event_test test);
+
+
+
+/** Wait for an event test without blocking a thread.
+ *
+ * For waiters which are not threads, such as suspended coroutines. If the test is satisfied,
+ * the action is applied and the function returns 0. Otherwise w joins the blocked waiters,
+ * in order with threads in pthread_event_wait: the pthread_event_set that satisfies the test
+ * applies the action for w, and calls notify(w, 0); pthread_event_reset calls
+ * notify(w, ECANCELED). notify is called in the setting thread once the event mutex is
+ * released, as the last use of w and mask. It must be short and must not block.
+ *
+ * @param[in] event			pointer to the event
+ * @param[in] w				waiter record, owned by the caller until notify is called
+ * @param[in] mask			bits to test
+ * @param[in] nwords		number of words in mask
+ * @param[in] test			PTHREAD_EVENT_ANY (logical OR), PTHREAD_EVENT_ALL (logical AND)
+ * @param[in] action		PTHREAD_EVENT_CLEAR (clear event bits) or PTHREAD_EVENT_KEEP (leave as is)
+ * @param[in] notify		called when the test is satisfied or the event is reset
+ * @returns                 0 if the test is satisfied now, otherwise an error number
+ * @ERRORS
+ *      [EINPROGRESS]       w was added, notify will be called
+ *      [EINVAL]            nwords is 0 or larger than the event
+ *      [ECANCELED]         event is reset
+ */
+int pthread_event_notify(pthread_event_t * event, pthread_event_waiter_t * w,
+						 const pthread_event_mask64 * mask, unsigned nwords, pthread_event_test test,
+						 pthread_event_action action, void (* notify)(pthread_event_waiter_t * w, int result));
+
+
+
+/** Withdraw a waiter added with pthread_event_notify.
+ *
+ * @param[in] event			pointer to the event
+ * @param[in] w				waiter record
+ * @returns                 1 if w was withdrawn, 0 if a set or reset completed it already: its
+ *                          notify is then called, or has been
+ */
+int pthread_event_unnotify(pthread_event_t * event, pthread_event_waiter_t * w);
+
+
+
 /** Reset event, set all bits to 0, prevent further inputs.
  *
  * @param[in] event			pointer to the event
@@ -139,4 +463,8 @@ int pthread_event_reset(pthread_event_t * event);
  */
 int pthread_event_unreset(pthread_event_t * event);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* PTHREAD_EVENT_H */
@@ -28,12 +28,30 @@ THE SOFTWARE.
  * pthread_queue implementation
  */
 
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
 #include "pthread_ext_common.h"
 
+/* next statistics shard to hand out, and the calling thread's shard + 1 */
+static uint32_t next_shard;
+static __thread uint32_t thread_shard;
+
+/* mbind policy, from <numaif.h>, which comes with libnuma rather than the C library */
+#define EXT_MPOL_BIND	2
+
+/* the start of PTHREAD_EXT_CLOCK, a deadline which has always passed */
+const struct timespec pthread_ext_deadline_now = { 0, 0 };
+
 /**************************************************************************************************/
 void pthread_ext_ms2abs_time(long ms, struct timespec * abstime)
 {
-	clock_gettime(CLOCK_REALTIME, abstime);
+	clock_gettime(PTHREAD_EXT_CLOCK, abstime);
 
 	if (ms >= 1000)
 	{
@@ -44,10 +62,233 @@ void pthread_ext_ms2abs_time(long ms, struct timespec * abstime)
 	else
 		abstime->tv_nsec += ms * 1000000l;
 
-	if (abstime->tv_nsec > 1000000000l)
+	if (abstime->tv_nsec >= 1000000000l)
 	{
 		abstime->tv_nsec -= 1000000000l;
 		abstime->tv_sec += 1;
 	}
 
 }
+
+/**************************************************************************************************/
+void pthread_ext_ns2abs_time(long long ns, struct timespec * abstime)
+{
+	clock_gettime(PTHREAD_EXT_CLOCK, abstime);
+
+	abstime->tv_sec += ns / 1000000000ll;
+	abstime->tv_nsec += ns % 1000000000ll;
+
+	if (abstime->tv_nsec >= 1000000000l)
+	{
+		abstime->tv_nsec -= 1000000000l;
+		abstime->tv_sec += 1;
+	}
+}
+
+/**************************************************************************************************/
+const struct timespec * pthread_ext_deadline_ms(long ms, struct timespec * abstime)
+{
+	if (PTHREAD_WAIT == ms)
+		return NULL;
+
+	if (PTHREAD_NOWAIT == ms)
+		return PTHREAD_EXT_DEADLINE_NOW;
+
+	pthread_ext_ms2abs_time(ms, abstime);
+
+	return abstime;
+}
+
+/**************************************************************************************************/
+const struct timespec * pthread_ext_deadline_ns(long long ns, struct timespec * abstime)
+{
+	if (PTHREAD_WAIT == ns)
+		return NULL;
+
+	if (PTHREAD_NOWAIT == ns)
+		return PTHREAD_EXT_DEADLINE_NOW;
+
+	pthread_ext_ns2abs_time(ns, abstime);
+
+	return abstime;
+}
+
+/**************************************************************************************************/
+int pthread_ext_mutex_lock(pthread_mutex_t * mutex)
+{
+	int				result;
+
+	result = pthread_mutex_lock(mutex);
+#if defined(__linux__)
+	if (EOWNERDEAD == result)
+		result = pthread_mutex_consistent(mutex);
+#endif
+
+	return result;
+}
+
+/**************************************************************************************************/
+uint64_t pthread_ext_now_ns(void)
+{
+	struct timespec	now;
+
+	clock_gettime(PTHREAD_EXT_CLOCK, &now);
+
+	return (uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec;
+}
+
+/**************************************************************************************************/
+uint32_t pthread_ext_shard(void)
+{
+	if (0 == thread_shard)
+		thread_shard = __atomic_fetch_add(&next_shard, 1, __ATOMIC_RELAXED) % PTHREAD_EXT_SHARDS + 1;
+
+	return thread_shard - 1;
+}
+
+/**************************************************************************************************/
+uint64_t pthread_ext_hist_value(uint32_t bucket)
+{
+	uint32_t		exp;
+
+	if (bucket < (2u << PTHREAD_EXT_HIST_SUB_BITS))
+		return bucket;
+
+	/* bucket is (exp - SUB_BITS) * 2^SUB_BITS + the top SUB_BITS + 1 bits of the value */
+	exp = (bucket >> PTHREAD_EXT_HIST_SUB_BITS) + PTHREAD_EXT_HIST_SUB_BITS - 1;
+
+	return (uint64_t) ((bucket & ((1u << PTHREAD_EXT_HIST_SUB_BITS) - 1)) | (1u << PTHREAD_EXT_HIST_SUB_BITS))
+		   << (exp - PTHREAD_EXT_HIST_SUB_BITS);
+}
+
+/**************************************************************************************************/
+uint64_t pthread_ext_hist_percentile(const uint64_t * hist, double percent)
+{
+	uint64_t		total = 0;
+	uint64_t		sum = 0;
+	double			want;
+	uint32_t		b;
+
+	for (b = 0; b < PTHREAD_EXT_HIST_BUCKETS; b++)
+		total += hist[b];
+	if (0 == total)
+		return 0;
+
+	want = (double) total * percent / 100.0;
+	for (b = 0; b < PTHREAD_EXT_HIST_BUCKETS - 1; b++)
+	{
+		sum += hist[b];
+		if ((sum > 0) && ((double) sum >= want))
+			return pthread_ext_hist_value(b + 1) - 1;
+	}
+
+	return pthread_ext_hist_value(PTHREAD_EXT_HIST_BUCKETS - 1);
+}
+
+/**************************************************************************************************/
+void pthread_ext_notify_fd(int fd)
+{
+	uint64_t		one = 1;
+	ssize_t			rc;
+
+	/* an eventfd only fails to take the write when its count is about to overflow, and
+	 * then it is readable anyway */
+	do {
+		rc = write(fd, &one, sizeof(one));
+	} while ((-1 == rc) && (EINTR == errno));
+}
+
+/**************************************************************************************************/
+void pthread_ext_alloc_attr_init(pthread_ext_alloc_attr_t * attr)
+{
+	attr->flags = 0;
+	attr->node = 0;
+}
+
+/**************************************************************************************************/
+int pthread_ext_alloc(void ** pmem, size_t len, const pthread_ext_alloc_attr_t * attr, size_t * pmap_len)
+{
+	uint32_t		flags = attr ? attr->flags : 0;
+	size_t			page = (size_t) sysconf(_SC_PAGESIZE);
+	size_t			map_len;
+	size_t			off;
+	char		  *	mem = (char *) MAP_FAILED;
+	int				result;
+
+	if ((flags & ~(PTHREAD_EXT_ALLOC_HUGE_2MB | PTHREAD_EXT_ALLOC_HUGE_1GB | PTHREAD_EXT_ALLOC_NODE |
+				   PTHREAD_EXT_ALLOC_PREFAULT)) ||
+		((flags & PTHREAD_EXT_ALLOC_HUGE_2MB) && (flags & PTHREAD_EXT_ALLOC_HUGE_1GB)) ||
+		((flags & PTHREAD_EXT_ALLOC_NODE) && ((attr->node < 0) || (attr->node >= PTHREAD_EXT_MAX_NODES))))
+		return EINVAL;
+
+	*pmap_len = 0;
+	if (0 == flags)
+		return posix_memalign(pmem, PTHREAD_EXT_CACHE_LINE, len);
+
+#if defined(MAP_HUGETLB)
+	if (flags & (PTHREAD_EXT_ALLOC_HUGE_2MB | PTHREAD_EXT_ALLOC_HUGE_1GB))
+	{
+		int			shift = (flags & PTHREAD_EXT_ALLOC_HUGE_2MB) ? 21 : 30;
+
+		map_len = (len + ((size_t) 1 << shift) - 1) & ~(((size_t) 1 << shift) - 1);
+		mem = (char *) mmap(NULL, map_len ? map_len : (size_t) 1 << shift, PROT_READ | PROT_WRITE,
+							MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (shift << 26), -1, 0);
+		if (MAP_FAILED != mem)
+			page = (size_t) 1 << shift;
+	}
+#endif
+
+	/* ordinary pages, which transparent huge pages may still back */
+	if (MAP_FAILED == mem)
+	{
+		map_len = (len + page - 1) & ~(page - 1);
+		mem = (char *) mmap(NULL, map_len ? map_len : page, PROT_READ | PROT_WRITE,
+							MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (MAP_FAILED == mem)
+			return errno;
+#if defined(MADV_HUGEPAGE)
+		if (flags & (PTHREAD_EXT_ALLOC_HUGE_2MB | PTHREAD_EXT_ALLOC_HUGE_1GB))
+			madvise(mem, map_len, MADV_HUGEPAGE);
+#endif
+	}
+	if (0 == map_len)
+		map_len = page;
+
+	/* bind before the first touch, which is what places a page */
+	if (flags & PTHREAD_EXT_ALLOC_NODE)
+	{
+#if defined(__linux__) && defined(SYS_mbind)
+		unsigned long	nodes[PTHREAD_EXT_MAX_NODES / (8 * sizeof(unsigned long))] = { 0 };
+
+		nodes[attr->node / (8 * sizeof(unsigned long))] = 1ul << (attr->node % (8 * sizeof(unsigned long)));
+		result = (0 == syscall(SYS_mbind, mem, map_len, EXT_MPOL_BIND, nodes, PTHREAD_EXT_MAX_NODES + 1, 0)) ? 0 : errno;
+#else
+		result = ENOSYS;
+#endif
+		if (result)
+		{
+			munmap(mem, map_len);
+			return result;
+		}
+	}
+
+	if (flags & PTHREAD_EXT_ALLOC_PREFAULT)
+	{
+		for (off = 0; off < map_len; off += page)
+			((volatile char *) mem)[off] = 0;
+	}
+
+	*pmem = mem;
+	*pmap_len = map_len;
+
+	return 0;
+}
+
+/**************************************************************************************************/
+void pthread_ext_free(void * mem, size_t map_len)
+{
+	if (map_len)
+		munmap(mem, map_len);
+	else
+		free(mem);
+}
@@ -33,16 +33,236 @@ THE SOFTWARE.
 
 #include <stdint.h>
 #include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
 
 /** Timeout identifiers */
 #define PTHREAD_WAIT	(-1)
 #define PTHREAD_NOWAIT	(0)
 
-/** Convert relative time (from now) to absolute time
+/** Clock of absolute timeouts (deadlines). Monotonic, so that steps and slews of the
+ * system time do not stretch or cut short a wait; CLOCK_REALTIME only where condition
+ * variables cannot select their clock. */
+#if defined(__linux__) || (defined(_POSIX_CLOCK_SELECTION) && (_POSIX_CLOCK_SELECTION >= 0))
+#define PTHREAD_EXT_CLOCK	CLOCK_MONOTONIC
+#define PTHREAD_EXT_CLOCK_SELECTION	1		/* condition variables use PTHREAD_EXT_CLOCK */
+#else
+#define PTHREAD_EXT_CLOCK	CLOCK_REALTIME
+#define PTHREAD_EXT_CLOCK_SELECTION	0
+#endif
+
+/** Deadline arguments (the _until functions): NULL waits forever, PTHREAD_EXT_DEADLINE_NOW
+ * does not wait at all, like PTHREAD_NOWAIT. Any other deadline is an absolute
+ * PTHREAD_EXT_CLOCK time; when it has passed already, the call gives up after one more
+ * check, as with PTHREAD_NOWAIT. */
+extern const struct timespec pthread_ext_deadline_now;
+#define PTHREAD_EXT_DEADLINE_NOW	(&pthread_ext_deadline_now)
+
+/** Cache line size used to keep producer and consumer state apart */
+#define PTHREAD_EXT_CACHE_LINE	64
+#define PTHREAD_EXT_CACHE_ALIGNED	__attribute__((aligned(PTHREAD_EXT_CACHE_LINE)))
+
+/** Statistics shards: counters written by many threads are split into this many cache
+ * line aligned copies, picked by pthread_ext_shard, and summed when read */
+#define PTHREAD_EXT_SHARDS	8
+
+/** Log-linear (HDR style) histogram of nanosecond values: exact below 16, then 8 buckets
+ * per power of two, so a bucket is within 12.5% of any value counted in it. Values from
+ * 2^44 ns (about 4.9 hours) up share the last bucket. */
+#define PTHREAD_EXT_HIST_SUB_BITS	3
+#define PTHREAD_EXT_HIST_BUCKETS	336
+
+/** Buffer allocation flags, see pthread_ext_alloc */
+#define PTHREAD_EXT_ALLOC_HUGE_2MB	0x0001		/* 2 MB huge pages */
+#define PTHREAD_EXT_ALLOC_HUGE_1GB	0x0002		/* 1 GB huge pages */
+#define PTHREAD_EXT_ALLOC_NODE		0x0004		/* bind the pages to NUMA node attr->node */
+#define PTHREAD_EXT_ALLOC_PREFAULT	0x0008		/* fault every page in before returning */
+
+/** Highest NUMA node number + 1 that PTHREAD_EXT_ALLOC_NODE takes */
+#define PTHREAD_EXT_MAX_NODES	1024
+
+typedef struct pthread_ext_alloc_attr_s {
+	uint32_t		flags;		/* PTHREAD_EXT_ALLOC_xxx */
+	int				node;		/* NODE: NUMA node of the pages */
+} pthread_ext_alloc_attr_t;
+
+/** Processor hint for spin-wait loops */
+#if defined(__x86_64__) || defined(__i386__)
+#define PTHREAD_EXT_CPU_RELAX()	__builtin_ia32_pause()
+#elif defined(__aarch64__) || defined(__arm__)
+#define PTHREAD_EXT_CPU_RELAX()	__asm__ __volatile__("yield" ::: "memory")
+#else
+#define PTHREAD_EXT_CPU_RELAX()	__asm__ __volatile__("" ::: "memory")
+#endif
+
+/** Convert relative time (from now) to absolute PTHREAD_EXT_CLOCK time
  *
  * @param[in]  ms			number of milliseconds relative to current time
  * @param[out] abstime		pointer to timespec structure which holds absolute time
  */
 void pthread_ext_ms2abs_time(long ms, struct timespec * abstime);
 
+
+
+/** Convert relative time (from now) in nanoseconds to absolute PTHREAD_EXT_CLOCK time
+ *
+ * @param[in]  ns			number of nanoseconds relative to current time
+ * @param[out] abstime		pointer to timespec structure which holds absolute time
+ */
+void pthread_ext_ns2abs_time(long long ns, struct timespec * abstime);
+
+
+
+/** Convert a timeout in ms, PTHREAD_WAIT or PTHREAD_NOWAIT to a deadline argument
+ *
+ * @param[in]  ms			timeout
+ * @param[out] abstime		holds the deadline, if there is one
+ * @returns                 NULL, PTHREAD_EXT_DEADLINE_NOW or abstime
+ */
+const struct timespec * pthread_ext_deadline_ms(long ms, struct timespec * abstime);
+
+
+
+/** Convert a timeout in ns, PTHREAD_WAIT or PTHREAD_NOWAIT to a deadline argument
+ *
+ * @param[in]  ns			timeout
+ * @param[out] abstime		holds the deadline, if there is one
+ * @returns                 NULL, PTHREAD_EXT_DEADLINE_NOW or abstime
+ */
+const struct timespec * pthread_ext_deadline_ns(long long ns, struct timespec * abstime);
+
+
+
+/** Lock a mutex, recovering a robust mutex whose owner died while holding it.
+ *
+ * The data a robust mutex protects must be consistent after every single store, so that
+ * the lock can be taken over as is.
+ *
+ * @param[in]  mutex		pointer to the mutex
+ * @returns                 0 for success, otherwise an error number from pthread_mutex_lock
+ */
+int pthread_ext_mutex_lock(pthread_mutex_t * mutex);
+
+
+
+/** Current PTHREAD_EXT_CLOCK time in nanoseconds
+ *
+ * @returns                 nanoseconds since the start of PTHREAD_EXT_CLOCK
+ */
+uint64_t pthread_ext_now_ns(void);
+
+
+
+/** Statistics shard of the calling thread. Threads are handed shards in turn the first
+ * time they ask, so up to PTHREAD_EXT_SHARDS threads never share one.
+ *
+ * @returns                 shard index, less than PTHREAD_EXT_SHARDS
+ */
+uint32_t pthread_ext_shard(void);
+
+
+
+/** Histogram bucket counting value
+ *
+ * @param[in]  value		value in nanoseconds
+ * @returns                 bucket index, less than PTHREAD_EXT_HIST_BUCKETS
+ */
+static inline uint32_t pthread_ext_hist_bucket(uint64_t value)
+{
+	uint32_t		exp;
+
+	if (value < (2u << PTHREAD_EXT_HIST_SUB_BITS))
+		return (uint32_t) value;
+
+	exp = 63 - (uint32_t) __builtin_clzll(value);
+	if (exp > 43)
+		return PTHREAD_EXT_HIST_BUCKETS - 1;
+
+	return ((exp - PTHREAD_EXT_HIST_SUB_BITS) << PTHREAD_EXT_HIST_SUB_BITS) +
+		   (uint32_t) (value >> (exp - PTHREAD_EXT_HIST_SUB_BITS));
+}
+
+
+
+/** Lowest value counted in a histogram bucket
+ *
+ * @param[in]  bucket		bucket index
+ * @returns                 value in nanoseconds
+ */
+uint64_t pthread_ext_hist_value(uint32_t bucket);
+
+
+
+/** Percentile of a histogram: the highest value counted in the bucket where the
+ * cumulative count reaches percent of the total.
+ *
+ * @param[in]  hist			PTHREAD_EXT_HIST_BUCKETS counts
+ * @param[in]  percent		0 to 100
+ * @returns                 value in nanoseconds, 0 for an empty histogram
+ */
+uint64_t pthread_ext_hist_percentile(const uint64_t * hist, double percent);
+
+
+
+/** Initialize allocation attributes to the defaults: cache line aligned heap memory.
+ *
+ * @param[out] attr			pointer to the attributes
+ */
+void pthread_ext_alloc_attr_init(pthread_ext_alloc_attr_t * attr);
+
+
+
+/** Allocate a large buffer, such as a queue ring, with control over its placement.
+ *
+ * With no flags the buffer comes from the heap, aligned to PTHREAD_EXT_CACHE_LINE. Any flag
+ * maps it with mmap instead, rounded up to whole pages, so it is page aligned:
+ *
+ * PTHREAD_EXT_ALLOC_HUGE_2MB or _HUGE_1GB ask for MAP_HUGETLB pages of that size, which
+ * cut TLB misses on large rings. When no huge pages of the size are reserved (see
+ * /proc/sys/vm/nr_hugepages), the buffer falls back to ordinary pages marked MADV_HUGEPAGE,
+ * so transparent huge pages may still back it.
+ *
+ * PTHREAD_EXT_ALLOC_NODE binds the pages to NUMA node attr->node with mbind, typically the
+ * node of the consumer. PTHREAD_EXT_ALLOC_PREFAULT writes to every page before returning, so
+ * the first burst of messages takes no page faults; with NODE the pages are faulted in
+ * on the bound node.
+ *
+ * @param[out] pmem			returns the buffer
+ * @param[in]  len			size of the buffer in bytes
+ * @param[in]  attr			allocation attributes, or NULL for defaults
+ * @param[out] pmap_len		returns the length to pass to pthread_ext_free
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ENOMEM]            	memory not available
+ *      [EINVAL]            	flags are invalid, both huge page sizes are set, or the node
+ *                              is out of range or not available
+ *      [ENOSYS]            	PTHREAD_EXT_ALLOC_NODE on a system without mbind
+ */
+int pthread_ext_alloc(void ** pmem, size_t len, const pthread_ext_alloc_attr_t * attr, size_t * pmap_len);
+
+
+
+/** Free a buffer from pthread_ext_alloc.
+ *
+ * @param[in]  mem			buffer, or NULL
+ * @param[in]  map_len		length returned by pthread_ext_alloc
+ */
+void pthread_ext_free(void * mem, size_t map_len);
+
+
+
+/** Post a notification descriptor: write an 8 byte count of 1, as an eventfd expects.
+ *
+ * @param[in]  fd			eventfd, or any descriptor that takes an 8 byte write, such as a pipe
+ */
+void pthread_ext_notify_fd(int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
 #endif  /* PTHREAD_EXT_COMMON_H */
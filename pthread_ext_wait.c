@@ -0,0 +1,672 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014, Stephen Scott
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/* 
+ * pthread_ext_wait implementation
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <errno.h>
+#include <sched.h>
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
+
+#include "pthread_ext_wait.h"
+#include "pthread_ext_common.h"
+
+/* park word value while its waiter is in the kernel */
+#define PARK_WORD_PARKED	0x80000000u
+
+/* longest a thread with cancellation enabled stays in the kernel before it checks for a
+ * deferred cancel */
+#define CANCEL_SLICE_NS		100000000L
+
+/**************************************************************************************************/
+static void cleanup_handler(void *arg)
+{
+	__atomic_fetch_sub(&((pthread_ext_waitq_t *) arg)->waiters, 1, __ATOMIC_RELEASE);
+}
+
+/**************************************************************************************************/
+static void unpark_handler(void *arg)
+{
+	__atomic_fetch_sub(&((pthread_ext_waitq_t *) arg)->parked, 1, __ATOMIC_RELEASE);
+}
+
+#if defined(__linux__)
+/**************************************************************************************************/
+/* futex_wait
+ * park while *uaddr == val, until abstime (CLOCK_MONOTONIC) if not NULL. Returns 0 if woken
+ * by futex_wake, EINTR if interrupted, otherwise the error number. The wait is a deferred
+ * cancellation point: a deferred cancel does not interrupt a thread in the kernel, so while
+ * cancellation is enabled the thread wakes every CANCEL_SLICE_NS to act on one, and
+ * returns EINTR for the callers to loop.
+ */
+static int futex_wait(uint32_t *uaddr, uint32_t val, const struct timespec *abstime, int pshared)
+{
+	struct timespec	slice;
+	const struct timespec *until = abstime;
+	int				state;
+	long			rc;
+
+	pthread_testcancel();
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state);
+	pthread_setcancelstate(state, NULL);
+	if (PTHREAD_CANCEL_ENABLE == state)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &slice);
+		slice.tv_nsec += CANCEL_SLICE_NS;
+		if (slice.tv_nsec >= 1000000000L)
+		{
+			slice.tv_sec++;
+			slice.tv_nsec -= 1000000000L;
+		}
+		if ( (NULL == abstime) || (slice.tv_sec < abstime->tv_sec) ||
+			 ((slice.tv_sec == abstime->tv_sec) && (slice.tv_nsec < abstime->tv_nsec)) )
+			until = &slice;
+	}
+
+	rc = syscall(SYS_futex, uaddr, pshared ? FUTEX_WAIT_BITSET : FUTEX_WAIT_BITSET_PRIVATE,
+				 val, until, NULL, FUTEX_BITSET_MATCH_ANY);
+	if ( (-1 == rc) && (ETIMEDOUT == errno) && (until == &slice) )
+		errno = EINTR;
+	rc = (-1 == rc) ? errno : 0;
+
+	pthread_testcancel();
+
+	return (int) rc;
+}
+
+/**************************************************************************************************/
+/* futex_wake
+ * wake up to nwake threads parked on uaddr. Returns the number of threads woken.
+ */
+static int futex_wake(uint32_t *uaddr, int nwake, int pshared)
+{
+	long			rc;
+
+	rc = syscall(SYS_futex, uaddr, pshared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, nwake, NULL, NULL, 0);
+
+	return (rc > 0) ? (int) rc : 0;
+}
+
+/**************************************************************************************************/
+/* waitq_park
+ * park until the sequence number moves away from seq. The thread counts itself parked
+ * around each system call, and a cleanup handler takes it off again if it is cancelled in
+ * the kernel; wakers only read the count.
+ */
+static int waitq_park(pthread_ext_waitq_t * wq, uint32_t seq, const struct timespec * abstime)
+{
+	int				result;
+
+	while (__atomic_load_n(&wq->seq, __ATOMIC_ACQUIRE) == seq)
+	{
+		__atomic_fetch_add(&wq->parked, 1, __ATOMIC_SEQ_CST);
+		pthread_cleanup_push(unpark_handler, wq);
+		result = futex_wait(&wq->seq, seq, abstime, wq->pshared);
+		pthread_cleanup_pop(1);
+
+		if (ETIMEDOUT == result)
+			return ETIMEDOUT;
+	}
+
+	return 0;
+}
+#else
+/**************************************************************************************************/
+/* waitq_park
+ * park until the sequence number moves away from seq.
+ */
+static int waitq_park(pthread_ext_waitq_t * wq, uint32_t seq, const struct timespec * abstime)
+{
+	int				result = 0;
+
+	pthread_mutex_lock(&wq->mutex);
+	while (__atomic_load_n(&wq->seq, __ATOMIC_ACQUIRE) == seq)
+	{
+		pthread_cleanup_push((void (*)(void *)) pthread_mutex_unlock, &wq->mutex);
+		if (NULL == abstime)
+			result = pthread_cond_wait(&wq->cond, &wq->mutex);
+		else
+			result = pthread_cond_timedwait(&wq->cond, &wq->mutex, abstime);
+		pthread_cleanup_pop(0);
+
+		if (ETIMEDOUT == result)
+			break;
+	}
+	pthread_mutex_unlock(&wq->mutex);
+
+	return (ETIMEDOUT == result) ? ETIMEDOUT : 0;
+}
+#endif
+
+/**************************************************************************************************/
+/* waitq_adapt
+ * ADAPTIVE: fold the length of a wait, in spins, into the running average, weight 1/8.
+ */
+static void waitq_adapt(pthread_ext_waitq_t * wq, uint32_t spins)
+{
+	int32_t			avg;
+
+	if (PTHREAD_EXT_WAIT_ADAPTIVE != wq->policy.mode)
+		return;
+
+	avg = (int32_t) __atomic_load_n(&wq->spin_avg, __ATOMIC_RELAXED);
+	avg += ((int32_t) spins - avg) / 8;
+	__atomic_store_n(&wq->spin_avg, (uint32_t) avg, __ATOMIC_RELAXED);
+}
+
+/**************************************************************************************************/
+/* waitq_spin
+ * spin, then yield, while *word is val, following the policy of wq. Returns 1 if it moved
+ * on, or 0 if the caller has to park.
+ *
+ * ADAPTIVE spins for about twice the average wait. Waits which outlast the spinning count
+ * as twice the spin limit, so when most waits are long the average climbs above the limit
+ * and spinning stops, apart from a full length probe every 64 waits to notice when waits
+ * get short again.
+ */
+static int waitq_spin(pthread_ext_waitq_t * wq, const uint32_t * word, uint32_t val)
+{
+	uint32_t		limit = wq->policy.spins;
+	uint32_t		avg;
+	uint32_t		i;
+
+	if (PTHREAD_EXT_WAIT_ADAPTIVE == wq->policy.mode)
+	{
+		avg = __atomic_load_n(&wq->spin_avg, __ATOMIC_RELAXED);
+		if (avg > limit)
+		{
+			if (__atomic_fetch_add(&wq->probe, 1, __ATOMIC_RELAXED) & 63)
+				limit = 0;
+		}
+		else if (2 * avg + 16 < limit)
+			limit = 2 * avg + 16;
+	}
+
+	for (i = 0; i < limit; i++)
+	{
+		if (__atomic_load_n(word, __ATOMIC_ACQUIRE) != val)
+		{
+			waitq_adapt(wq, i);
+			return 1;
+		}
+		PTHREAD_EXT_CPU_RELAX();
+	}
+
+	waitq_adapt(wq, 2 * wq->policy.spins);
+
+	for (i = 0; i < wq->policy.yields; i++)
+	{
+		sched_yield();
+		if (__atomic_load_n(word, __ATOMIC_ACQUIRE) != val)
+			return 1;
+	}
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* pthread_ext_wait_policy_init
+ * default wait policy.
+ */
+void pthread_ext_wait_policy_init(pthread_ext_wait_policy_t * policy)
+{
+	policy->mode = PTHREAD_EXT_WAIT_PARK;
+	policy->spins = PTHREAD_EXT_WAIT_SPINS;
+	policy->yields = PTHREAD_EXT_WAIT_YIELDS;
+}
+
+/**************************************************************************************************/
+/* pthread_ext_waitq_set_policy
+ * set how waiters spin before parking.
+ */
+void pthread_ext_waitq_set_policy(pthread_ext_waitq_t * wq, const pthread_ext_wait_policy_t * policy)
+{
+	if (NULL == policy)
+		pthread_ext_wait_policy_init(&wq->policy);
+	else
+		wq->policy = *policy;
+
+	wq->spin_avg = wq->policy.spins / 2;
+	wq->probe = 0;
+}
+
+/**************************************************************************************************/
+/* pthread_ext_waitq_init
+ * initialize a wait queue.
+ */
+void pthread_ext_waitq_init(pthread_ext_waitq_t * wq)
+{
+	pthread_ext_waitq_init_pshared(wq, 0);
+}
+
+/**************************************************************************************************/
+/* pthread_ext_waitq_init_pshared
+ * initialize a wait queue, optionally shared between processes.
+ */
+void pthread_ext_waitq_init_pshared(pthread_ext_waitq_t * wq, int pshared)
+{
+#if !defined(__linux__)
+	pthread_mutexattr_t	mattr;
+	pthread_condattr_t	cattr;
+#endif
+
+	wq->seq = 0;
+	wq->waiters = 0;
+	wq->parked = 0;
+	wq->pshared = pshared ? 1 : 0;
+	wq->watch_lock = 0;
+	wq->watches = NULL;
+	wq->watches_tail = NULL;
+	pthread_ext_waitq_set_policy(wq, NULL);
+#if !defined(__linux__)
+	pthread_mutexattr_init(&mattr);
+	pthread_condattr_init(&cattr);
+#if PTHREAD_EXT_CLOCK_SELECTION
+	pthread_condattr_setclock(&cattr, PTHREAD_EXT_CLOCK);
+#endif
+	if (pshared)
+	{
+		pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+		pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+	}
+	pthread_mutex_init(&wq->mutex, &mattr);
+	pthread_cond_init(&wq->cond, &cattr);
+	pthread_mutexattr_destroy(&mattr);
+	pthread_condattr_destroy(&cattr);
+#endif
+}
+
+/**************************************************************************************************/
+/* pthread_ext_waitq_destroy
+ * destroy a wait queue.
+ */
+void pthread_ext_waitq_destroy(pthread_ext_waitq_t * wq)
+{
+#if !defined(__linux__)
+	pthread_mutex_destroy(&wq->mutex);
+	pthread_cond_destroy(&wq->cond);
+#else
+	(void) wq;
+#endif
+}
+
+/**************************************************************************************************/
+/* pthread_ext_waitq_prepare
+ * register as a waiter and return the sequence number to wait on.
+ */
+uint32_t pthread_ext_waitq_prepare(pthread_ext_waitq_t * wq)
+{
+	__atomic_fetch_add(&wq->waiters, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);	// order the caller's re-check after the registration
+
+	return __atomic_load_n(&wq->seq, __ATOMIC_SEQ_CST);
+}
+
+/**************************************************************************************************/
+/* pthread_ext_waitq_cancel
+ * withdraw a registration without waiting.
+ */
+void pthread_ext_waitq_cancel(pthread_ext_waitq_t * wq)
+{
+	__atomic_fetch_sub(&wq->waiters, 1, __ATOMIC_RELEASE);
+}
+
+/**************************************************************************************************/
+/* pthread_ext_waitq_wait
+ * park until the sequence number moves away from seq, or abstime passes.
+ */
+int pthread_ext_waitq_wait(pthread_ext_waitq_t * wq, uint32_t seq, const struct timespec * abstime)
+{
+	int				result;
+
+	if ( (PTHREAD_EXT_WAIT_PARK != wq->policy.mode) && waitq_spin(wq, &wq->seq, seq) )
+	{
+		__atomic_fetch_sub(&wq->waiters, 1, __ATOMIC_RELEASE);
+		return 0;
+	}
+
+	pthread_cleanup_push(cleanup_handler, wq);
+	result = waitq_park(wq, seq, abstime);
+	pthread_cleanup_pop(0);
+
+	__atomic_fetch_sub(&wq->waiters, 1, __ATOMIC_RELEASE);
+
+	return result;
+}
+
+/**************************************************************************************************/
+/* pthread_ext_waitq_wait_mutex
+ * condition variable style wait.
+ */
+int pthread_ext_waitq_wait_mutex(pthread_ext_waitq_t * wq, pthread_mutex_t * mutex,
+								 const struct timespec * abstime)
+{
+	uint32_t		seq;
+	int				result;
+
+	seq = pthread_ext_waitq_prepare(wq);
+	pthread_mutex_unlock(mutex);
+
+	result = pthread_ext_waitq_wait(wq, seq, abstime);
+
+	pthread_ext_mutex_lock(mutex);
+
+	return result;
+}
+
+/**************************************************************************************************/
+/* watch_lock
+ * take the spin lock of a wait queue's watches. It is only held for short walks of the
+ * list, and by pthread_ext_waitq_unwatch to wait for a walk to finish.
+ */
+static void watch_lock(pthread_ext_waitq_t * wq)
+{
+	while (__atomic_exchange_n(&wq->watch_lock, 1, __ATOMIC_ACQUIRE))
+		sched_yield();
+}
+
+/**************************************************************************************************/
+static void watch_unlock(pthread_ext_waitq_t * wq)
+{
+	__atomic_store_n(&wq->watch_lock, 0, __ATOMIC_RELEASE);
+}
+
+/**************************************************************************************************/
+/* watch_link
+ * called with the watch lock held. Link a watch at the front of a wait queue's list, or
+ * a one-shot watch at its back so they fire in the order they were added.
+ */
+static void watch_link(pthread_ext_waitq_t * wq, pthread_ext_waitq_watch_t * watch)
+{
+	watch->linked = 1;
+	if (NULL != watch->notify)
+	{
+		watch->next = NULL;
+		watch->prev = wq->watches_tail;
+		wq->watches_tail = watch;
+		if (watch->prev)
+			watch->prev->next = watch;
+		else
+			__atomic_store_n(&wq->watches, watch, __ATOMIC_RELAXED);
+		return;
+	}
+	watch->prev = NULL;
+	watch->next = wq->watches;
+	if (watch->next)
+		watch->next->prev = watch;
+	else
+		wq->watches_tail = watch;
+	__atomic_store_n(&wq->watches, watch, __ATOMIC_RELAXED);
+}
+
+/**************************************************************************************************/
+/* watch_unlink
+ * called with the watch lock held. Unlink a watch from a wait queue's list.
+ */
+static void watch_unlink(pthread_ext_waitq_t * wq, pthread_ext_waitq_watch_t * watch)
+{
+	if (watch->prev)
+		watch->prev->next = watch->next;
+	else
+		__atomic_store_n(&wq->watches, watch->next, __ATOMIC_RELAXED);
+	if (watch->next)
+		watch->next->prev = watch->prev;
+	else
+		wq->watches_tail = watch->prev;
+	watch->linked = 0;
+}
+
+/**************************************************************************************************/
+/* waitq_wake_watches
+ * wake the target of every watch of a wait queue, and fire up to nwake one-shot watches.
+ * A fired watch may be freed as soon as its function returns, so it is not touched again.
+ */
+static void waitq_wake_watches(pthread_ext_waitq_t * wq, int nwake)
+{
+	pthread_ext_waitq_watch_t *watch;
+	pthread_ext_waitq_watch_t *next;
+	int				fired = 0;
+
+	watch_lock(wq);
+	for (watch = wq->watches; NULL != watch; watch = next)
+	{
+		next = watch->next;
+		if (NULL == watch->notify)
+			pthread_ext_waitq_wake(watch->target, 1);
+		else if (fired < nwake)
+		{
+			fired++;
+			watch_unlink(wq, watch);
+			watch->notify(watch);
+		}
+	}
+	watch_unlock(wq);
+}
+
+/**************************************************************************************************/
+/* pthread_ext_waitq_wake
+ * wake waiters, if there are any.
+ */
+void pthread_ext_waitq_wake(pthread_ext_waitq_t * wq, int nwake)
+{
+	if (0 == __atomic_load_n(&wq->waiters, __ATOMIC_SEQ_CST))
+		return;
+
+	if (NULL != __atomic_load_n(&wq->watches, __ATOMIC_RELAXED))
+		waitq_wake_watches(wq, nwake);
+
+#if defined(__linux__)
+	/* registered threads which have not parked yet see the new sequence number and do not
+	 * park; only make the system call if somebody is parked */
+	__atomic_fetch_add(&wq->seq, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&wq->parked, __ATOMIC_SEQ_CST))
+		futex_wake(&wq->seq, nwake, wq->pshared);
+#else
+	pthread_mutex_lock(&wq->mutex);
+	__atomic_fetch_add(&wq->seq, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&wq->mutex);
+	if (1 == nwake)
+		pthread_cond_signal(&wq->cond);
+	else
+		pthread_cond_broadcast(&wq->cond);
+#endif
+}
+
+/**************************************************************************************************/
+/* pthread_ext_waitq_watch
+ * link a watch into a wait queue.
+ */
+void pthread_ext_waitq_watch(pthread_ext_waitq_t * wq, pthread_ext_waitq_watch_t * watch,
+							 pthread_ext_waitq_t * target)
+{
+	watch->target = target;
+	watch->notify = NULL;
+
+	watch_lock(wq);
+	watch_link(wq, watch);
+	watch_unlock(wq);
+}
+
+/**************************************************************************************************/
+/* pthread_ext_waitq_notify
+ * link a one-shot watch into a wait queue.
+ */
+void pthread_ext_waitq_notify(pthread_ext_waitq_t * wq, pthread_ext_waitq_watch_t * watch,
+							  void (* notify)(pthread_ext_waitq_watch_t * watch))
+{
+	watch->target = NULL;
+	watch->notify = notify;
+
+	watch_lock(wq);
+	watch_link(wq, watch);
+	watch_unlock(wq);
+}
+
+/**************************************************************************************************/
+/* pthread_ext_waitq_unwatch
+ * unlink a watch from a wait queue, unless it has fired.
+ */
+int pthread_ext_waitq_unwatch(pthread_ext_waitq_t * wq, pthread_ext_waitq_watch_t * watch)
+{
+	int				linked;
+
+	watch_lock(wq);
+	linked = watch->linked;
+	if (linked)
+		watch_unlink(wq, watch);
+	watch_unlock(wq);
+
+	return linked;
+}
+
+#if defined(__linux__)
+/**************************************************************************************************/
+/* pthread_ext_park_wait
+ * wait for a park word to be posted. The word is PARK_WORD_PARKED while the waiter is (or
+ * is about to be) in the kernel, so a post knows whether to make the system call.
+ */
+int pthread_ext_park_wait(uint32_t * word, pthread_ext_waitq_t * wq, const struct timespec * abstime)
+{
+	uint32_t		val = 0;
+	int				result;
+
+	if ( (PTHREAD_EXT_WAIT_PARK != wq->policy.mode) && waitq_spin(wq, word, 0) )
+		return 0;
+
+	/* a post in the meantime makes the exchange fail */
+	if (!__atomic_compare_exchange_n(word, &val, PARK_WORD_PARKED, 0, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE))
+		return 0;
+
+	for (;;)
+	{
+		result = futex_wait(word, PARK_WORD_PARKED, abstime, wq->pshared);
+		if (PARK_WORD_PARKED != __atomic_load_n(word, __ATOMIC_ACQUIRE))
+			return 0;
+
+		if (ETIMEDOUT == result)
+		{
+			/* withdraw, unless a post got in first */
+			val = PARK_WORD_PARKED;
+			if (__atomic_compare_exchange_n(word, &val, 0, 0, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE))
+				return ETIMEDOUT;
+			return 0;
+		}
+	}
+}
+
+/**************************************************************************************************/
+/* pthread_ext_park_post
+ * post a value to a park word. Nothing touches the word after the exchange, so the waiter
+ * may free it as soon as it sees the value; waking a futex address which has been reused
+ * at worst causes a spurious wakeup.
+ */
+void pthread_ext_park_post(uint32_t * word, uint32_t value, int pshared)
+{
+	if (PARK_WORD_PARKED == __atomic_exchange_n(word, value, __ATOMIC_SEQ_CST))
+		futex_wake(word, 1, pshared);
+}
+#else
+/* park words hash to a fixed table of mutexes and condition variables, which outlive
+ * any word */
+#define PARK_BUCKETS	64
+
+static struct {
+	pthread_mutex_t	mutex;
+	pthread_cond_t	cond;
+} park_table[PARK_BUCKETS];
+static pthread_once_t park_once = PTHREAD_ONCE_INIT;
+
+/**************************************************************************************************/
+static void park_init(void)
+{
+	pthread_condattr_t	cattr;
+	int				i;
+
+	pthread_condattr_init(&cattr);
+#if PTHREAD_EXT_CLOCK_SELECTION
+	pthread_condattr_setclock(&cattr, PTHREAD_EXT_CLOCK);
+#endif
+	for (i = 0; i < PARK_BUCKETS; i++)
+	{
+		pthread_mutex_init(&park_table[i].mutex, NULL);
+		pthread_cond_init(&park_table[i].cond, &cattr);
+	}
+	pthread_condattr_destroy(&cattr);
+}
+
+/**************************************************************************************************/
+/* pthread_ext_park_wait
+ * wait for a park word to be posted.
+ */
+int pthread_ext_park_wait(uint32_t * word, pthread_ext_waitq_t * wq, const struct timespec * abstime)
+{
+	unsigned		b = ((uintptr_t) word >> 3) % PARK_BUCKETS;
+	int				result = 0;
+
+	if ( (PTHREAD_EXT_WAIT_PARK != wq->policy.mode) && waitq_spin(wq, word, 0) )
+		return 0;
+
+	pthread_once(&park_once, park_init);
+	pthread_mutex_lock(&park_table[b].mutex);
+	while ((0 == __atomic_load_n(word, __ATOMIC_ACQUIRE)) && (ETIMEDOUT != result))
+	{
+		pthread_cleanup_push((void (*)(void *)) pthread_mutex_unlock, &park_table[b].mutex);
+		if (NULL == abstime)
+			result = pthread_cond_wait(&park_table[b].cond, &park_table[b].mutex);
+		else
+			result = pthread_cond_timedwait(&park_table[b].cond, &park_table[b].mutex, abstime);
+		pthread_cleanup_pop(0);
+	}
+	result = (0 == __atomic_load_n(word, __ATOMIC_ACQUIRE)) ? ETIMEDOUT : 0;
+	pthread_mutex_unlock(&park_table[b].mutex);
+
+	return result;
+}
+
+/**************************************************************************************************/
+/* pthread_ext_park_post
+ * post a value to a park word.
+ */
+void pthread_ext_park_post(uint32_t * word, uint32_t value, int pshared)
+{
+	unsigned		b = ((uintptr_t) word >> 3) % PARK_BUCKETS;
+
+	(void) pshared;
+	pthread_once(&park_once, park_init);
+	pthread_mutex_lock(&park_table[b].mutex);
+	__atomic_store_n(word, value, __ATOMIC_SEQ_CST);
+	pthread_cond_broadcast(&park_table[b].cond);
+	pthread_mutex_unlock(&park_table[b].mutex);
+}
+#endif
@@ -0,0 +1,322 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014, Stephen Scott
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/** @file pthread_ext_wait.h
+ * @brief pthread extension wait queue, a futex based replacement for condition variables
+ */
+
+#ifndef PTHREAD_EXT_WAIT_H
+#define PTHREAD_EXT_WAIT_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Wake every waiter */
+#define PTHREAD_EXT_WAKE_ALL	(0x7fffffff)
+
+/** Defaults for pthread_ext_wait_policy_t spins and yields */
+#define PTHREAD_EXT_WAIT_SPINS	2000
+#define PTHREAD_EXT_WAIT_YIELDS	4
+
+/** How a thread waits before it parks in the kernel
+ *
+ * PTHREAD_EXT_WAIT_PARK     park at once (the default)
+ * PTHREAD_EXT_WAIT_SPIN     spin for spins iterations with a pause instruction, then call
+ *                           sched_yield up to yields times, then park
+ * PTHREAD_EXT_WAIT_ADAPTIVE as PTHREAD_EXT_WAIT_SPIN, but the number of spins is tuned from
+ *                           how long recent waits took: about twice the recent average, so
+ *                           short handoffs are caught spinning, and no spinning at all when
+ *                           recent waits mostly outlasted spins, the upper limit.
+ */
+typedef enum {
+	PTHREAD_EXT_WAIT_PARK,
+	PTHREAD_EXT_WAIT_SPIN,
+	PTHREAD_EXT_WAIT_ADAPTIVE
+} pthread_ext_wait_mode;
+
+typedef struct pthread_ext_wait_policy_s {
+	pthread_ext_wait_mode	mode;	/* PTHREAD_EXT_WAIT_xxx */
+	uint32_t		spins;		/* pause iterations before yielding (ADAPTIVE: upper limit) */
+	uint32_t		yields;		/* sched_yield calls before parking */
+} pthread_ext_wait_policy_t;
+
+/*
+ * A wait queue is a sequence number and counts of waiters. A waiter registers with
+ * pthread_ext_waitq_prepare, which returns the current sequence number, re-checks its
+ * condition, then parks in pthread_ext_waitq_wait until the sequence number changes.
+ * pthread_ext_waitq_wake does nothing but a single load if nobody is registered. Otherwise
+ * it bumps the sequence number, and only makes a wake system call if a thread is actually
+ * parked. A parked thread counts itself in and out around its system call, including
+ * when it is cancelled there, so the count cannot drift.
+ *
+ * On Linux the sequence number is the futex word. Elsewhere a mutex and condition
+ * variable stand in for the futex.
+ *
+ * A thread can wait for several wait queues at once: it adds a watch to each of them,
+ * naming a wait queue of its own, then registers with pthread_ext_waitq_prepare on its
+ * own wait queue and on every watched one before it re-checks its conditions and waits
+ * on its own. A wake of a watched wait queue with registered waiters also wakes the
+ * wait queue of every watch.
+ *
+ * A one-shot watch calls a function instead, for waiters which are not threads, such as
+ * suspended coroutines: the waiter registers with pthread_ext_waitq_prepare, adds the
+ * watch with pthread_ext_waitq_notify and re-checks its condition. The next wake unlinks
+ * the watch and calls its function, from the waking thread.
+ */
+struct pthread_ext_waitq_s;
+
+typedef struct pthread_ext_waitq_watch_s {
+	struct pthread_ext_waitq_watch_s * next;
+	struct pthread_ext_waitq_watch_s * prev;
+	struct pthread_ext_waitq_s * target;	/* wait queue to wake */
+	void (* notify)(struct pthread_ext_waitq_watch_s * watch);	/* one-shot: called instead */
+	uint32_t		linked;		/* 1 = in the watched wait queue's list */
+} pthread_ext_waitq_watch_t;
+
+typedef struct pthread_ext_waitq_s {
+	uint32_t		seq;		/* bumped by every wake */
+	uint32_t		waiters;	/* threads between prepare and the end of their wait */
+	uint32_t		parked;		/* threads in the wait system call */
+	uint32_t		pshared;	/* 1 = shared between processes */
+	pthread_ext_wait_policy_t	policy;	/* spin/yield before parking */
+	uint32_t		spin_avg;	/* ADAPTIVE: recent average length of a wait, in spins */
+	uint32_t		probe;		/* ADAPTIVE: waits since spinning was switched off */
+	uint32_t		watch_lock;	/* spin lock for watches */
+	pthread_ext_waitq_watch_t * watches;	/* watches to wake, not for shared wait queues */
+	pthread_ext_waitq_watch_t * watches_tail;	/* one-shot watches are appended here */
+#if !defined(__linux__)
+	pthread_mutex_t	mutex;		/* protects seq for the condition variable */
+	pthread_cond_t	cond;		/* stands in for the futex */
+#endif
+} pthread_ext_waitq_t;
+
+
+/** Initialize a wait queue.
+ *
+ * @param[out] wq			pointer to the wait queue
+ */
+void pthread_ext_waitq_init(pthread_ext_waitq_t * wq);
+
+
+
+/** Initialize a wait queue which may be shared between processes.
+ *
+ * The wait queue must live in memory mapped by every process using it. On Linux a shared
+ * wait queue uses non-private futex operations.
+ *
+ * @param[out] wq			pointer to the wait queue
+ * @param[in]  pshared		1 to share between processes, 0 for one process only
+ */
+void pthread_ext_waitq_init_pshared(pthread_ext_waitq_t * wq, int pshared);
+
+
+
+/** Initialize a wait policy to the defaults: park at once, with the default spin and yield
+ * counts ready for a change of mode.
+ *
+ * @param[out] policy		pointer to the policy
+ */
+void pthread_ext_wait_policy_init(pthread_ext_wait_policy_t * policy);
+
+
+
+/** Set the wait policy of a wait queue. Call before the wait queue is in use.
+ *
+ * @param[in] wq			pointer to the wait queue
+ * @param[in] policy		wait policy, or NULL for the defaults
+ */
+void pthread_ext_waitq_set_policy(pthread_ext_waitq_t * wq, const pthread_ext_wait_policy_t * policy);
+
+
+
+/** Destroy a wait queue.
+ *
+ * @param[in] wq			pointer to the wait queue
+ */
+void pthread_ext_waitq_destroy(pthread_ext_waitq_t * wq);
+
+
+
+/** Register as a waiter.
+ *
+ * After this call, and before pthread_ext_waitq_wait, the caller re-checks the condition
+ * it waits for. Any wake issued after the registration makes the wait return at once. If
+ * the condition is already satisfied, call pthread_ext_waitq_cancel instead of waiting.
+ *
+ * The registration is a sequentially consistent read-modify-write, so a waker which
+ * changes the condition with a sequentially consistent store (or under a mutex the waiter
+ * also holds) will see the waiter.
+ *
+ * @param[in] wq			pointer to the wait queue
+ * @returns                 sequence number to pass to pthread_ext_waitq_wait
+ */
+uint32_t pthread_ext_waitq_prepare(pthread_ext_waitq_t * wq);
+
+
+
+/** Withdraw a registration made by pthread_ext_waitq_prepare without waiting.
+ *
+ * @param[in] wq			pointer to the wait queue
+ */
+void pthread_ext_waitq_cancel(pthread_ext_waitq_t * wq);
+
+
+
+/** Wait for a wake after pthread_ext_waitq_prepare, and end the registration.
+ *
+ * Returns as soon as the sequence number differs from seq. Depending on the wait policy,
+ * the thread spins and yields for a while before it parks. Like a condition variable wait,
+ * the return may be spurious, so the caller re-checks its condition. The wait is a
+ * deferred cancellation point; a thread parked in the kernel acts on a cancel within
+ * 100 ms.
+ *
+ * @param[in] wq			pointer to the wait queue
+ * @param[in] seq			sequence number returned by pthread_ext_waitq_prepare
+ * @param[in] abstime		absolute PTHREAD_EXT_CLOCK timeout, or NULL to wait forever
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ETIMEDOUT]         abstime has passed
+ */
+int pthread_ext_waitq_wait(pthread_ext_waitq_t * wq, uint32_t seq, const struct timespec * abstime);
+
+
+
+/** Wait on a wait queue with a mutex held, like pthread_cond_timedwait.
+ *
+ * The mutex is released while waiting and taken again before returning. If the thread
+ * is cancelled while waiting, the mutex is not held when the cancellation handlers run.
+ *
+ * @param[in] wq			pointer to the wait queue
+ * @param[in] mutex			mutex held by the caller
+ * @param[in] abstime		absolute PTHREAD_EXT_CLOCK timeout, or NULL to wait forever
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ETIMEDOUT]         abstime has passed
+ */
+int pthread_ext_waitq_wait_mutex(pthread_ext_waitq_t * wq, pthread_mutex_t * mutex,
+								 const struct timespec * abstime);
+
+
+
+/** Wake threads waiting on a wait queue.
+ *
+ * Does nothing, and makes no system call, if no thread is registered.
+ *
+ * @param[in] wq			pointer to the wait queue
+ * @param[in] nwake			number of parked threads to wake, or PTHREAD_EXT_WAKE_ALL
+ */
+void pthread_ext_waitq_wake(pthread_ext_waitq_t * wq, int nwake);
+
+
+
+/** Add a watch to a wait queue, so that its wakes also wake target.
+ *
+ * The watch stays linked into wq until pthread_ext_waitq_unwatch, and target must stay
+ * valid as long. Watches only work within one process.
+ *
+ * @param[in] wq			pointer to the watched wait queue
+ * @param[in] watch			watch to link, owned by the caller
+ * @param[in] target		wait queue to wake
+ */
+void pthread_ext_waitq_watch(pthread_ext_waitq_t * wq, pthread_ext_waitq_watch_t * watch,
+							 pthread_ext_waitq_t * target);
+
+
+
+/** Add a one-shot watch to a wait queue.
+ *
+ * The next wake of wq with registered waiters unlinks the watch and calls notify(watch),
+ * in the waking thread and under a spin lock of wq: notify must be short, must not block,
+ * and must not call back into wq. A wake for nwake waiters fires up to nwake one-shot
+ * watches, oldest first. Watches only work within one process.
+ *
+ * @param[in] wq			pointer to the watched wait queue
+ * @param[in] watch			watch to link, owned by the caller
+ * @param[in] notify		function to call
+ */
+void pthread_ext_waitq_notify(pthread_ext_waitq_t * wq, pthread_ext_waitq_watch_t * watch,
+							  void (* notify)(pthread_ext_waitq_watch_t * watch));
+
+
+
+/** Remove a watch added with pthread_ext_waitq_watch or pthread_ext_waitq_notify.
+ *
+ * When this returns, no waker uses the watch or its target any longer, and a one-shot
+ * watch's function has returned if it was called.
+ *
+ * @param[in] wq			pointer to the watched wait queue
+ * @param[in] watch			watch to unlink
+ * @returns                 1 if the watch was unlinked, 0 if a one-shot watch had fired
+ */
+int pthread_ext_waitq_unwatch(pthread_ext_waitq_t * wq, pthread_ext_waitq_watch_t * watch);
+
+
+
+/*
+ * A park word is a one-shot wakeup for a single waiter. It starts at 0; the waiter blocks
+ * in pthread_ext_park_wait until another thread posts a non-zero value (below 0x80000000)
+ * with pthread_ext_park_post. The post touches the word once, so the waiter may return
+ * and free the word as soon as it sees the value: this suits wait records kept on the
+ * waiting thread's stack, which a waker must not touch after the waiter has gone.
+ */
+
+/** Wait for a park word to be posted.
+ *
+ * The wait follows, and adapts, the policy of wq, and is shared between processes if wq
+ * is. Nothing waits on wq itself, so one wq can serve as the policy of many park words. On return
+ * with 0, *word holds the posted value. On ETIMEDOUT, *word is 0 again. The wait is a
+ * cancellation point; if the thread is cancelled, the word may hold an internal value
+ * until it is posted.
+ *
+ * @param[in] word			pointer to the park word
+ * @param[in] wq			wait queue whose policy to follow
+ * @param[in] abstime		absolute PTHREAD_EXT_CLOCK timeout, or NULL to wait forever
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ETIMEDOUT]         abstime has passed
+ */
+int pthread_ext_park_wait(uint32_t * word, pthread_ext_waitq_t * wq, const struct timespec * abstime);
+
+
+
+/** Post a value to a park word, waking its waiter.
+ *
+ * @param[in] word			pointer to the park word
+ * @param[in] value			non-zero value below 0x80000000
+ * @param[in] pshared		1 if the word is shared between processes
+ */
+void pthread_ext_park_post(uint32_t * word, uint32_t value, int pshared);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* PTHREAD_EXT_WAIT_H */
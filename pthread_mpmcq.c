@@ -0,0 +1,343 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014, Stephen Scott
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/* 
+ * pthread_mpmcq implementation
+ *
+ * Bounded lock-free ring after D. Vyukov. Every cell carries a sequence number: a cell at
+ * position pos is free for writing when its sequence is pos, and holds a message for
+ * reading when its sequence is pos+1. A producer claims a position by advancing tail with a
+ * compare and swap, copies the message, then publishes the cell by setting its sequence to
+ * pos+1. A consumer claims by advancing head, copies the message out, then frees the cell
+ * for the next lap by setting its sequence to pos+qsize.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+
+#include "pthread_mpmcq.h"
+#include "pthread_ext_common.h"
+#include "pthread_ext_wait.h"
+
+/**************************************************************************************************/
+/* mpmcq_try_send
+ * claim the cell at tail and copy the message into it. Returns ETIMEDOUT if the queue is full.
+ */
+static int mpmcq_try_send(pthread_mpmcq_t *queue, void *msg)
+{
+	uint64_t		pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+	uint64_t	  *	cell;
+	int64_t			dif;
+
+	for (;;)
+	{
+		cell = (uint64_t *) &queue->buffer[(pos & queue->mask) * queue->cell_len];
+		dif = (int64_t)(__atomic_load_n(cell, __ATOMIC_ACQUIRE) - pos);
+
+		if (0 == dif)
+		{
+			if (__atomic_compare_exchange_n(&queue->tail, &pos, pos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if (dif < 0)
+			return ETIMEDOUT;
+		else
+			pos = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+	}
+
+	/* copy message to the cell and publish it */
+	memcpy(cell + 1, msg, queue->msg_len);
+	__atomic_store_n(cell, pos+1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* mpmcq_try_get
+ * claim the cell at head and copy the message out of it. Returns ETIMEDOUT if the queue is empty.
+ */
+static int mpmcq_try_get(pthread_mpmcq_t *queue, void *msg)
+{
+	uint64_t		pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+	uint64_t	  *	cell;
+	int64_t			dif;
+
+	for (;;)
+	{
+		cell = (uint64_t *) &queue->buffer[(pos & queue->mask) * queue->cell_len];
+		dif = (int64_t)(__atomic_load_n(cell, __ATOMIC_ACQUIRE) - (pos+1));
+
+		if (0 == dif)
+		{
+			if (__atomic_compare_exchange_n(&queue->head, &pos, pos+1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		}
+		else if (dif < 0)
+			return ETIMEDOUT;
+		else
+			pos = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+	}
+
+	/* copy message from the cell and free it for the next lap */
+	memcpy(msg, cell + 1, queue->msg_len);
+	__atomic_store_n(cell, pos + queue->qsize, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* pthread_mpmcq_create
+ * create and initialize a new queue.
+ */
+int pthread_mpmcq_create(pthread_mpmcq_t ** ppqueue, void * qstart, uint32_t num_msg, uint32_t msg_len_bytes)
+{
+	pthread_mpmcq_t * queue;
+	uint32_t		i;
+
+	if ((0 == num_msg) || (num_msg & (num_msg - 1)))
+		return EINVAL;
+
+	if (NULL == *ppqueue)
+	{
+		if (0 != posix_memalign((void **) &queue, PTHREAD_EXT_CACHE_LINE, sizeof(pthread_mpmcq_t)))
+			return ENOMEM;
+
+		queue->buffer = (char *) malloc(PTHREAD_MPMCQ_BUFFER_SIZE(num_msg, msg_len_bytes));
+		if (NULL == queue->buffer)
+		{
+			free(queue);
+			return ENOMEM;
+		}
+
+		*ppqueue = queue;
+		queue->destroyFree = 1;
+	}
+	else
+	{
+		queue = *ppqueue;
+		queue->buffer = (char *) qstart;
+		if (NULL == queue->buffer)
+		{
+			return ENOMEM;
+		}
+		queue->destroyFree = 0;
+	}
+
+	pthread_ext_waitq_init(&queue->full);
+	pthread_ext_waitq_init(&queue->empty);
+	queue->qsize = num_msg;
+	queue->mask = num_msg - 1;
+	queue->msg_len = msg_len_bytes;
+	queue->cell_len = PTHREAD_MPMCQ_CELL_LEN(msg_len_bytes);
+	queue->head = 0;
+	queue->tail = 0;
+
+	for (i = 0; i < num_msg; i++)
+		*(uint64_t *) &queue->buffer[i * queue->cell_len] = i;
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* pthread_mpmcq_destroy
+ * free a queue.
+ */
+void pthread_mpmcq_destroy(pthread_mpmcq_t *queue)
+{
+	pthread_ext_waitq_destroy(&queue->full);
+	pthread_ext_waitq_destroy(&queue->empty);
+	if (queue->destroyFree)
+	{
+		free(queue->buffer);
+		free(queue);
+	}
+
+} /* pthread_mpmcq_destroy */
+
+
+/**************************************************************************************************/
+/* pthread_mpmcq_sendmsg
+ * puts new message on the queue.
+ * timeout is PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * If the queue is full, the caller parks on the full wait queue until a consumer frees a cell.
+ */
+int pthread_mpmcq_sendmsg(pthread_mpmcq_t *queue, void *msg, long timeout)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout) && (timeout < 0) )
+		return EINVAL;
+
+	return pthread_mpmcq_sendmsg_until(queue, msg, pthread_ext_deadline_ms(timeout, &abstime));
+
+} /* pthread_mpmcq_sendmsg */
+
+
+/**************************************************************************************************/
+/* pthread_mpmcq_sendmsg_ns
+ * as pthread_mpmcq_sendmsg, with the timeout in nanoseconds.
+ */
+int pthread_mpmcq_sendmsg_ns(pthread_mpmcq_t *queue, void *msg, long long timeout_ns)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0) )
+		return EINVAL;
+
+	return pthread_mpmcq_sendmsg_until(queue, msg, pthread_ext_deadline_ns(timeout_ns, &abstime));
+
+} /* pthread_mpmcq_sendmsg_ns */
+
+
+/**************************************************************************************************/
+/* pthread_mpmcq_sendmsg_until
+ * as pthread_mpmcq_sendmsg, waiting until an absolute PTHREAD_EXT_CLOCK deadline.
+ */
+int pthread_mpmcq_sendmsg_until(pthread_mpmcq_t *queue, void *msg, const struct timespec *deadline)
+{
+	uint32_t		seq;
+	int				result;
+
+	result = mpmcq_try_send(queue, msg);
+	if ( (0 != result) && (PTHREAD_EXT_DEADLINE_NOW != deadline) )
+	{
+		/* wait while buffer full */
+		for (;;)
+		{
+			seq = pthread_ext_waitq_prepare(&queue->full);
+			result = mpmcq_try_send(queue, msg);
+			if (0 == result)
+			{
+				pthread_ext_waitq_cancel(&queue->full);
+				break;
+			}
+
+			result = pthread_ext_waitq_wait(&queue->full, seq, deadline);
+			if (ETIMEDOUT == result)
+				break;
+		}
+	}
+
+	/* signal waiting consumer */
+	if (0 == result)
+	{
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		pthread_ext_waitq_wake(&queue->empty, 1);
+	}
+
+	return result;
+
+} /* pthread_mpmcq_sendmsg_until */
+
+
+/**************************************************************************************************/
+/* pthread_mpmcq_getmsg
+ * gets the oldest message in the queue.
+ * timeout is PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * If the queue is empty, the caller parks on the empty wait queue until a producer fills a cell.
+ */
+int pthread_mpmcq_getmsg(pthread_mpmcq_t *queue, void *msg, long timeout)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout) && (timeout < 0) )
+		return EINVAL;
+
+	return pthread_mpmcq_getmsg_until(queue, msg, pthread_ext_deadline_ms(timeout, &abstime));
+
+} /* pthread_mpmcq_getmsg */
+
+
+/**************************************************************************************************/
+/* pthread_mpmcq_getmsg_ns
+ * as pthread_mpmcq_getmsg, with the timeout in nanoseconds.
+ */
+int pthread_mpmcq_getmsg_ns(pthread_mpmcq_t *queue, void *msg, long long timeout_ns)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0) )
+		return EINVAL;
+
+	return pthread_mpmcq_getmsg_until(queue, msg, pthread_ext_deadline_ns(timeout_ns, &abstime));
+
+} /* pthread_mpmcq_getmsg_ns */
+
+
+/**************************************************************************************************/
+/* pthread_mpmcq_getmsg_until
+ * as pthread_mpmcq_getmsg, waiting until an absolute PTHREAD_EXT_CLOCK deadline.
+ */
+int pthread_mpmcq_getmsg_until(pthread_mpmcq_t *queue, void *msg, const struct timespec *deadline)
+{
+	uint32_t		seq;
+	int				result;
+
+	result = mpmcq_try_get(queue, msg);
+	if ( (0 != result) && (PTHREAD_EXT_DEADLINE_NOW != deadline) )
+	{
+		/* wait while there is nothing in the buffer */
+		for (;;)
+		{
+			seq = pthread_ext_waitq_prepare(&queue->empty);
+			result = mpmcq_try_get(queue, msg);
+			if (0 == result)
+			{
+				pthread_ext_waitq_cancel(&queue->empty);
+				break;
+			}
+
+			result = pthread_ext_waitq_wait(&queue->empty, seq, deadline);
+			if (ETIMEDOUT == result)
+				break;
+		}
+	}
+
+	/* signal waiting producer */
+	if (0 == result)
+	{
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		pthread_ext_waitq_wake(&queue->full, 1);
+	}
+
+	return result;
+
+} /* pthread_mpmcq_getmsg_until */
+
+/**************************************************************************************************/
+/* pthread_mpmcq_count
+ * return number of entries in queue, including those being copied in or out
+ */
+uint32_t pthread_mpmcq_count(pthread_mpmcq_t * queue)
+{
+	uint64_t		head;
+
+	/* read head first, tail never falls behind it */
+	head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+	return (uint32_t)(__atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) - head);
+}
@@ -0,0 +1,171 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014, Stephen Scott
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/** @file pthread_mpmcq.h
+ * @brief pthread lock-free multi-producer/multi-consumer bounded message queue
+ */
+
+#ifndef PTHREAD_MPMCQ_H
+#define PTHREAD_MPMCQ_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "pthread_ext_common.h"
+#include "pthread_ext_wait.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Bytes of queue buffer needed for num_msg messages of msg_len bytes (see pthread_mpmcq_create) */
+#define PTHREAD_MPMCQ_CELL_LEN(msg_len)				(8 + (((msg_len) + 7) & ~7u))
+#define PTHREAD_MPMCQ_BUFFER_SIZE(num_msg, msg_len)	((size_t)(num_msg) * PTHREAD_MPMCQ_CELL_LEN(msg_len))
+
+typedef struct pthread_mpmcq_s {
+	char		  *	buffer;		/* ring of cells, each a sequence number and a message */
+	pthread_ext_waitq_t	full;	/* full condition */
+	pthread_ext_waitq_t	empty;	/* empty condition */
+	uint32_t		qsize;		/* max number of elements in queue */
+	uint32_t		mask;		/* qsize - 1 */
+	uint32_t		msg_len;	/* length of each message */
+	uint32_t		cell_len;	/* length of each cell */
+	uint8_t			destroyFree;/* 1 = free memory on destroy */
+
+	uint64_t		head PTHREAD_EXT_CACHE_ALIGNED;	/* next position to read */
+	uint64_t		tail PTHREAD_EXT_CACHE_ALIGNED;	/* next position to write */
+} pthread_mpmcq_t;
+
+
+/** Create a lock-free multi-producer/multi-consumer queue with fixed length messages.
+ *
+ * Set *ppqueue = NULL to allocate memory for the queue. Otherwise, caller allocates memory
+ * (aligned to PTHREAD_EXT_CACHE_LINE) and provides a buffer of at least
+ * PTHREAD_MPMCQ_BUFFER_SIZE(num_msg, msg_len_bytes) bytes, aligned to 8 bytes.
+ *
+ * Each cell of the ring carries a sequence number, so producers and consumers only contend
+ * on the head or tail counter they advance. The wait queues are only touched by threads
+ * which have to block, or when a thread is blocked.
+ *
+ * @param[inout] ppqueue		if *ppqueue == NULL, allocate memory for queue. Returns queue pointer.
+ * @param[in]	 qstart			pointer to the queue buffer
+ * @param[in]    num_msg        maximum number of messages in the queue, a power of two
+ * @param[in]    msg_len_bytes  maximum size of each message in bytes
+ * @returns                   0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ENOMEM]            	memory for queue not available
+ *      [EINVAL]            	num_msg is not a power of two
+ */
+int pthread_mpmcq_create(pthread_mpmcq_t ** ppqueue, void * qstart, uint32_t num_msg, uint32_t msg_len_bytes);
+
+
+
+/** Destroy a message queue.
+ * 
+ * @param[in]  queue          pointer to the queue to destroy
+ * @returns                   nothing
+ */
+void pthread_mpmcq_destroy(pthread_mpmcq_t *queue);
+
+
+
+/** Send message to a queue.
+ * 
+ * Same semantics as pthread_queue_sendmsg.
+ *
+ * @param[in] queue         pointer to the queue
+ * @param[in] msg           message to place in the queue
+ * @param[in] timeout       PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ETIMEDOUT]         timeout has passed (or, if PTHREAD_NOWAIT, queue is full)
+ *      [EINVAL]            timeout value is invalid
+ */
+int pthread_mpmcq_sendmsg(pthread_mpmcq_t *queue, void *msg, long timeout);
+
+
+
+/** Same as pthread_mpmcq_sendmsg, with the timeout in nanoseconds.
+ *
+ * @param[in] timeout_ns	PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ns
+ */
+int pthread_mpmcq_sendmsg_ns(pthread_mpmcq_t *queue, void *msg, long long timeout_ns);
+
+
+
+/** Same as pthread_mpmcq_sendmsg, waiting until an absolute deadline.
+ *
+ * @param[in] deadline		absolute PTHREAD_EXT_CLOCK time, NULL to wait forever, or
+ *                          PTHREAD_EXT_DEADLINE_NOW not to wait
+ */
+int pthread_mpmcq_sendmsg_until(pthread_mpmcq_t *queue, void *msg, const struct timespec * deadline);
+
+
+
+/** Get message from a queue.
+ *
+ * Same semantics as pthread_queue_getmsg.
+ *
+ * @param[in]  queue		pointer to the queue
+ * @param[out] msg			buffer to receive message from the queue.
+ * @param[in]  timeout		PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ETIMEDOUT]         timeout has passed (or, if PTHREAD_NOWAIT, queue is empty)
+ *      [EINVAL]            timeout value is invalid
+ */
+int pthread_mpmcq_getmsg(pthread_mpmcq_t *queue, void *msg, long timeout);
+
+
+
+/** Same as pthread_mpmcq_getmsg, with the timeout in nanoseconds.
+ *
+ * @param[in] timeout_ns	PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ns
+ */
+int pthread_mpmcq_getmsg_ns(pthread_mpmcq_t *queue, void *msg, long long timeout_ns);
+
+
+
+/** Same as pthread_mpmcq_getmsg, waiting until an absolute deadline.
+ *
+ * @param[in] deadline		absolute PTHREAD_EXT_CLOCK time, NULL to wait forever, or
+ *                          PTHREAD_EXT_DEADLINE_NOW not to wait
+ */
+int pthread_mpmcq_getmsg_until(pthread_mpmcq_t *queue, void *msg, const struct timespec * deadline);
+
+
+
+/** Return number of messages in a queue.
+ *
+ * @param[in] queue			pointer to the queue
+ */
+uint32_t pthread_mpmcq_count(pthread_mpmcq_t * queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PTHREAD_MPMCQ_H */
@@ -0,0 +1,300 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014, Stephen Scott
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/* 
+ * pthread_pool implementation
+ *
+ * The shared free list is a stack of object indexes, linked through the next array
+ * rather than through the objects, so a thread that loses a race still reads valid memory.
+ * top packs the index of the first object with a tag bumped by every change, which a
+ * compare and swap checks to tell a list that was popped and pushed back (ABA) from one
+ * that was left alone.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+
+#include "pthread_pool.h"
+#include "pthread_ext_common.h"
+
+/** One thread's cache of free objects */
+typedef struct pthread_pool_cache_s {
+	struct pthread_pool_cache_s * next;
+	struct pthread_pool_cache_s * prev;
+	pthread_pool_t * pool;
+	uint32_t		count;		/* objects in the cache */
+	uint32_t		objs[];		/* their indexes, the most recently freed last */
+} pool_cache_t;
+
+/**************************************************************************************************/
+/* pool_push
+ * link n object indexes in order and push them on the free list with one compare and swap.
+ */
+static void pool_push(pthread_pool_t *pool, const uint32_t *objs, uint32_t n)
+{
+	uint64_t		old = __atomic_load_n(&pool->top, __ATOMIC_RELAXED);
+	uint32_t		i;
+
+	for (i = 0; i + 1 < n; i++)
+		pool->next[objs[i]] = objs[i+1] + 1;
+
+	do {
+		__atomic_store_n(&pool->next[objs[n-1]], (uint32_t) old, __ATOMIC_RELAXED);
+	} while (!__atomic_compare_exchange_n(&pool->top, &old, (((old >> 32) + 1) << 32) | (objs[0] + 1),
+										  1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/**************************************************************************************************/
+/* pool_pop
+ * pop up to n object indexes off the free list. Returns the number popped.
+ */
+static uint32_t pool_pop(pthread_pool_t *pool, uint32_t *objs, uint32_t n)
+{
+	uint64_t		old = __atomic_load_n(&pool->top, __ATOMIC_ACQUIRE);
+	uint64_t		new;
+	uint32_t		first;
+	uint32_t		got;
+
+	for (got = 0; got < n; got++)
+	{
+		do {
+			first = (uint32_t) old;
+			if (0 == first)
+				return got;
+			new = (((old >> 32) + 1) << 32) | __atomic_load_n(&pool->next[first-1], __ATOMIC_RELAXED);
+		} while (!__atomic_compare_exchange_n(&pool->top, &old, new, 1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+
+		objs[got] = first - 1;
+		old = new;
+	}
+
+	return got;
+}
+
+/**************************************************************************************************/
+/* pool_cache_exit
+ * thread exit: give the cache back to the free list.
+ */
+static void pool_cache_exit(void *arg)
+{
+	pool_cache_t  *	cache = (pool_cache_t *) arg;
+	pthread_pool_t * pool = cache->pool;
+
+	if (cache->count)
+		pool_push(pool, cache->objs, cache->count);
+
+	pthread_mutex_lock(&pool->caches_lock);
+	if (cache->prev)
+		cache->prev->next = cache->next;
+	else
+		pool->caches = cache->next;
+	if (cache->next)
+		cache->next->prev = cache->prev;
+	pthread_mutex_unlock(&pool->caches_lock);
+
+	free(cache);
+}
+
+/**************************************************************************************************/
+/* pool_cache
+ * the calling thread's cache, set up on first use. NULL if the pool has no caches, or
+ * there is no memory for one.
+ */
+static inline pool_cache_t *pool_cache(pthread_pool_t *pool)
+{
+	pool_cache_t  *	cache;
+
+	if (0 == pool->cache_size)
+		return NULL;
+
+	cache = (pool_cache_t *) pthread_getspecific(pool->key);
+	if (NULL != cache)
+		return cache;
+
+	cache = (pool_cache_t *) malloc(sizeof(pool_cache_t) + pool->cache_size * sizeof(uint32_t));
+	if (NULL == cache)
+		return NULL;
+	cache->pool = pool;
+	cache->count = 0;
+	cache->prev = NULL;
+
+	pthread_mutex_lock(&pool->caches_lock);
+	cache->next = pool->caches;
+	if (cache->next)
+		cache->next->prev = cache;
+	pool->caches = cache;
+	pthread_mutex_unlock(&pool->caches_lock);
+
+	pthread_setspecific(pool->key, cache);
+
+	return cache;
+}
+
+/**************************************************************************************************/
+/* pthread_pool_attr_init
+ * default attributes.
+ */
+int pthread_pool_attr_init(pthread_pool_attr_t * attr)
+{
+	attr->cache_size = PTHREAD_POOL_CACHE_SIZE;
+	pthread_ext_alloc_attr_init(&attr->alloc);
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* pthread_pool_create
+ * create a pool with every object on the free list, in address order.
+ */
+int pthread_pool_create(pthread_pool_t ** pppool, uint32_t num_objs, uint32_t obj_size,
+						const pthread_pool_attr_t * attr)
+{
+	pthread_pool_t * pool;
+	void		  *	objs;
+	size_t			map_len;
+	uint32_t		stride = (obj_size + PTHREAD_EXT_CACHE_LINE - 1) & ~(uint32_t) (PTHREAD_EXT_CACHE_LINE - 1);
+	uint32_t		i;
+	int				result;
+
+	if ((0 == num_objs) || (num_objs == UINT32_MAX) || (0 == obj_size) || (stride < obj_size))
+		return EINVAL;
+
+	if (0 != posix_memalign((void **) &pool, PTHREAD_EXT_CACHE_LINE, sizeof(pthread_pool_t)))
+		return ENOMEM;
+
+	pool->next = (uint32_t *) malloc((size_t) num_objs * sizeof(uint32_t));
+	if (NULL == pool->next)
+	{
+		free(pool);
+		return ENOMEM;
+	}
+
+	result = pthread_ext_alloc(&objs, (size_t) num_objs * stride, attr ? &attr->alloc : NULL, &map_len);
+	if (0 == result)
+	{
+		result = pthread_key_create(&pool->key, pool_cache_exit);
+		if (result)
+			pthread_ext_free(objs, map_len);
+	}
+	if (result)
+	{
+		free(pool->next);
+		free(pool);
+		return result;
+	}
+
+	for (i = 0; i < num_objs; i++)
+		pool->next[i] = (i + 1 < num_objs) ? i + 2 : 0;
+
+	pthread_mutex_init(&pool->caches_lock, NULL);
+	pool->objs = (char *) objs;
+	pool->map_len = map_len;
+	pool->num_objs = num_objs;
+	pool->obj_size = obj_size;
+	pool->stride = stride;
+	pool->cache_size = attr ? attr->cache_size : PTHREAD_POOL_CACHE_SIZE;
+	pool->caches = NULL;
+	pool->top = 1;
+
+	*pppool = pool;
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* pthread_pool_destroy
+ * free a pool and the caches of threads still running.
+ */
+void pthread_pool_destroy(pthread_pool_t *pool)
+{
+	pool_cache_t  *	cache;
+
+	pthread_key_delete(pool->key);
+	while (NULL != (cache = pool->caches))
+	{
+		pool->caches = cache->next;
+		free(cache);
+	}
+	pthread_mutex_destroy(&pool->caches_lock);
+	pthread_ext_free(pool->objs, pool->map_len);
+	free(pool->next);
+	free(pool);
+
+} /* pthread_pool_destroy */
+
+
+/**************************************************************************************************/
+/* pthread_pool_alloc
+ * take the most recently freed object in the thread's cache, refilling an empty cache
+ * with half a cache from the free list.
+ */
+void * pthread_pool_alloc(pthread_pool_t *pool)
+{
+	pool_cache_t  *	cache = pool_cache(pool);
+	uint32_t		obj;
+
+	if (NULL == cache)
+		return pool_pop(pool, &obj, 1) ? pool->objs + (size_t) obj * pool->stride : NULL;
+
+	if (0 == cache->count)
+		cache->count = pool_pop(pool, cache->objs, (pool->cache_size + 1) / 2);
+	if (0 == cache->count)
+		return NULL;
+
+	return pool->objs + (size_t) cache->objs[--cache->count] * pool->stride;
+
+} /* pthread_pool_alloc */
+
+
+/**************************************************************************************************/
+/* pthread_pool_free
+ * put the object in the thread's cache, first giving the older half of a full cache back
+ * to the free list.
+ */
+void pthread_pool_free(pthread_pool_t *pool, void *obj)
+{
+	pool_cache_t  *	cache = pool_cache(pool);
+	uint32_t		index = (uint32_t) (((char *) obj - pool->objs) / pool->stride);
+	uint32_t		half;
+
+	if (NULL == cache)
+	{
+		pool_push(pool, &index, 1);
+		return;
+	}
+
+	if (cache->count == pool->cache_size)
+	{
+		half = (pool->cache_size + 1) / 2;
+		pool_push(pool, cache->objs, half);
+		cache->count -= half;
+		memmove(cache->objs, cache->objs + half, cache->count * sizeof(uint32_t));
+	}
+	cache->objs[cache->count++] = index;
+
+} /* pthread_pool_free */
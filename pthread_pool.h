@@ -0,0 +1,144 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014, Stephen Scott
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/** @file pthread_pool.h
+ * @brief pthread fixed size object pool with per-thread caches
+ */
+
+#ifndef PTHREAD_POOL_H
+#define PTHREAD_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "pthread_ext_common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Default number of objects each thread keeps in its cache */
+#define PTHREAD_POOL_CACHE_SIZE	32
+
+typedef struct pthread_pool_attr_s {
+	uint32_t		cache_size;	/* objects each thread keeps to itself, 0 for no caches */
+	pthread_ext_alloc_attr_t	alloc;	/* how the objects are placed */
+} pthread_pool_attr_t;
+
+struct pthread_pool_cache_s;
+
+typedef struct pthread_pool_s {
+	char		  *	objs;		/* the objects, stride bytes apart */
+	uint32_t	  *	next;		/* free list link of each object: index + 1, 0 = end */
+	size_t			map_len;	/* length from pthread_ext_alloc */
+	uint32_t		num_objs;	/* number of objects */
+	uint32_t		obj_size;	/* size of each object */
+	uint32_t		stride;		/* obj_size rounded up to a cache line */
+	uint32_t		cache_size;	/* objects each thread keeps to itself */
+	pthread_key_t	key;		/* the calling thread's cache */
+	pthread_mutex_t	caches_lock;/* lock the list of caches */
+	struct pthread_pool_cache_s * caches;	/* caches of all threads, freed on destroy */
+
+	uint64_t		top PTHREAD_EXT_CACHE_ALIGNED;	/* free list: tag << 32 | index + 1 of first object */
+} pthread_pool_t;
+
+
+/** Initialize pool attributes to the defaults: PTHREAD_POOL_CACHE_SIZE objects per thread,
+ * cache line aligned heap memory.
+ *
+ * @param[out] attr			pointer to the attributes
+ * @returns                 0 for success
+ */
+int pthread_pool_attr_init(pthread_pool_attr_t * attr);
+
+
+
+/** Create a pool of fixed size objects.
+ *
+ * The pool is meant to go with a queue of pointers (a pthread_queue_t with msg_len
+ * sizeof(void *)) for payloads too large to copy: a producer takes an object from the
+ * pool, fills it in and sends the pointer, and the consumer gives the object back when
+ * it is done with it. Neither side calls malloc or free, or shares an allocator lock.
+ *
+ * Each thread keeps up to attr->cache_size free objects to itself, last freed first out,
+ * so an object is usually reused while it is still in the thread's cache. A thread which
+ * runs out takes half a cache of objects from a lock-free free list shared by all
+ * threads, and one with a full cache gives the older half back, linked up beforehand so
+ * the whole batch takes one compare and swap. A producer and a consumer on different
+ * threads so exchange objects in batches. The cache of a thread goes back to the shared
+ * list when the thread exits.
+ *
+ * Objects are cache line aligned and each takes whole cache lines, so two objects never
+ * share one. attr->alloc places them, for instance on the NUMA node of the threads using
+ * them (see pthread_ext_alloc).
+ *
+ * @param[out]   pppool			returns the pool pointer
+ * @param[in]    num_objs		number of objects
+ * @param[in]    obj_size		size of each object in bytes
+ * @param[in]    attr			pool attributes, or NULL for defaults
+ * @returns                   0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ENOMEM]            	memory for pool not available
+ *      [EAGAIN]            	no thread-specific data key available
+ *      [EINVAL]            	num_objs or obj_size is 0, or attributes are invalid
+ */
+int pthread_pool_create(pthread_pool_t ** pppool, uint32_t num_objs, uint32_t obj_size,
+						const pthread_pool_attr_t * attr);
+
+
+
+/** Destroy a pool. No thread may use it, or its objects, afterwards.
+ *
+ * @param[in]  pool           pointer to the pool to destroy
+ * @returns                   nothing
+ */
+void pthread_pool_destroy(pthread_pool_t *pool);
+
+
+
+/** Take an object from a pool.
+ *
+ * @param[in]  pool			pointer to the pool
+ * @returns                 pointer to the object, or NULL if every object is in use or in
+ *                          the cache of another thread
+ */
+void * pthread_pool_alloc(pthread_pool_t *pool);
+
+
+
+/** Give an object back to a pool. Any thread may free an object, whichever took it.
+ *
+ * @param[in]  pool			pointer to the pool
+ * @param[in]  obj			object from pthread_pool_alloc
+ */
+void pthread_pool_free(pthread_pool_t *pool, void *obj);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PTHREAD_POOL_H */
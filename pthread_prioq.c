@@ -0,0 +1,329 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014, Stephen Scott
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/* 
+ * pthread_prioq implementation
+ *
+ * One mutex and one empty wait queue cover all levels, and each level has its own ring and
+ * full wait queue. ready has a bit per level with messages, so a receiver finds the highest
+ * one with a count-leading-zeros instead of looking at every level.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+
+#include "pthread_prioq.h"
+#include "pthread_ext_common.h"
+#include "pthread_ext_wait.h"
+
+/**************************************************************************************************/
+/* prioq_msg
+ * address of the message at buffer index slot of a level.
+ */
+static inline char *prioq_msg(const pthread_prioq_t *queue, uint32_t level, uint32_t slot)
+{
+	return queue->buffer + ((size_t) level * queue->qsize + slot) * queue->msg_len;
+}
+
+/**************************************************************************************************/
+/* prioq_pick
+ * called with the mutex held and a message in the queue. Return the highest level with
+ * messages, unless that level has used up its weight while a lower level waited: then the
+ * turn passes down to the highest lower level with messages, which checks its own weight.
+ */
+static uint32_t prioq_pick(pthread_prioq_t *queue)
+{
+	pthread_prioq_level_t *l;
+	uint32_t		level = 31 - (uint32_t) __builtin_clz(queue->ready);
+	uint32_t		lower;
+
+	for (;;)
+	{
+		l = &queue->levels[level];
+		lower = queue->ready & ((1u << level) - 1);
+		if (0 == lower)
+		{
+			l->run = 0;
+			return level;
+		}
+
+		if ((0 == l->weight) || (++l->run <= l->weight))
+			return level;
+
+		l->run = 0;
+		level = 31 - (uint32_t) __builtin_clz(lower);
+	}
+}
+
+/**************************************************************************************************/
+/* pthread_prioq_attr_init
+ * default attributes.
+ */
+int pthread_prioq_attr_init(pthread_prioq_attr_t * attr)
+{
+	pthread_ext_wait_policy_init(&attr->wait);
+	memset(attr->weights, 0, sizeof(attr->weights));
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* pthread_prioq_create
+ * create and initialize a new priority queue.
+ */
+int pthread_prioq_create(pthread_prioq_t ** ppqueue, uint32_t levels, uint32_t num_msg, uint32_t msg_len_bytes,
+						 const pthread_prioq_attr_t * attr)
+{
+	pthread_prioq_t * queue;
+	uint32_t		i;
+
+	if ((0 == levels) || (levels > PTHREAD_PRIOQ_MAX_LEVELS) || (0 == num_msg))
+		return EINVAL;
+
+	if (attr && ((unsigned) attr->wait.mode > PTHREAD_EXT_WAIT_ADAPTIVE))
+		return EINVAL;
+
+	if (0 != posix_memalign((void **) &queue, PTHREAD_EXT_CACHE_LINE, sizeof(pthread_prioq_t)))
+		return ENOMEM;
+
+	queue->buffer = (char *) malloc((size_t) levels * num_msg * msg_len_bytes);
+	queue->levels = (pthread_prioq_level_t *) calloc(levels, sizeof(pthread_prioq_level_t));
+	if ((NULL == queue->buffer) || (NULL == queue->levels))
+	{
+		free(queue->buffer);
+		free(queue->levels);
+		free(queue);
+		return ENOMEM;
+	}
+
+	pthread_mutex_init(&queue->mutex, NULL);
+	pthread_ext_waitq_init(&queue->empty);
+	pthread_ext_waitq_set_policy(&queue->empty, attr ? &attr->wait : NULL);
+	for (i = 0; i < levels; i++)
+	{
+		pthread_ext_waitq_init(&queue->levels[i].full);
+		pthread_ext_waitq_set_policy(&queue->levels[i].full, attr ? &attr->wait : NULL);
+		queue->levels[i].weight = attr ? attr->weights[i] : 0;
+	}
+	queue->ready = 0;
+	queue->count = 0;
+	queue->nlevels = levels;
+	queue->qsize = num_msg;
+	queue->msg_len = msg_len_bytes;
+
+	*ppqueue = queue;
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* pthread_prioq_destroy
+ * free a queue.
+ */
+void pthread_prioq_destroy(pthread_prioq_t *queue)
+{
+	uint32_t		i;
+
+	pthread_mutex_destroy(&queue->mutex);
+	pthread_ext_waitq_destroy(&queue->empty);
+	for (i = 0; i < queue->nlevels; i++)
+		pthread_ext_waitq_destroy(&queue->levels[i].full);
+	free(queue->buffer);
+	free(queue->levels);
+	free(queue);
+
+} /* pthread_prioq_destroy */
+
+
+/**************************************************************************************************/
+/* pthread_prioq_sendmsg
+ * puts new message on the queue at level prio.
+ * timeout is PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ */
+int pthread_prioq_sendmsg(pthread_prioq_t *queue, void *msg, uint32_t prio, long timeout)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout) && (timeout < 0) )
+		return EINVAL;
+
+	return pthread_prioq_sendmsg_until(queue, msg, prio, pthread_ext_deadline_ms(timeout, &abstime));
+
+} /* pthread_prioq_sendmsg */
+
+
+/**************************************************************************************************/
+/* pthread_prioq_sendmsg_ns
+ * as pthread_prioq_sendmsg, with the timeout in nanoseconds.
+ */
+int pthread_prioq_sendmsg_ns(pthread_prioq_t *queue, void *msg, uint32_t prio, long long timeout_ns)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0) )
+		return EINVAL;
+
+	return pthread_prioq_sendmsg_until(queue, msg, prio, pthread_ext_deadline_ns(timeout_ns, &abstime));
+
+} /* pthread_prioq_sendmsg_ns */
+
+
+/**************************************************************************************************/
+/* pthread_prioq_sendmsg_until
+ * as pthread_prioq_sendmsg, waiting until an absolute PTHREAD_EXT_CLOCK deadline.
+ */
+int pthread_prioq_sendmsg_until(pthread_prioq_t *queue, void *msg, uint32_t prio,
+								const struct timespec *deadline)
+{
+	pthread_prioq_level_t *l;
+	int				result = 0;
+
+	if (prio >= queue->nlevels)
+		return EINVAL;
+	l = &queue->levels[prio];
+
+	pthread_ext_mutex_lock(&queue->mutex);
+
+	/* wait while this level is full */
+	while (l->count == queue->qsize)
+	{
+		if (PTHREAD_EXT_DEADLINE_NOW == deadline)
+			result = ETIMEDOUT;
+		else
+			result = pthread_ext_waitq_wait_mutex(&l->full, &queue->mutex, deadline);
+		if (ETIMEDOUT == result)
+		{
+			pthread_mutex_unlock(&queue->mutex);
+			return ETIMEDOUT;
+		}
+	}
+
+	/* copy message to the level's ring */
+	memcpy(prioq_msg(queue, prio, l->tail), msg, queue->msg_len);
+	l->tail = (l->tail + 1 == queue->qsize) ? 0 : l->tail + 1;
+	l->count++;
+	queue->count++;
+	queue->ready |= 1u << prio;
+
+	/* signal waiting consumer */
+	pthread_mutex_unlock(&queue->mutex);
+	pthread_ext_waitq_wake(&queue->empty, 1);
+
+	return 0;
+
+} /* pthread_prioq_sendmsg_until */
+
+
+/**************************************************************************************************/
+/* pthread_prioq_getmsg
+ * gets the next message: the oldest of the highest level, subject to the weights.
+ * timeout is PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ */
+int pthread_prioq_getmsg(pthread_prioq_t *queue, void *msg, uint32_t *pprio, long timeout)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout) && (timeout < 0) )
+		return EINVAL;
+
+	return pthread_prioq_getmsg_until(queue, msg, pprio, pthread_ext_deadline_ms(timeout, &abstime));
+
+} /* pthread_prioq_getmsg */
+
+
+/**************************************************************************************************/
+/* pthread_prioq_getmsg_ns
+ * as pthread_prioq_getmsg, with the timeout in nanoseconds.
+ */
+int pthread_prioq_getmsg_ns(pthread_prioq_t *queue, void *msg, uint32_t *pprio, long long timeout_ns)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0) )
+		return EINVAL;
+
+	return pthread_prioq_getmsg_until(queue, msg, pprio, pthread_ext_deadline_ns(timeout_ns, &abstime));
+
+} /* pthread_prioq_getmsg_ns */
+
+
+/**************************************************************************************************/
+/* pthread_prioq_getmsg_until
+ * as pthread_prioq_getmsg, waiting until an absolute PTHREAD_EXT_CLOCK deadline.
+ */
+int pthread_prioq_getmsg_until(pthread_prioq_t *queue, void *msg, uint32_t *pprio,
+							   const struct timespec *deadline)
+{
+	pthread_prioq_level_t *l;
+	uint32_t		level;
+	int				result = 0;
+
+	pthread_ext_mutex_lock(&queue->mutex);
+
+	/* wait while there is nothing at any level */
+	while (0 == queue->ready)
+	{
+		if (PTHREAD_EXT_DEADLINE_NOW == deadline)
+			result = ETIMEDOUT;
+		else
+			result = pthread_ext_waitq_wait_mutex(&queue->empty, &queue->mutex, deadline);
+		if (ETIMEDOUT == result)
+		{
+			pthread_mutex_unlock(&queue->mutex);
+			return ETIMEDOUT;
+		}
+	}
+
+	/* copy message from the chosen level */
+	level = prioq_pick(queue);
+	l = &queue->levels[level];
+	memcpy(msg, prioq_msg(queue, level, l->head), queue->msg_len);
+	l->head = (l->head + 1 == queue->qsize) ? 0 : l->head + 1;
+	if (0 == --l->count)
+		queue->ready &= ~(1u << level);
+	queue->count--;
+
+	/* signal waiting producer at that level */
+	pthread_mutex_unlock(&queue->mutex);
+	pthread_ext_waitq_wake(&l->full, 1);
+
+	if (pprio)
+		*pprio = level;
+
+	return 0;
+
+} /* pthread_prioq_getmsg_until */
+
+/**************************************************************************************************/
+/* pthread_prioq_count
+ * return number of entries in queue
+ */
+uint32_t pthread_prioq_count(pthread_prioq_t * queue)
+{
+	return __atomic_load_n(&queue->count, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,201 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014, Stephen Scott
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/** @file pthread_prioq.h
+ * @brief pthread message queue with priority levels
+ */
+
+#ifndef PTHREAD_PRIOQ_H
+#define PTHREAD_PRIOQ_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "pthread_ext_common.h"
+#include "pthread_ext_wait.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Most priority levels of a queue */
+#define PTHREAD_PRIOQ_MAX_LEVELS	32
+
+typedef struct pthread_prioq_attr_s {
+	pthread_ext_wait_policy_t	wait;	/* how blocked senders and receivers wait */
+	uint32_t		weights[PTHREAD_PRIOQ_MAX_LEVELS];	/* per level, see pthread_prioq_create */
+} pthread_prioq_attr_t;
+
+typedef struct pthread_prioq_level_s {
+	uint32_t		head;		/* buffer index of the oldest message */
+	uint32_t		tail;		/* buffer index of the next free slot */
+	uint32_t		count;		/* number of messages at this level */
+	uint32_t		weight;		/* messages in a row while a lower level waits, 0 = no limit */
+	uint32_t		run;		/* messages taken in a row while a lower level waited */
+	pthread_ext_waitq_t	full;	/* senders at this level wait for room */
+} pthread_prioq_level_t;
+
+typedef struct pthread_prioq_s {
+	char		  *	buffer;		/* nlevels rings of qsize messages */
+	pthread_prioq_level_t *levels;	/* ring state per level, 0 the lowest */
+	pthread_mutex_t	mutex;		/* lock the structure */
+	pthread_ext_waitq_t	empty;	/* empty condition */
+	uint32_t		ready;		/* bit n set = level n has messages */
+	uint32_t		count;		/* number of messages at all levels */
+	uint32_t		nlevels;	/* number of priority levels */
+	uint32_t		qsize;		/* max number of messages at each level */
+	uint32_t		msg_len;	/* length of each message */
+} pthread_prioq_t;
+
+
+/** Initialize priority queue attributes to the defaults: park at once, strict priority.
+ *
+ * @param[out] attr			pointer to the attributes
+ * @returns                 0 for success
+ */
+int pthread_prioq_attr_init(pthread_prioq_attr_t * attr);
+
+
+
+/** Create a message queue with priority levels and fixed length messages.
+ *
+ * Each level is a FIFO ring of its own with room for num_msg messages, so a full level
+ * only holds up senders at that level. A receiver takes the oldest message of the highest
+ * level which has one (level levels-1 is the highest): a bitmap of the levels with
+ * messages finds it in constant time, and there is one wait for any message, whatever its
+ * level.
+ *
+ * By default priority is strict, and a busy level starves those below it.
+ * attr->weights[n] bounds that: once level n has given weights[n] messages in a row while
+ * a lower level had messages waiting, the next one is taken from the highest lower level
+ * instead (which may pass it on the same way). A weight of 0 leaves the level strict.
+ *
+ * @param[out]   ppqueue		returns the queue pointer
+ * @param[in]    levels			number of priority levels, 1 to PTHREAD_PRIOQ_MAX_LEVELS
+ * @param[in]    num_msg        maximum number of messages at each level
+ * @param[in]    msg_len_bytes  size of each message in bytes
+ * @param[in]    attr			queue attributes, or NULL for defaults
+ * @returns                   0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ENOMEM]            	memory for queue not available
+ *      [EINVAL]            	levels or num_msg is out of range, or attributes are invalid
+ */
+int pthread_prioq_create(pthread_prioq_t ** ppqueue, uint32_t levels, uint32_t num_msg, uint32_t msg_len_bytes,
+						 const pthread_prioq_attr_t * attr);
+
+
+
+/** Destroy a priority queue.
+ *
+ * @param[in]  queue          pointer to the queue to destroy
+ * @returns                   nothing
+ */
+void pthread_prioq_destroy(pthread_prioq_t *queue);
+
+
+
+/** Send message to a queue at a priority level.
+ *
+ * Same semantics as pthread_queue_sendmsg; the sender waits for room at its own level.
+ *
+ * @param[in] queue         pointer to the queue
+ * @param[in] msg           message to place in the queue
+ * @param[in] prio          priority level, 0 (lowest) to levels-1 (highest)
+ * @param[in] timeout       PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ETIMEDOUT]         timeout has passed (or, if PTHREAD_NOWAIT, the level is full)
+ *      [EINVAL]            timeout value or prio is invalid
+ */
+int pthread_prioq_sendmsg(pthread_prioq_t *queue, void *msg, uint32_t prio, long timeout);
+
+
+
+/** Same as pthread_prioq_sendmsg, with the timeout in nanoseconds.
+ *
+ * @param[in] timeout_ns	PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ns
+ */
+int pthread_prioq_sendmsg_ns(pthread_prioq_t *queue, void *msg, uint32_t prio, long long timeout_ns);
+
+
+
+/** Same as pthread_prioq_sendmsg, waiting until an absolute deadline.
+ *
+ * @param[in] deadline		absolute PTHREAD_EXT_CLOCK time, NULL to wait forever, or
+ *                          PTHREAD_EXT_DEADLINE_NOW not to wait
+ */
+int pthread_prioq_sendmsg_until(pthread_prioq_t *queue, void *msg, uint32_t prio,
+								const struct timespec * deadline);
+
+
+
+/** Get the next message from a queue: the oldest of the highest level, see
+ * pthread_prioq_create.
+ *
+ * Same semantics as pthread_queue_getmsg.
+ *
+ * @param[in]  queue		pointer to the queue
+ * @param[out] msg			buffer to receive message from the queue
+ * @param[out] pprio		priority level of the message, or NULL
+ * @param[in]  timeout		PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ETIMEDOUT]         timeout has passed (or, if PTHREAD_NOWAIT, queue is empty)
+ *      [EINVAL]            timeout value is invalid
+ */
+int pthread_prioq_getmsg(pthread_prioq_t *queue, void *msg, uint32_t *pprio, long timeout);
+
+
+
+/** Same as pthread_prioq_getmsg, with the timeout in nanoseconds.
+ *
+ * @param[in] timeout_ns	PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ns
+ */
+int pthread_prioq_getmsg_ns(pthread_prioq_t *queue, void *msg, uint32_t *pprio, long long timeout_ns);
+
+
+
+/** Same as pthread_prioq_getmsg, waiting until an absolute deadline.
+ *
+ * @param[in] deadline		absolute PTHREAD_EXT_CLOCK time, NULL to wait forever, or
+ *                          PTHREAD_EXT_DEADLINE_NOW not to wait
+ */
+int pthread_prioq_getmsg_until(pthread_prioq_t *queue, void *msg, uint32_t *pprio,
+							   const struct timespec * deadline);
+
+
+
+/** Return number of messages in a queue, at all levels.
+ *
+ * @param[in] queue			pointer to the queue
+ */
+uint32_t pthread_prioq_count(pthread_prioq_t * queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PTHREAD_PRIOQ_H */
@@ -32,207 +32,2064 @@ THE SOFTWARE.
 #include <string.h>
 #include <pthread.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "pthread_queue.h"
 #include "pthread_ext_common.h"
+#include "pthread_ext_wait.h"
+
+/** PTHREAD_QUEUE_PSHARED queue is initialized */
+#define QUEUE_MAGIC		0x51756575u
+
+/** Offset of the buffer in a pthread_queue_create_shared mapping */
+#define QUEUE_SHM_BUFFER	((sizeof(pthread_queue_t) + PTHREAD_EXT_CACHE_LINE - 1) & \
+							 ~(size_t) (PTHREAD_EXT_CACHE_LINE - 1))
+
+/** One thread's shard of the statistics of a PTHREAD_QUEUE_STATS queue */
+typedef struct queue_shard_s {
+	uint64_t		sends;
+	uint64_t		gets;
+	uint64_t		blocked_sends;
+	uint64_t		blocked_gets;
+	uint64_t		timeouts;
+	uint64_t		residency[PTHREAD_EXT_HIST_BUCKETS];
+	uint64_t		wait[PTHREAD_EXT_HIST_BUCKETS];
+} PTHREAD_EXT_CACHE_ALIGNED queue_shard_t;
+
+struct pthread_queue_shards_s {
+	queue_shard_t	shard[PTHREAD_EXT_SHARDS];
+	uint32_t		high_water;	/* most messages in the queue at once */
+	uint64_t		stamps[];	/* send time of the message in each slot (VARLEN: 8 bytes of ring) */
+};
+
+/**************************************************************************************************/
+/* queue_buffer
+ * address of the buffer. It is kept as an offset from the queue, so a queue in shared
+ * memory works wherever each process maps it.
+ */
+static inline char *queue_buffer(const pthread_queue_t *queue)
+{
+	return (char *) queue + queue->buffer;
+}
+
+/**************************************************************************************************/
+/* queue_wrap
+ * buffer index of a slot number up to 2*qsize-1, or with PTHREAD_QUEUE_POW2 of any free
+ * running position.
+ */
+static inline uint32_t queue_wrap(const pthread_queue_t *queue, uint32_t slot)
+{
+	if (queue->flags & PTHREAD_QUEUE_POW2)
+		return slot & queue->mask;
+
+	return (slot >= queue->qsize) ? slot - queue->qsize : slot;
+}
+
+/**************************************************************************************************/
+/* queue_msg
+ * address of the message at buffer index slot.
+ */
+static inline char *queue_msg(const pthread_queue_t *queue, uint32_t slot)
+{
+	if (queue->flags & PTHREAD_QUEUE_POW2)
+		return queue_buffer(queue) + ((size_t) slot << queue->shift);
+
+	return queue_buffer(queue) + (size_t) slot * queue->msg_len;
+}
+
+/**************************************************************************************************/
+/* queue_used
+ * called with the mutex held. Number of messages in the queue. With PTHREAD_QUEUE_POW2, head
+ * and tail run free and there is no separate count to keep up to date.
+ */
+static inline uint32_t queue_used(const pthread_queue_t *queue)
+{
+	if (queue->flags & PTHREAD_QUEUE_POW2)
+		return queue->tail - queue->head;
+
+	return queue->count;
+}
+
+/**************************************************************************************************/
+/* queue_push
+ * called with the mutex held. Add n messages written at the tail to the queue.
+ */
+static inline void queue_push(pthread_queue_t *queue, uint32_t n)
+{
+	if (queue->flags & PTHREAD_QUEUE_POW2)
+		queue->tail += n;
+	else
+	{
+		queue->tail = queue_wrap(queue, queue->tail + n);
+		queue->count += n;
+	}
+}
+
+/**************************************************************************************************/
+/* queue_pop
+ * called with the mutex held. Remove n messages at the head from the queue.
+ */
+static inline void queue_pop(pthread_queue_t *queue, uint32_t n)
+{
+	if (queue->flags & PTHREAD_QUEUE_POW2)
+		queue->head += n;
+	else
+	{
+		queue->head = queue_wrap(queue, queue->head + n);
+		queue->count -= n;
+	}
+	queue->head_seq += n;
+}
+
+/**************************************************************************************************/
+/* varlen_pop
+ * called with the mutex held. Remove the record at the head of a PTHREAD_QUEUE_VARLEN queue.
+ */
+static inline void varlen_pop(pthread_queue_t *queue)
+{
+	uint32_t		rec = PTHREAD_QUEUE_VARLEN_RECORD(*(uint32_t *) (queue_buffer(queue) + queue->head));
+	uint32_t		off = queue->head + rec;
+
+	queue->head = (off >= queue->qsize) ? off - queue->qsize : off;
+	queue->bytes -= rec;
+	queue->count--;
+	queue->head_seq++;
+}
+
+/**************************************************************************************************/
+/* queue_signal_msg
+ * wake consumers after messages were put on the queue, and post the notification
+ * descriptor unless it is posted already.
+ */
+static inline void queue_signal_msg(pthread_queue_t *queue, int nwake)
+{
+	int				efd = __atomic_load_n(&queue->efd, __ATOMIC_RELAXED);
+
+	pthread_ext_waitq_wake(&queue->empty, nwake);
+
+	if ((efd >= 0) && (0 == __atomic_exchange_n(&queue->efd_posted, 1, __ATOMIC_SEQ_CST)))
+		pthread_ext_notify_fd(efd);
+}
+
+/**************************************************************************************************/
+/* queue_stats_sent
+ * STATS: n messages were written from buffer index slot (VARLEN: ring offset / 8), and the
+ * queue now holds used messages. Stamp them with the time and raise the high water mark.
+ */
+static void queue_stats_sent(pthread_queue_t *queue, uint32_t slot, uint32_t n, uint32_t used)
+{
+	struct pthread_queue_shards_s *stats = queue->stats;
+	uint64_t		now = pthread_ext_now_ns();
+	uint32_t		high = __atomic_load_n(&stats->high_water, __ATOMIC_RELAXED);
+	uint32_t		i;
+
+	for (i = 0; i < n; i++)
+		stats->stamps[queue_wrap(queue, slot + i)] = now;
+
+	while ((used > high) &&
+		   !__atomic_compare_exchange_n(&stats->high_water, &high, used, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+
+	__atomic_fetch_add(&stats->shard[pthread_ext_shard()].sends, n, __ATOMIC_RELAXED);
+}
+
+/**************************************************************************************************/
+/* queue_stats_got
+ * STATS: n messages are being taken from buffer index slot (VARLEN: ring offset / 8). Add
+ * the time since each was sent to the residency histogram.
+ */
+static void queue_stats_got(pthread_queue_t *queue, uint32_t slot, uint32_t n)
+{
+	queue_shard_t	*shard = &queue->stats->shard[pthread_ext_shard()];
+	uint64_t		now = pthread_ext_now_ns();
+	uint64_t		sent;
+	uint32_t		i;
+
+	for (i = 0; i < n; i++)
+	{
+		sent = queue->stats->stamps[queue_wrap(queue, slot + i)];
+		__atomic_fetch_add(&shard->residency[pthread_ext_hist_bucket((now > sent) ? now - sent : 0)], 1,
+						   __ATOMIC_RELAXED);
+	}
+
+	__atomic_fetch_add(&shard->gets, n, __ATOMIC_RELAXED);
+}
+
+/**************************************************************************************************/
+/* queue_stats_waited
+ * STATS: a sender (consumer = 0) or receiver (consumer = 1) which started to block at
+ * start (0 if it did not block) is returning result.
+ */
+static void queue_stats_waited(pthread_queue_t *queue, int consumer, uint64_t start, int result)
+{
+	queue_shard_t	*shard = &queue->stats->shard[pthread_ext_shard()];
+
+	if (start)
+	{
+		__atomic_fetch_add(consumer ? &shard->blocked_gets : &shard->blocked_sends, 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&shard->wait[pthread_ext_hist_bucket(pthread_ext_now_ns() - start)], 1,
+						   __ATOMIC_RELAXED);
+	}
+
+	if (ETIMEDOUT == result)
+		__atomic_fetch_add(&shard->timeouts, 1, __ATOMIC_RELAXED);
+}
+
+/**************************************************************************************************/
+/* spsc_wait_space
+ * block the producer of an SPSC queue until there is room or the queue is reset.
+ */
+static int spsc_wait_space(pthread_queue_t *queue, const struct timespec *deadline)
+{
+	uint64_t		start = 0;
+	uint32_t		seq;
+	int				result = ETIMEDOUT;
+
+	if (PTHREAD_EXT_DEADLINE_NOW != deadline)
+	{
+		for (;;)
+		{
+			seq = pthread_ext_waitq_prepare(&queue->full);
+			if ((queue->tail - __atomic_load_n(&queue->head, __ATOMIC_SEQ_CST) != queue->qsize) ||
+				__atomic_load_n(&queue->reset, __ATOMIC_SEQ_CST))
+			{
+				pthread_ext_waitq_cancel(&queue->full);
+				result = 0;
+				break;
+			}
+
+			if (queue->stats && (0 == start))
+				start = pthread_ext_now_ns();
+			result = pthread_ext_waitq_wait(&queue->full, seq, deadline);
+			if (result)
+				break;
+		}
+	}
+
+	if (queue->stats && (start || result))
+		queue_stats_waited(queue, 0, start, result);
+
+	return result;
+}
+
+/**************************************************************************************************/
+/* spsc_wait_msg
+ * block the consumer of an SPSC queue until there is a message.
+ */
+static int spsc_wait_msg(pthread_queue_t *queue, const struct timespec *deadline)
+{
+	uint64_t		start = 0;
+	uint32_t		seq;
+	int				result = ETIMEDOUT;
+
+	if (PTHREAD_EXT_DEADLINE_NOW != deadline)
+	{
+		for (;;)
+		{
+			seq = pthread_ext_waitq_prepare(&queue->empty);
+			if ((int32_t)(__atomic_load_n(&queue->tail, __ATOMIC_SEQ_CST) -
+						  __atomic_load_n(&queue->head, __ATOMIC_SEQ_CST)) > 0)
+			{
+				pthread_ext_waitq_cancel(&queue->empty);
+				result = 0;
+				break;
+			}
+
+			if (queue->stats && (0 == start))
+				start = pthread_ext_now_ns();
+			result = pthread_ext_waitq_wait(&queue->empty, seq, deadline);
+			if (result)
+				break;
+		}
+	}
+
+	if (queue->stats && (start || result))
+		queue_stats_waited(queue, 1, start, result);
+
+	return result;
+}
+
+/**************************************************************************************************/
+/* ring_copy_in
+ * copy n messages into the ring starting at buffer index slot, as at most two runs split at
+ * the wrap point. Returns the buffer index following the last message.
+ */
+static uint32_t ring_copy_in(pthread_queue_t *queue, uint32_t slot, const char *msgs, uint32_t n)
+{
+	size_t			msg_len = queue->msg_len;
+	uint32_t		run = queue->qsize - slot;
+
+	if (run > n)
+		run = n;
+
+	memcpy(queue_msg(queue, slot), msgs, run * msg_len);
+	if (n > run)
+		memcpy(queue_buffer(queue), msgs + run * msg_len, (n - run) * msg_len);
+
+	return queue_wrap(queue, slot + n);
+}
+
+/**************************************************************************************************/
+/* ring_copy_out
+ * copy n messages out of the ring starting at buffer index slot, as at most two runs split
+ * at the wrap point. Returns the buffer index following the last message.
+ */
+static uint32_t ring_copy_out(pthread_queue_t *queue, uint32_t slot, char *msgs, uint32_t n)
+{
+	size_t			msg_len = queue->msg_len;
+	uint32_t		run = queue->qsize - slot;
+
+	if (run > n)
+		run = n;
+
+	memcpy(msgs, queue_msg(queue, slot), run * msg_len);
+	if (n > run)
+		memcpy(msgs + run * msg_len, queue_buffer(queue), (n - run) * msg_len);
+
+	return queue_wrap(queue, slot + n);
+}
+
+/**************************************************************************************************/
+/* ring_write
+ * copy len bytes into a PTHREAD_QUEUE_VARLEN byte ring at offset off, wrapping at the end.
+ */
+static void ring_write(pthread_queue_t *queue, uint32_t off, const char *src, uint32_t len)
+{
+	uint32_t		run = queue->qsize - off;
+
+	if (run > len)
+		run = len;
+
+	memcpy(queue_buffer(queue) + off, src, run);
+	if (len > run)
+		memcpy(queue_buffer(queue), src + run, len - run);
+}
+
+/**************************************************************************************************/
+/* ring_read
+ * copy len bytes out of a PTHREAD_QUEUE_VARLEN byte ring at offset off, wrapping at the end.
+ */
+static void ring_read(pthread_queue_t *queue, uint32_t off, char *dst, uint32_t len)
+{
+	uint32_t		run = queue->qsize - off;
+
+	if (run > len)
+		run = len;
+
+	memcpy(dst, queue_buffer(queue) + off, run);
+	if (len > run)
+		memcpy(dst + run, queue_buffer(queue), len - run);
+}
+
+/**************************************************************************************************/
+/* spsc_tail_slot
+ * buffer index of the producer's next slot in an SPSC queue. With PTHREAD_QUEUE_POW2 it is
+ * worked out from tail, so there is no separate index for a producer which dies part way
+ * through a send to leave out of step.
+ */
+static inline uint32_t spsc_tail_slot(const pthread_queue_t *queue)
+{
+	if (queue->flags & PTHREAD_QUEUE_POW2)
+		return queue->tail & queue->mask;
+
+	return queue->tail_slot;
+}
+
+/**************************************************************************************************/
+/* spsc_head_slot
+ * buffer index of the consumer's next slot in an SPSC queue, see spsc_tail_slot.
+ */
+static inline uint32_t spsc_head_slot(const pthread_queue_t *queue)
+{
+	if (queue->flags & PTHREAD_QUEUE_POW2)
+		return queue->head_last & queue->mask;
+
+	return queue->head_slot;
+}
+
+/**************************************************************************************************/
+/* spsc_overwrite
+ * producer side of a PTHREAD_QUEUE_OVERWRITE SPSC queue: drop the oldest messages until there
+ * is room for want messages, and return the room. head is moved with a compare and swap,
+ * which makes a consumer copying those messages try again; if the consumer (or a reset)
+ * moves head first, that made room, and the loop ends after at most qsize turns.
+ */
+static uint32_t spsc_overwrite(pthread_queue_t *queue, uint32_t want)
+{
+	uint32_t		tail = queue->tail;
+	uint32_t		head = queue->head_cache;
+	uint32_t		space = queue->qsize - (tail - head);
+
+	while (space < want)
+	{
+		if (__atomic_compare_exchange_n(&queue->head, &head, tail + want - queue->qsize, 0,
+										__ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE))
+		{
+			__atomic_fetch_add(&queue->drops, want - space, __ATOMIC_RELAXED);
+			head = tail + want - queue->qsize;
+		}
+		space = queue->qsize - (tail - head);
+	}
+	queue->head_cache = head;
+
+	return space;
+}
+
+/**************************************************************************************************/
+/* spsc_space
+ * producer side of an SPSC queue: wait until there is room for at least one message, and
+ * return in *pspace how many messages fit. Only the producer writes tail, tail_slot and
+ * head_cache, so they need no synchronization. head is re-read only when the cached copy
+ * says there is not enough room for n messages.
+ */
+static int spsc_space(pthread_queue_t *queue, uint32_t n, uint32_t *pspace, const struct timespec *deadline)
+{
+	uint32_t		tail = queue->tail;
+	uint32_t		space = queue->qsize - (tail - queue->head_cache);
+	int				result;
+
+	if (space < n)
+	{
+		queue->head_cache = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+		space = queue->qsize - (tail - queue->head_cache);
+		if ((queue->flags & PTHREAD_QUEUE_OVERWRITE) && (space < n) && (space < queue->qsize))
+			space = spsc_overwrite(queue, (n < queue->qsize) ? n : queue->qsize);
+		else if (0 == space)
+		{
+			result = spsc_wait_space(queue, deadline);
+			if (result)
+				return result;
+			queue->head_cache = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+			space = queue->qsize - (tail - queue->head_cache);
+		}
+	}
+
+	if (__atomic_load_n(&queue->reset, __ATOMIC_RELAXED))
+		return ECANCELED;
+
+	*pspace = space;
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* spsc_publish
+ * make n messages written at tail_slot visible to the consumer.
+ */
+static void spsc_publish(pthread_queue_t *queue, uint32_t n)
+{
+	queue->tail_slot = queue_wrap(queue, queue->tail_slot + n);
+	__atomic_store_n(&queue->tail, queue->tail+n, __ATOMIC_SEQ_CST);
+
+	/* signal waiting consumer */
+	queue_signal_msg(queue, 1);
+}
+
+/**************************************************************************************************/
+/* spsc_avail
+ * consumer side of an SPSC queue: wait until there is at least one message, and return the
+ * current head in *phead and how many messages there are in *pavail. If the queue was reset,
+ * skip head_slot past the discarded messages first.
+ */
+static int spsc_avail(pthread_queue_t *queue, uint32_t n, uint32_t *phead, uint32_t *pavail,
+					  const struct timespec *deadline)
+{
+	uint32_t		head;
+	int				result;
+
+	for (;;)
+	{
+		head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+		if (head != queue->head_last)
+		{
+			/* queue was reset or messages dropped, skip the discarded messages */
+			if (!(queue->flags & PTHREAD_QUEUE_POW2))
+				queue->head_slot = (uint32_t)(((uint64_t)queue->head_slot + (head - queue->head_last)) % queue->qsize);
+			queue->head_seq += head - queue->head_last;
+			queue->head_last = head;
+		}
+
+		if ((int32_t)(queue->tail_cache - head) < (int32_t)n)
+		{
+			queue->tail_cache = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+			if ((int32_t)(queue->tail_cache - head) <= 0)
+			{
+				result = spsc_wait_msg(queue, deadline);
+				if (result)
+					return result;
+				continue;
+			}
+		}
+
+		*phead = head;
+		*pavail = queue->tail_cache - head;
+
+		return 0;
+	}
+}
+
+/**************************************************************************************************/
+/* spsc_consume
+ * remove n messages starting at head. head is advanced with a compare and swap because
+ * pthread_queue_reset may move it forward at any time; if that happened the messages were
+ * discarded and ECANCELED is returned.
+ */
+static int spsc_consume(pthread_queue_t *queue, uint32_t head, uint32_t n)
+{
+	if (!__atomic_compare_exchange_n(&queue->head, &head, head+n, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		return ECANCELED;
+
+	queue->head_slot = queue_wrap(queue, queue->head_slot + n);
+	queue->head_last = head+n;
+	queue->head_seq += n;
+
+	/* signal waiting producer */
+	pthread_ext_waitq_wake(&queue->full, 1);
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* spsc_send
+ * lock-free send of up to n messages for a single producer.
+ */
+static int spsc_send(pthread_queue_t *queue, const char *msgs, uint32_t n, uint32_t *psent,
+					 const struct timespec *deadline)
+{
+	uint32_t		space;
+	int				result;
+
+	result = spsc_space(queue, n, &space, deadline);
+	if (result)
+		return result;
+
+	/* copy messages to queue and publish them */
+	if (n > space)
+		n = space;
+	ring_copy_in(queue, spsc_tail_slot(queue), msgs, n);
+	if (queue->stats)
+		queue_stats_sent(queue, spsc_tail_slot(queue), n,
+						 queue->tail + n - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE));
+	spsc_publish(queue, n);
+	*psent = n;
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* spsc_get
+ * lock-free get of up to n messages for a single consumer. If a reset discards the messages
+ * while they are being copied, try again.
+ */
+static int spsc_get(pthread_queue_t *queue, char *msgs, uint32_t n, uint32_t *pgot, uint64_t *pseq,
+					const struct timespec *deadline)
+{
+	uint32_t		head;
+	uint32_t		avail;
+	int				result;
+
+	if (n > queue->qsize)
+		n = queue->qsize;
+
+	do {
+		result = spsc_avail(queue, n, &head, &avail, deadline);
+		if (result)
+			return result;
+
+		/* copy messages from the queue */
+		if (avail < n)
+			n = avail;
+		ring_copy_out(queue, spsc_head_slot(queue), msgs, n);
+
+		/* read the send times while the producer cannot reuse the slots */
+		if (queue->stats)
+			queue_stats_got(queue, spsc_head_slot(queue), n);
+
+	} while (0 != spsc_consume(queue, head, n));
+
+	*pgot = n;
+	if (pseq)
+		*pseq = queue->head_seq - n;
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* queue_resize
+ * called with the mutex held, for PTHREAD_QUEUE_GROW. Move the messages to a new buffer of
+ * size slots, oldest at buffer index 0. Not while a slot is reserved or peeked at, since
+ * its owner holds a pointer into the ring. Returns nonzero if the ring was resized.
+ */
+static int queue_resize(pthread_queue_t *queue, uint32_t size)
+{
+	uint32_t		used = queue_used(queue);
+	void		  *	buf;
+	size_t			map_len;
+
+	if (queue->reserved || queue->peeked || (size == queue->qsize))
+		return 0;
+
+	if (0 != pthread_ext_alloc(&buf, (size_t) size * queue->msg_len, &queue->alloc, &map_len))
+		return 0;
+
+	ring_copy_out(queue, queue_wrap(queue, queue->head), (char *) buf, used);
+	pthread_ext_free(queue_buffer(queue), queue->buf_map_len);
+	queue->buffer = (char *) buf - (char *) queue;
+	queue->buf_map_len = map_len;
+	queue->qsize = size;
+	queue->mask = size - 1;
+	queue->head = 0;
+	queue->tail = ((queue->flags & PTHREAD_QUEUE_POW2) || (used < size)) ? used : 0;
+
+	return 1;
+}
+
+/**************************************************************************************************/
+/* queue_grow
+ * called with the mutex held, for PTHREAD_QUEUE_GROW. Unless there is room for 'need'
+ * messages already, at least double the ring, up to qmax, and wake blocked senders.
+ * Returns nonzero if the ring grew.
+ */
+static int queue_grow(pthread_queue_t *queue, uint32_t need)
+{
+	uint64_t		want = (uint64_t) queue_used(queue) + need;
+	uint64_t		size = (uint64_t) queue->qsize * 2;
+
+	if ((want <= queue->qsize) || (queue->qsize == queue->qmax))
+		return 0;
+
+	while (size < want)
+		size *= 2;
+	if (size > queue->qmax)
+		size = queue->qmax;
+
+	if (!queue_resize(queue, (uint32_t) size))
+		return 0;
+
+	pthread_ext_waitq_wake(&queue->full, PTHREAD_EXT_WAKE_ALL);
+
+	return 1;
+}
+
+/**************************************************************************************************/
+/* queue_shrink
+ * called with the mutex held, for PTHREAD_QUEUE_GROW. Halve the ring, down to qmin, once it
+ * is at most a quarter full; it is then at most half full, so a shrink is not followed
+ * straight away by a grow.
+ */
+static void queue_shrink(pthread_queue_t *queue)
+{
+	uint32_t		size = queue->qsize / 2;
+
+	if (size < queue->qmin)
+		size = queue->qmin;
+
+	if ((size < queue->qsize) && (queue_used(queue) <= queue->qsize / 4))
+		queue_resize(queue, size);
+}
+
+/**************************************************************************************************/
+/* queue_full
+ * called with the mutex held. Return nonzero if a message needing 'need' slots (or, for
+ * PTHREAD_QUEUE_VARLEN, 'need' bytes of ring) does not fit in the queue.
+ */
+static int queue_full(pthread_queue_t *queue, uint32_t need)
+{
+	if (queue->flags & PTHREAD_QUEUE_VARLEN)
+		return (queue->qsize - queue->bytes < need);
+
+	return (queue->qsize - queue_used(queue) < need);
+}
+
+/**************************************************************************************************/
+/* queue_overwrite
+ * called with the mutex held, for PTHREAD_QUEUE_OVERWRITE. Drop the oldest messages until
+ * there is room for 'need' slots (or bytes, see queue_full).
+ */
+static void queue_overwrite(pthread_queue_t *queue, uint32_t need)
+{
+	uint32_t		n = 0;
+
+	if (queue->flags & PTHREAD_QUEUE_VARLEN)
+	{
+		for (; queue_full(queue, need); n++)
+			varlen_pop(queue);
+	}
+	else if (queue_full(queue, need))
+	{
+		n = need - (queue->qsize - queue_used(queue));
+		queue_pop(queue, n);
+	}
+
+	if (n)
+		__atomic_fetch_add(&queue->drops, n, __ATOMIC_RELAXED);
+}
+
+/**************************************************************************************************/
+/* queue_wait_space
+ * called with the mutex held. Wait until there is room in the queue for 'need' slots (or
+ * bytes, see queue_full) and no other producer has the tail slot reserved, or the queue is
+ * reset. A producer that blocks while the slot is reserved counts itself in
+ * reserve_waiters, so commit knows whom to wake. On error the mutex is still held.
+ */
+static int queue_wait_space(pthread_queue_t *queue, uint32_t need, const struct timespec *deadline)
+{
+	uint64_t		start = 0;
+	uint8_t			on_reserve;
+	int				result = 0;
+
+	/* a lossy ring makes room rather than wait for it */
+	if (queue->flags & PTHREAD_QUEUE_OVERWRITE)
+	{
+		queue_overwrite(queue, need);
+		return 0;
+	}
+
+	/* a growable ring makes room, up to its limit, before it waits for it */
+	if ((queue->flags & PTHREAD_QUEUE_GROW) && queue_full(queue, need))
+		queue_grow(queue, need);
+
+	/* handle nowait and queue is full (or the tail slot is reserved) */
+	if ( (PTHREAD_EXT_DEADLINE_NOW == deadline) && (queue_full(queue, need) || queue->reserved) )
+		result = ETIMEDOUT;
+
+	/* wait while buffer full */
+	else while ((queue_full(queue, need) || queue->reserved) && !queue->reset) {
+
+		if ((queue->flags & PTHREAD_QUEUE_GROW) && queue_grow(queue, need))
+			continue;
+		if (queue->stats && (0 == start))
+			start = pthread_ext_now_ns();
+		on_reserve = queue->reserved;
+		queue->reserve_waiters += on_reserve;
+		result = pthread_ext_waitq_wait_mutex(&queue->full, &queue->mutex, deadline);
+		queue->reserve_waiters -= on_reserve;
+		if (ETIMEDOUT == result)
+			break;
+	}
+
+	if (queue->stats && (start || result))
+		queue_stats_waited(queue, 0, start, result);
+
+	return result;
+}
+
+/**************************************************************************************************/
+/* queue_wait_msg
+ * called with the mutex held. Wait until there is a message in the queue and no other
+ * consumer is peeking at the head slot. A consumer that blocks while the slot is peeked at
+ * counts itself in peek_waiters, so release knows whom to wake. On error the mutex is
+ * still held.
+ */
+static int queue_wait_msg(pthread_queue_t *queue, const struct timespec *deadline)
+{
+	uint64_t		start = 0;
+	uint8_t			on_peek;
+	int				result = 0;
+
+	/* handle nowait and queue is empty (or the head slot is being peeked at) */
+	if ( (PTHREAD_EXT_DEADLINE_NOW == deadline) && ((queue_used(queue) == 0) || queue->peeked) )
+		result = ETIMEDOUT;
+
+	/* wait while there is nothing in the buffer */
+	else while ((queue_used(queue) == 0) || queue->peeked) {
+
+		if (queue->stats && (0 == start))
+			start = pthread_ext_now_ns();
+		on_peek = queue->peeked;
+		queue->peek_waiters += on_peek;
+		result = pthread_ext_waitq_wait_mutex(&queue->empty, &queue->mutex, deadline);
+		queue->peek_waiters -= on_peek;
+		if (ETIMEDOUT == result)
+			break;
+	}
+
+	if (queue->stats && (start || result))
+		queue_stats_waited(queue, 1, start, result);
+
+	return result;
+}
+
+/**************************************************************************************************/
+/* varlen_send
+ * put a message of len bytes on a PTHREAD_QUEUE_VARLEN queue. The record is an 8 byte
+ * header holding the length, followed by the message padded to 8 bytes. Records start on
+ * 8 byte offsets and the ring is a multiple of 8 bytes, so only the message part can wrap.
+ */
+static int varlen_send(pthread_queue_t *queue, void *msg, uint32_t len, const struct timespec *deadline)
+{
+	uint32_t		rec = PTHREAD_QUEUE_VARLEN_RECORD(len);
+	uint32_t		off;
+	int				result;
+
+	if (len > queue->msg_len)
+		return EMSGSIZE;
+
+	pthread_ext_mutex_lock(&queue->mutex);
+
+	result = queue_wait_space(queue, rec, deadline);
+	if ( (0 == result) && queue->reset )
+		result = ECANCELED;
+
+	if (0 == result)
+	{
+		/* write header and message */
+		*(uint32_t *) (queue_buffer(queue) + queue->tail) = len;
+		off = queue->tail + 8;
+		ring_write(queue, (off == queue->qsize) ? 0 : off, msg, len);
+
+		if (queue->stats)
+			queue_stats_sent(queue, queue->tail >> 3, 1, queue->count + 1);
+
+		off = queue->tail + rec;
+		queue->tail = (off >= queue->qsize) ? off - queue->qsize : off;
+		queue->bytes += rec;
+		queue->count += 1;
+	}
+
+	/* signal waiting consumer */
+	pthread_mutex_unlock(&queue->mutex);
+	if (0 == result)
+		queue_signal_msg(queue, 1);
+
+	return result;
+}
+
+/**************************************************************************************************/
+/* varlen_get
+ * get the oldest message from a PTHREAD_QUEUE_VARLEN queue into a buffer of buf_len bytes.
+ * If the message does not fit, it is left on the queue and EMSGSIZE returned.
+ */
+static int varlen_get(pthread_queue_t *queue, void *msg, uint32_t buf_len, uint32_t *plen, uint64_t *pseq,
+					  const struct timespec *deadline)
+{
+	uint32_t		len;
+	uint32_t		off;
+	int				result;
+
+	pthread_ext_mutex_lock(&queue->mutex);
+
+	result = queue_wait_msg(queue, deadline);
+	if (result)
+	{
+		pthread_mutex_unlock(&queue->mutex);
+		return result;
+	}
+
+	len = *(uint32_t *) (queue_buffer(queue) + queue->head);
+	*plen = len;
+	if (len > buf_len)
+	{
+		pthread_mutex_unlock(&queue->mutex);
+		return EMSGSIZE;
+	}
+
+	/* copy message from the queue */
+	off = queue->head + 8;
+	ring_read(queue, (off == queue->qsize) ? 0 : off, msg, len);
+
+	if (queue->stats)
+		queue_stats_got(queue, queue->head >> 3, 1);
+	if (pseq)
+		*pseq = queue->head_seq;
+	varlen_pop(queue);
+
+	/* signal waiting producers, any of them may fit now */
+	pthread_mutex_unlock(&queue->mutex);
+	pthread_ext_waitq_wake(&queue->full, PTHREAD_EXT_WAKE_ALL);
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* pthread_queue_attr_init
+ * default attributes.
+ */
+int pthread_queue_attr_init(pthread_queue_attr_t * attr)
+{
+	attr->flags = 0;
+	pthread_ext_wait_policy_init(&attr->wait);
+	pthread_ext_alloc_attr_init(&attr->alloc);
+	attr->grow_max = 0;
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* pthread_queue_create
+ * create and initialize a new queue.
+ */
+int pthread_queue_create(pthread_queue_t ** ppqueue, void * qstart, uint32_t num_msg, uint32_t msg_len_bytes)
+{
+	return pthread_queue_create_ex(ppqueue, qstart, num_msg, msg_len_bytes, NULL);
+}
+
+/**************************************************************************************************/
+/* pthread_queue_create_ex
+ * create and initialize a new queue with mode and wait policy attributes.
+ */
+int pthread_queue_create_ex(pthread_queue_t ** ppqueue, void * qstart, uint32_t num_msg,
+							uint32_t msg_len_bytes, const pthread_queue_attr_t * attr)
+{
+	pthread_queue_t * queue;
+	pthread_mutexattr_t	mattr;
+	struct pthread_queue_shards_s *stats = NULL;
+	uint32_t		flags = attr ? attr->flags : 0;
+	size_t			buf_len = (size_t) num_msg * msg_len_bytes;
+	size_t			buf_map_len = 0;
+	int				result;
+
+	if (flags & ~(PTHREAD_QUEUE_SPSC | PTHREAD_QUEUE_VARLEN | PTHREAD_QUEUE_POW2 | PTHREAD_QUEUE_PSHARED |
+				  PTHREAD_QUEUE_STATS | PTHREAD_QUEUE_OVERWRITE | PTHREAD_QUEUE_GROW))
+		return EINVAL;
+
+	/* head and tail sit on cache lines of their own */
+	if ((NULL != *ppqueue) && ((uintptr_t) *ppqueue & (PTHREAD_EXT_CACHE_LINE - 1)))
+		return EINVAL;
+
+	/* a growable ring is a plain ring moved to buffers of the queue's own, under the mutex */
+	if ((flags & PTHREAD_QUEUE_GROW) &&
+		((flags & (PTHREAD_QUEUE_SPSC | PTHREAD_QUEUE_VARLEN | PTHREAD_QUEUE_PSHARED | PTHREAD_QUEUE_STATS |
+				   PTHREAD_QUEUE_OVERWRITE)) ||
+		 (NULL != *ppqueue) || (0 == num_msg) || (attr->grow_max < num_msg) || (attr->grow_max > (1u << 31)) ||
+		 ((flags & PTHREAD_QUEUE_POW2) && (attr->grow_max & (attr->grow_max - 1)))))
+		return EINVAL;
+
+	/* shared queues must stay consistent when a process dies part way through a change;
+	 * statistics live in process memory */
+	if ((flags & PTHREAD_QUEUE_PSHARED) && (!(flags & PTHREAD_QUEUE_POW2) || (flags & PTHREAD_QUEUE_STATS)))
+		return EINVAL;
+
+	if (attr && ((unsigned) attr->wait.mode > PTHREAD_EXT_WAIT_ADAPTIVE))
+		return EINVAL;
+
+	/* placement only applies to a buffer the queue allocates */
+	if (attr && attr->alloc.flags && (NULL != *ppqueue))
+		return EINVAL;
+
+	/* SPSC compares free running counters as signed distances */
+	if ((flags & PTHREAD_QUEUE_SPSC) && ((0 == num_msg) || (num_msg > INT32_MAX)))
+		return EINVAL;
+
+	/* mask and shift indexing, free running counters compared as signed distances */
+	if ((flags & PTHREAD_QUEUE_POW2) &&
+		((flags & PTHREAD_QUEUE_VARLEN) || (0 == num_msg) || (num_msg & (num_msg - 1)) ||
+		 (num_msg > (1u << 31)) || (0 == msg_len_bytes) || (msg_len_bytes & (msg_len_bytes - 1))))
+		return EINVAL;
+
+	/* byte ring must hold at least one largest message, and keep records 8 byte aligned */
+	if (flags & PTHREAD_QUEUE_VARLEN)
+	{
+		if ((flags & PTHREAD_QUEUE_SPSC) || (num_msg & 7) ||
+			(msg_len_bytes > UINT32_MAX - 16) || (num_msg < PTHREAD_QUEUE_VARLEN_RECORD(msg_len_bytes)))
+			return EINVAL;
+		buf_len = num_msg;
+	}
+
+	/* zeroed counters, and a send time for each slot (VARLEN: each record offset) */
+	if (flags & PTHREAD_QUEUE_STATS)
+	{
+		if (0 != posix_memalign((void **) &stats, PTHREAD_EXT_CACHE_LINE, sizeof(*stats) + sizeof(uint64_t) *
+								((flags & PTHREAD_QUEUE_VARLEN) ? num_msg / 8 : (size_t) num_msg)))
+			return ENOMEM;
+		memset(stats, 0, sizeof(*stats));
+	}
+
+	if (NULL == *ppqueue)
+	{
+		if (0 != posix_memalign((void **) &queue, PTHREAD_EXT_CACHE_LINE, sizeof(pthread_queue_t)))
+		{
+			free(stats);
+			return ENOMEM;
+		}
+	
+		result = pthread_ext_alloc(&qstart, buf_len, attr ? &attr->alloc : NULL, &buf_map_len);
+		if (result)
+		{
+			free(queue);
+			free(stats);
+			return result;
+		}
+		queue->buffer = (char *) qstart - (char *) queue;
+
+		*ppqueue = queue;
+		queue->destroyFree = 1;
+	}
+	else
+	{
+		queue = *ppqueue;
+		if (NULL == qstart)
+		{
+			free(stats);
+			return ENOMEM;
+		}
+		queue->buffer = (char *) qstart - (char *) queue;
+		queue->destroyFree = 0;
+	}
+
+	pthread_mutexattr_init(&mattr);
+	if (flags & PTHREAD_QUEUE_PSHARED)
+	{
+		pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+#if defined(__linux__)
+		pthread_mutexattr_setrobust(&mattr, PTHREAD_MUTEX_ROBUST);
+#endif
+	}
+	pthread_mutex_init(&queue->mutex, &mattr);
+	pthread_mutexattr_destroy(&mattr);
+	pthread_ext_waitq_init_pshared(&queue->full, flags & PTHREAD_QUEUE_PSHARED);
+	pthread_ext_waitq_init_pshared(&queue->empty, flags & PTHREAD_QUEUE_PSHARED);
+	pthread_ext_waitq_set_policy(&queue->full, attr ? &attr->wait : NULL);
+	pthread_ext_waitq_set_policy(&queue->empty, attr ? &attr->wait : NULL);
+	queue->head = 0;
+	queue->tail = 0;
+	queue->count = 0;
+	queue->bytes = 0;
+	queue->qsize = num_msg;
+	queue->msg_len = msg_len_bytes;
+	queue->flags = flags;
+	queue->mask = num_msg - 1;
+	queue->shift = (flags & PTHREAD_QUEUE_POW2) ? (uint8_t) __builtin_ctz(msg_len_bytes) : 0;
+	queue->head_slot = 0;
+	queue->head_last = 0;
+	queue->tail_cache = 0;
+	queue->tail_slot = 0;
+	queue->head_cache = 0;
+	queue->resets = 0;
+	queue->reserve_gen = 0;
+	queue->peek_gen = 0;
+	queue->reserved = 0;
+	queue->peeked = 0;
+	queue->reserve_waiters = 0;
+	queue->peek_waiters = 0;
+	queue->peek_watches = 0;
+	queue->head_seq = 0;
+	queue->drops = 0;
+	queue->reset = 0;
+	queue->efd = -1;
+	queue->efd_posted = 0;
+	queue->magic = 0;
+	queue->map_len = 0;
+	queue->buf_map_len = buf_map_len;
+	queue->qmin = num_msg;
+	queue->qmax = (flags & PTHREAD_QUEUE_GROW) ? attr->grow_max : num_msg;
+	if (attr)
+		queue->alloc = attr->alloc;
+	else
+		pthread_ext_alloc_attr_init(&queue->alloc);
+	queue->stats = stats;
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* pthread_queue_destroy
+ * free a queue.
+ */
+void pthread_queue_destroy(pthread_queue_t *queue)
+{
+	pthread_mutex_destroy(&queue->mutex);
+	pthread_ext_waitq_destroy(&queue->full);
+	pthread_ext_waitq_destroy(&queue->empty);
+	free(queue->stats);
+	if (queue->destroyFree)
+	{
+		pthread_ext_free(queue_buffer(queue), queue->buf_map_len);
+		free(queue);
+	}
+	else if (queue->map_len)
+		munmap(queue, queue->map_len);
+
+} /* pthread_queue_destroy */
+
+
+/**************************************************************************************************/
+/* pthread_queue_create_shared
+ * create a queue and its buffer in a new POSIX shared memory object.
+ */
+int pthread_queue_create_shared(pthread_queue_t ** ppqueue, const char * name, uint32_t num_msg,
+								uint32_t msg_len_bytes, const pthread_queue_attr_t * attr)
+{
+	pthread_queue_attr_t	qattr;
+	pthread_queue_t * queue;
+	size_t			len = QUEUE_SHM_BUFFER + (size_t) num_msg * msg_len_bytes;
+	int				fd;
+	int				result;
+
+	if (attr)
+		qattr = *attr;
+	else
+		pthread_queue_attr_init(&qattr);
+	qattr.flags |= PTHREAD_QUEUE_PSHARED;
+
+	fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (-1 == fd)
+		return errno;
+
+	if (0 != ftruncate(fd, (off_t) len))
+	{
+		result = errno;
+		close(fd);
+		shm_unlink(name);
+		return result;
+	}
+
+	queue = (pthread_queue_t *) mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	result = errno;
+	close(fd);
+	if (MAP_FAILED == queue)
+	{
+		shm_unlink(name);
+		return result;
+	}
+
+	result = pthread_queue_create_ex(&queue, (char *) queue + QUEUE_SHM_BUFFER, num_msg, msg_len_bytes, &qattr);
+	if (result)
+	{
+		munmap(queue, len);
+		shm_unlink(name);
+		return result;
+	}
+
+	/* attach only succeeds once the queue is complete */
+	queue->map_len = len;
+	__atomic_store_n(&queue->magic, QUEUE_MAGIC, __ATOMIC_RELEASE);
+
+	*ppqueue = queue;
+
+	return 0;
+
+} /* pthread_queue_create_shared */
+
+
+/**************************************************************************************************/
+/* pthread_queue_attach
+ * map a queue created by pthread_queue_create_shared.
+ */
+int pthread_queue_attach(pthread_queue_t ** ppqueue, const char * name)
+{
+	pthread_queue_t * queue;
+	struct stat		st;
+	int				fd;
+	int				result;
+
+	fd = shm_open(name, O_RDWR, 0);
+	if (-1 == fd)
+		return errno;
+
+	if (0 != fstat(fd, &st))
+	{
+		result = errno;
+		close(fd);
+		return result;
+	}
+
+	/* creator has not sized the object yet */
+	if ((size_t) st.st_size < QUEUE_SHM_BUFFER)
+	{
+		close(fd);
+		return EAGAIN;
+	}
+
+	queue = (pthread_queue_t *) mmap(NULL, (size_t) st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	result = errno;
+	close(fd);
+	if (MAP_FAILED == queue)
+		return result;
+
+	if ((QUEUE_MAGIC != __atomic_load_n(&queue->magic, __ATOMIC_ACQUIRE)) ||
+		(queue->map_len != (uint64_t) st.st_size))
+	{
+		munmap(queue, (size_t) st.st_size);
+		return EAGAIN;
+	}
+
+	*ppqueue = queue;
+
+	return 0;
+
+} /* pthread_queue_attach */
+
+
+/**************************************************************************************************/
+/* pthread_queue_detach
+ * unmap a queue mapped by pthread_queue_attach.
+ */
+void pthread_queue_detach(pthread_queue_t *queue)
+{
+	munmap(queue, queue->map_len);
+
+} /* pthread_queue_detach */
+
+
+/**************************************************************************************************/
+/* pthread_queue_unlink
+ * remove the name of a shared queue.
+ */
+int pthread_queue_unlink(const char * name)
+{
+	return (0 == shm_unlink(name)) ? 0 : errno;
+
+} /* pthread_queue_unlink */
+
+
+/**************************************************************************************************/
+/* pthread_queue_sendmsg
+ * puts new message on the queue.
+ * timeout is PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * If timeout == PTHREAD_WAIT and the queue is full, function waits until there is room.
+ * If blocked on full queue, function wakes up if queue is reset, and returns ECANCELED.
+ */
+int pthread_queue_sendmsg(pthread_queue_t *queue, void *msg, long timeout)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout) && (timeout < 0) )
+		return EINVAL;
+
+	return pthread_queue_sendmsg_until(queue, msg, pthread_ext_deadline_ms(timeout, &abstime));
+
+} /* pthread_queue_sendmsg */
+
+
+/**************************************************************************************************/
+/* pthread_queue_sendmsg_ns
+ * as pthread_queue_sendmsg, with the timeout in nanoseconds.
+ */
+int pthread_queue_sendmsg_ns(pthread_queue_t *queue, void *msg, long long timeout_ns)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0) )
+		return EINVAL;
+
+	return pthread_queue_sendmsg_until(queue, msg, pthread_ext_deadline_ns(timeout_ns, &abstime));
+
+} /* pthread_queue_sendmsg_ns */
+
+
+/**************************************************************************************************/
+/* pthread_queue_sendmsg_until
+ * as pthread_queue_sendmsg, waiting until an absolute PTHREAD_EXT_CLOCK deadline.
+ */
+int pthread_queue_sendmsg_until(pthread_queue_t *queue, void *msg, const struct timespec *deadline)
+{
+	uint32_t		sent;
+	int				result;
+
+	if (queue->flags & PTHREAD_QUEUE_SPSC)
+		return spsc_send(queue, msg, 1, &sent, deadline);
+
+	if (queue->flags & PTHREAD_QUEUE_VARLEN)
+		return varlen_send(queue, msg, queue->msg_len, deadline);
+
+	pthread_ext_mutex_lock(&queue->mutex);
+
+	result = queue_wait_space(queue, 1, deadline);
+	if ( (0 == result) && queue->reset )
+		result = ECANCELED;
+
+	if (0 == result)
+	{
+		/* copy message to queue */
+		memcpy(queue_msg(queue, queue_wrap(queue, queue->tail)), msg, queue->msg_len);
+		if (queue->stats)
+			queue_stats_sent(queue, queue_wrap(queue, queue->tail), 1, queue_used(queue) + 1);
+		queue_push(queue, 1);
+	}
+
+	/* signal waiting consumer */
+	pthread_mutex_unlock(&queue->mutex);
+	if (0 == result)
+		queue_signal_msg(queue, 1);
+
+	return result;
+
+} /* pthread_queue_sendmsg_until */
+
+
+/**************************************************************************************************/
+/* pthread_queue_sendmsgs
+ * puts up to num_msgs new messages on the queue in one critical section.
+ * Waits like pthread_queue_sendmsg until there is room for at least one message.
+ */
+int pthread_queue_sendmsgs(pthread_queue_t *queue, void *msgs, uint32_t num_msgs, uint32_t *psent, long timeout)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout) && (timeout < 0) )
+		return EINVAL;
+
+	return pthread_queue_sendmsgs_until(queue, msgs, num_msgs, psent, pthread_ext_deadline_ms(timeout, &abstime));
+
+} /* pthread_queue_sendmsgs */
+
+
+/**************************************************************************************************/
+/* pthread_queue_sendmsgs_ns
+ * as pthread_queue_sendmsgs, with the timeout in nanoseconds.
+ */
+int pthread_queue_sendmsgs_ns(pthread_queue_t *queue, void *msgs, uint32_t num_msgs, uint32_t *psent,
+							  long long timeout_ns)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0) )
+		return EINVAL;
+
+	return pthread_queue_sendmsgs_until(queue, msgs, num_msgs, psent, pthread_ext_deadline_ns(timeout_ns, &abstime));
+
+} /* pthread_queue_sendmsgs_ns */
+
+
+/**************************************************************************************************/
+/* pthread_queue_sendmsgs_until
+ * as pthread_queue_sendmsgs, waiting until an absolute PTHREAD_EXT_CLOCK deadline.
+ */
+int pthread_queue_sendmsgs_until(pthread_queue_t *queue, void *msgs, uint32_t num_msgs, uint32_t *psent,
+								 const struct timespec *deadline)
+{
+	uint32_t		need = 1;
+	uint32_t		n = 0;
+	int				result;
+
+	*psent = 0;
+
+	if ( (0 == num_msgs) || (queue->flags & PTHREAD_QUEUE_VARLEN) )
+		return EINVAL;
+
+	if (queue->flags & PTHREAD_QUEUE_SPSC)
+		return spsc_send(queue, msgs, num_msgs, psent, deadline);
+
+	pthread_ext_mutex_lock(&queue->mutex);
+
+	/* a lossy ring drops enough for the whole batch, or the whole ring; a growable one
+	 * tries to make room for the whole batch */
+	if (queue->flags & PTHREAD_QUEUE_OVERWRITE)
+		need = (num_msgs < queue->qsize) ? num_msgs : queue->qsize;
+	else if (queue->flags & PTHREAD_QUEUE_GROW)
+		queue_grow(queue, num_msgs);
+	result = queue_wait_space(queue, need, deadline);
+	if ( (0 == result) && queue->reset )
+		result = ECANCELED;
+
+	if (0 == result)
+	{
+		/* copy as many messages as fit */
+		n = queue->qsize - queue_used(queue);
+		if (n > num_msgs)
+			n = num_msgs;
+		ring_copy_in(queue, queue_wrap(queue, queue->tail), msgs, n);
+		if (queue->stats)
+			queue_stats_sent(queue, queue_wrap(queue, queue->tail), n, queue_used(queue) + n);
+		queue_push(queue, n);
+	}
+
+	/* one wakeup for the whole batch, of a consumer per message */
+	pthread_mutex_unlock(&queue->mutex);
+	if (n)
+		queue_signal_msg(queue, (int) n);
+
+	*psent = n;
+
+	return result;
+
+} /* pthread_queue_sendmsgs_until */
+
+
+/**************************************************************************************************/
+/* pthread_queue_getmsg
+ * gets the oldest message in the queue.
+ * timeout is PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * If timeout == PTHREAD_WAIT and the queue is full, function waits until there is room.
+ */
+
+int pthread_queue_getmsg(pthread_queue_t *queue, void *msg, long timeout)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout) && (timeout < 0) )
+		return EINVAL;
+
+	return pthread_queue_getmsg_until(queue, msg, pthread_ext_deadline_ms(timeout, &abstime));
+
+} /* pthread_queue_getmsg */
+
+
+/**************************************************************************************************/
+/* pthread_queue_getmsg_ns
+ * as pthread_queue_getmsg, with the timeout in nanoseconds.
+ */
+int pthread_queue_getmsg_ns(pthread_queue_t *queue, void *msg, long long timeout_ns)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0) )
+		return EINVAL;
+
+	return pthread_queue_getmsg_until(queue, msg, pthread_ext_deadline_ns(timeout_ns, &abstime));
+
+} /* pthread_queue_getmsg_ns */
+
+
+/**************************************************************************************************/
+/* pthread_queue_getmsg_until
+ * as pthread_queue_getmsg, waiting until an absolute PTHREAD_EXT_CLOCK deadline.
+ */
+int pthread_queue_getmsg_until(pthread_queue_t *queue, void *msg, const struct timespec *deadline)
+{
+	return pthread_queue_getmsg_seq_until(queue, msg, NULL, deadline);
+
+} /* pthread_queue_getmsg_until */
+
+
+/**************************************************************************************************/
+/* pthread_queue_getmsg_seq
+ * gets the oldest message in the queue and its sequence number.
+ */
+int pthread_queue_getmsg_seq(pthread_queue_t *queue, void *msg, uint64_t *pseq, long timeout)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout) && (timeout < 0) )
+		return EINVAL;
+
+	return pthread_queue_getmsg_seq_until(queue, msg, pseq, pthread_ext_deadline_ms(timeout, &abstime));
+
+} /* pthread_queue_getmsg_seq */
+
+
+/**************************************************************************************************/
+/* pthread_queue_getmsg_seq_ns
+ * as pthread_queue_getmsg_seq, with the timeout in nanoseconds.
+ */
+int pthread_queue_getmsg_seq_ns(pthread_queue_t *queue, void *msg, uint64_t *pseq, long long timeout_ns)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0) )
+		return EINVAL;
+
+	return pthread_queue_getmsg_seq_until(queue, msg, pseq, pthread_ext_deadline_ns(timeout_ns, &abstime));
+
+} /* pthread_queue_getmsg_seq_ns */
+
+
+/**************************************************************************************************/
+/* pthread_queue_getmsg_seq_until
+ * as pthread_queue_getmsg_seq, waiting until an absolute PTHREAD_EXT_CLOCK deadline. pseq
+ * may be NULL.
+ */
+int pthread_queue_getmsg_seq_until(pthread_queue_t *queue, void *msg, uint64_t *pseq,
+								   const struct timespec *deadline)
+{
+	uint32_t		got;
+	int				result;
+
+	if (queue->flags & PTHREAD_QUEUE_SPSC)
+		return spsc_get(queue, msg, 1, &got, pseq, deadline);
+
+	if (queue->flags & PTHREAD_QUEUE_VARLEN)
+		return varlen_get(queue, msg, queue->msg_len, &got, pseq, deadline);
+
+	pthread_ext_mutex_lock(&queue->mutex);
+
+	result = queue_wait_msg(queue, deadline);
+	if (result)
+	{
+		pthread_mutex_unlock(&queue->mutex);
+		return result;
+	}
+
+	/* copy message from the queue */
+	memcpy(msg, queue_msg(queue, queue_wrap(queue, queue->head)), queue->msg_len);
+	if (queue->stats)
+		queue_stats_got(queue, queue_wrap(queue, queue->head), 1);
+	if (pseq)
+		*pseq = queue->head_seq;
+	queue_pop(queue, 1);
+	if (queue->flags & PTHREAD_QUEUE_GROW)
+		queue_shrink(queue);
+
+	/* signal waiting producer */
+	pthread_mutex_unlock(&queue->mutex);
+	pthread_ext_waitq_wake(&queue->full, 1);
+
+	return (0);
+
+} /* pthread_queue_getmsg_seq_until */
+
+
+/**************************************************************************************************/
+/* pthread_queue_getmsgs
+ * gets at least one and up to max_msgs of the oldest messages in the queue in one critical
+ * section. Waits like pthread_queue_getmsg until there is at least one message.
+ */
+int pthread_queue_getmsgs(pthread_queue_t *queue, void *msgs, uint32_t max_msgs, uint32_t *pgot, long timeout)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout) && (timeout < 0) )
+		return EINVAL;
+
+	return pthread_queue_getmsgs_until(queue, msgs, max_msgs, pgot, pthread_ext_deadline_ms(timeout, &abstime));
+
+} /* pthread_queue_getmsgs */
+
+
+/**************************************************************************************************/
+/* pthread_queue_getmsgs_ns
+ * as pthread_queue_getmsgs, with the timeout in nanoseconds.
+ */
+int pthread_queue_getmsgs_ns(pthread_queue_t *queue, void *msgs, uint32_t max_msgs, uint32_t *pgot,
+							 long long timeout_ns)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0) )
+		return EINVAL;
+
+	return pthread_queue_getmsgs_until(queue, msgs, max_msgs, pgot, pthread_ext_deadline_ns(timeout_ns, &abstime));
+
+} /* pthread_queue_getmsgs_ns */
+
+
+/**************************************************************************************************/
+/* pthread_queue_getmsgs_until
+ * as pthread_queue_getmsgs, waiting until an absolute PTHREAD_EXT_CLOCK deadline.
+ */
+int pthread_queue_getmsgs_until(pthread_queue_t *queue, void *msgs, uint32_t max_msgs, uint32_t *pgot,
+								const struct timespec *deadline)
+{
+	uint32_t		n;
+	int				result;
+
+	*pgot = 0;
+
+	if ( (0 == max_msgs) || (queue->flags & PTHREAD_QUEUE_VARLEN) )
+		return EINVAL;
+
+	if (queue->flags & PTHREAD_QUEUE_SPSC)
+		return spsc_get(queue, msgs, max_msgs, pgot, NULL, deadline);
+
+	pthread_ext_mutex_lock(&queue->mutex);
+
+	result = queue_wait_msg(queue, deadline);
+	if (result)
+	{
+		pthread_mutex_unlock(&queue->mutex);
+		return result;
+	}
+
+	/* copy whatever is there, up to max_msgs */
+	n = queue_used(queue);
+	if (n > max_msgs)
+		n = max_msgs;
+	ring_copy_out(queue, queue_wrap(queue, queue->head), msgs, n);
+	if (queue->stats)
+		queue_stats_got(queue, queue_wrap(queue, queue->head), n);
+	queue_pop(queue, n);
+	if (queue->flags & PTHREAD_QUEUE_GROW)
+		queue_shrink(queue);
+
+	/* one wakeup for the whole batch */
+	pthread_mutex_unlock(&queue->mutex);
+	if (1 == n)
+		pthread_ext_waitq_wake(&queue->full, 1);
+	else
+		pthread_ext_waitq_wake(&queue->full, PTHREAD_EXT_WAKE_ALL);
+
+	*pgot = n;
+
+	return (0);
+
+} /* pthread_queue_getmsgs_until */
+
+/**************************************************************************************************/
+/* pthread_queue_sendmsg_len
+ * puts a new message of len bytes on a PTHREAD_QUEUE_VARLEN queue.
+ */
+int pthread_queue_sendmsg_len(pthread_queue_t *queue, void *msg, uint32_t len, long timeout)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout) && (timeout < 0) )
+		return EINVAL;
+
+	return pthread_queue_sendmsg_len_until(queue, msg, len, pthread_ext_deadline_ms(timeout, &abstime));
+
+} /* pthread_queue_sendmsg_len */
+
+
+/**************************************************************************************************/
+/* pthread_queue_sendmsg_len_ns
+ * as pthread_queue_sendmsg_len, with the timeout in nanoseconds.
+ */
+int pthread_queue_sendmsg_len_ns(pthread_queue_t *queue, void *msg, uint32_t len, long long timeout_ns)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0) )
+		return EINVAL;
+
+	return pthread_queue_sendmsg_len_until(queue, msg, len, pthread_ext_deadline_ns(timeout_ns, &abstime));
+
+} /* pthread_queue_sendmsg_len_ns */
+
+
+/**************************************************************************************************/
+/* pthread_queue_sendmsg_len_until
+ * as pthread_queue_sendmsg_len, waiting until an absolute PTHREAD_EXT_CLOCK deadline.
+ */
+int pthread_queue_sendmsg_len_until(pthread_queue_t *queue, void *msg, uint32_t len,
+									const struct timespec *deadline)
+{
+	if (!(queue->flags & PTHREAD_QUEUE_VARLEN))
+		return EINVAL;
+
+	return varlen_send(queue, msg, len, deadline);
+
+} /* pthread_queue_sendmsg_len_until */
+
+
+/**************************************************************************************************/
+/* pthread_queue_getmsg_len
+ * gets the oldest message from a PTHREAD_QUEUE_VARLEN queue, and its length.
+ */
+int pthread_queue_getmsg_len(pthread_queue_t *queue, void *msg, uint32_t buf_len, uint32_t *plen, long timeout)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout) && (timeout < 0) )
+		return EINVAL;
+
+	return pthread_queue_getmsg_len_until(queue, msg, buf_len, plen, pthread_ext_deadline_ms(timeout, &abstime));
+
+} /* pthread_queue_getmsg_len */
+
+
+/**************************************************************************************************/
+/* pthread_queue_getmsg_len_ns
+ * as pthread_queue_getmsg_len, with the timeout in nanoseconds.
+ */
+int pthread_queue_getmsg_len_ns(pthread_queue_t *queue, void *msg, uint32_t buf_len, uint32_t *plen,
+								long long timeout_ns)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0) )
+		return EINVAL;
+
+	return pthread_queue_getmsg_len_until(queue, msg, buf_len, plen, pthread_ext_deadline_ns(timeout_ns, &abstime));
+
+} /* pthread_queue_getmsg_len_ns */
+
+
+/**************************************************************************************************/
+/* pthread_queue_getmsg_len_until
+ * as pthread_queue_getmsg_len, waiting until an absolute PTHREAD_EXT_CLOCK deadline.
+ */
+int pthread_queue_getmsg_len_until(pthread_queue_t *queue, void *msg, uint32_t buf_len, uint32_t *plen,
+								   const struct timespec *deadline)
+{
+	if (!(queue->flags & PTHREAD_QUEUE_VARLEN))
+		return EINVAL;
+
+	return varlen_get(queue, msg, buf_len, plen, NULL, deadline);
+
+} /* pthread_queue_getmsg_len_until */
+
 
 /**************************************************************************************************/
-static void cleanup_handler(void *arg)
+/* pthread_queue_reserve
+ * reserve the slot at the tail of the queue for the caller to fill in place.
+ * Waits like pthread_queue_sendmsg.
+ */
+int pthread_queue_reserve(pthread_queue_t *queue, void **pmsg, long timeout)
 {
-	pthread_mutex_unlock((pthread_mutex_t*)arg);
-}
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout) && (timeout < 0) )
+		return EINVAL;
+
+	return pthread_queue_reserve_until(queue, pmsg, pthread_ext_deadline_ms(timeout, &abstime));
+
+} /* pthread_queue_reserve */
+
 
 /**************************************************************************************************/
-/* pthread_queue_create
- * create and initialize a new queue.
+/* pthread_queue_reserve_ns
+ * as pthread_queue_reserve, with the timeout in nanoseconds.
  */
-int pthread_queue_create(pthread_queue_t ** ppqueue, void * qstart, uint32_t num_msg, uint32_t msg_len_bytes)
+int pthread_queue_reserve_ns(pthread_queue_t *queue, void **pmsg, long long timeout_ns)
 {
-	pthread_queue_t * queue;
+	struct timespec abstime;
 
-	if (NULL == *ppqueue)
+	if ( (PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0) )
+		return EINVAL;
+
+	return pthread_queue_reserve_until(queue, pmsg, pthread_ext_deadline_ns(timeout_ns, &abstime));
+
+} /* pthread_queue_reserve_ns */
+
+
+/**************************************************************************************************/
+/* pthread_queue_reserve_until
+ * as pthread_queue_reserve, waiting until an absolute PTHREAD_EXT_CLOCK deadline.
+ */
+int pthread_queue_reserve_until(pthread_queue_t *queue, void **pmsg, const struct timespec *deadline)
+{
+	uint32_t		space;
+	int				result;
+
+	if (queue->flags & (PTHREAD_QUEUE_VARLEN | PTHREAD_QUEUE_OVERWRITE))
+		return EINVAL;
+
+	if (queue->flags & PTHREAD_QUEUE_SPSC)
 	{
-		queue = (pthread_queue_t *) malloc(sizeof(pthread_queue_t));
-		if (NULL == queue)
-			return ENOMEM;
-	
-		queue->buffer = (char *) malloc(num_msg * msg_len_bytes);
-		if (NULL == queue->buffer)
+		result = spsc_space(queue, 1, &space, deadline);
+		if (0 == result)
 		{
-			free(queue);
-			return ENOMEM;
+			*pmsg = queue_msg(queue, spsc_tail_slot(queue));
+			queue->reserved = 1;
 		}
+		return result;
+	}
 
-		*ppqueue = queue;
-		queue->destroyFree = 1;
+	pthread_ext_mutex_lock(&queue->mutex);
+
+	result = queue_wait_space(queue, 1, deadline);
+	if ( (0 == result) && queue->reset )
+		result = ECANCELED;
+
+	if (0 == result)
+	{
+		/* hold the slot until commit; other producers wait for it */
+		*pmsg = queue_msg(queue, queue_wrap(queue, queue->tail));
+		queue->reserved = 1;
+		queue->reserve_gen = queue->resets;
+	}
+
+	pthread_mutex_unlock(&queue->mutex);
+
+	return result;
+
+} /* pthread_queue_reserve_until */
+
+
+/**************************************************************************************************/
+/* pthread_queue_commit
+ * put the message filled in at the reserved slot on the queue.
+ */
+int pthread_queue_commit(pthread_queue_t *queue)
+{
+	int				result = 0;
+	uint32_t		nwake;
+
+	if (queue->flags & PTHREAD_QUEUE_SPSC)
+	{
+		if (!queue->reserved)
+			return EINVAL;
+		queue->reserved = 0;
+		if (queue->stats)
+			queue_stats_sent(queue, spsc_tail_slot(queue), 1,
+							 queue->tail + 1 - __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE));
+		spsc_publish(queue, 1);
+		return 0;
 	}
+
+	pthread_ext_mutex_lock(&queue->mutex);
+
+	if (!queue->reserved)
+		result = EINVAL;
+	else if (queue->reserve_gen != queue->resets)
+		result = ECANCELED;		// queue was reset since the slot was reserved
 	else
 	{
-		queue = *ppqueue;
-		queue->buffer = (char *) qstart;
-		if (NULL == queue->buffer)
-		{
-			return ENOMEM;
-		}
-		queue->destroyFree = 0;
+		if (queue->stats)
+			queue_stats_sent(queue, queue_wrap(queue, queue->tail), 1, queue_used(queue) + 1);
+		queue_push(queue, 1);
 	}
+	queue->reserved = 0;
+	nwake = queue->reserve_waiters;
 
-	pthread_mutex_init(&queue->mutex, NULL);
-	pthread_cond_init(&queue->full, NULL);
-	pthread_cond_init(&queue->empty, NULL);
-	queue->head = 0;
-	queue->tail = 0;
-	queue->count = 0;
-	queue->qsize = num_msg;
-	queue->msg_len = msg_len_bytes;
-	queue->reset = 0;
+	/* signal waiting consumer, and producers waiting for the reservation */
+	pthread_mutex_unlock(&queue->mutex);
+	if (0 == result)
+		queue_signal_msg(queue, 1);
+	if (nwake)
+		pthread_ext_waitq_wake(&queue->full, nwake);
+
+	return result;
+
+} /* pthread_queue_commit */
 
-	return 0;
-}
 
 /**************************************************************************************************/
-/* pthread_queue_destroy
- * free a queue.
+/* pthread_queue_unreserve
+ * give up the reserved slot without putting a message on the queue.
  */
-void pthread_queue_destroy(pthread_queue_t *queue)
+int pthread_queue_unreserve(pthread_queue_t *queue)
 {
-	pthread_mutex_destroy(&queue->mutex);
-	pthread_cond_destroy(&queue->full);
-	pthread_cond_destroy(&queue->empty);
-	if (queue->destroyFree)
+	int				result = 0;
+	uint32_t		nwake;
+
+	if (queue->flags & PTHREAD_QUEUE_SPSC)
 	{
-		free(queue->buffer);
-		free(queue);
+		if (!queue->reserved)
+			return EINVAL;
+		queue->reserved = 0;
+		return 0;
 	}
 
-} /* pthread_queue_destroy */
+	pthread_ext_mutex_lock(&queue->mutex);
+	if (!queue->reserved)
+		result = EINVAL;
+	queue->reserved = 0;
+	nwake = queue->reserve_waiters;
+	pthread_mutex_unlock(&queue->mutex);
+
+	/* signal producers waiting for the reservation */
+	if (nwake)
+		pthread_ext_waitq_wake(&queue->full, nwake);
+
+	return result;
+
+} /* pthread_queue_unreserve */
 
 
 /**************************************************************************************************/
-/* pthread_queue_sendmsg
- * puts new message on the queue.
- * timeout is PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
- * If timeout == PTHREAD_WAIT and the queue is full, function waits until there is room.
- * If blocked on full queue, function wakes up if queue is reset, and returns ECANCELED.
+/* pthread_queue_peek
+ * return a pointer to the message at the head of the queue without removing it.
+ * Waits like pthread_queue_getmsg.
  */
-int pthread_queue_sendmsg(pthread_queue_t *queue, void *msg, long timeout)
+int pthread_queue_peek(pthread_queue_t *queue, void **pmsg, long timeout)
 {
 	struct timespec abstime;
-	uint8_t			reset;
-	int				result;
 
 	if ( (PTHREAD_WAIT != timeout) && (timeout < 0) )
 		return EINVAL;
 
-	// convert wait to absolute system time
-	if (timeout > 0)
-		pthread_ext_ms2abs_time(timeout, &abstime);
+	return pthread_queue_peek_until(queue, pmsg, pthread_ext_deadline_ms(timeout, &abstime));
 
-	pthread_mutex_lock(&queue->mutex);
+} /* pthread_queue_peek */
 
-	/* handle nowait and queue is full */
-	if ( (PTHREAD_NOWAIT == timeout) && (queue->count == queue->qsize) )
-	{
-		pthread_mutex_unlock(&queue->mutex);
-		return ETIMEDOUT;
-	}
 
-	/* wait while buffer full */
-	while ((queue->count == queue->qsize) && !queue->reset) {
+/**************************************************************************************************/
+/* pthread_queue_peek_ns
+ * as pthread_queue_peek, with the timeout in nanoseconds.
+ */
+int pthread_queue_peek_ns(pthread_queue_t *queue, void **pmsg, long long timeout_ns)
+{
+	struct timespec abstime;
 
-		pthread_cleanup_push(cleanup_handler, &queue->mutex);
-		if (PTHREAD_WAIT == timeout)
-			result = pthread_cond_wait(&queue->full, &queue->mutex);
-		else
-			result = pthread_cond_timedwait(&queue->full, &queue->mutex, &abstime);
-		pthread_cleanup_pop(0);
+	if ( (PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0) )
+		return EINVAL;
 
-		if (ETIMEDOUT == result)
+	return pthread_queue_peek_until(queue, pmsg, pthread_ext_deadline_ns(timeout_ns, &abstime));
+
+} /* pthread_queue_peek_ns */
+
+
+/**************************************************************************************************/
+/* pthread_queue_peek_until
+ * as pthread_queue_peek, waiting until an absolute PTHREAD_EXT_CLOCK deadline.
+ */
+int pthread_queue_peek_until(pthread_queue_t *queue, void **pmsg, const struct timespec *deadline)
+{
+	uint32_t		head;
+	uint32_t		avail;
+	int				result;
+
+	if (queue->flags & (PTHREAD_QUEUE_VARLEN | PTHREAD_QUEUE_OVERWRITE))
+		return EINVAL;
+
+	if (queue->flags & PTHREAD_QUEUE_SPSC)
+	{
+		result = spsc_avail(queue, 1, &head, &avail, deadline);
+		if (0 == result)
 		{
-			pthread_mutex_unlock(&queue->mutex);
-			return ETIMEDOUT;
+			*pmsg = queue_msg(queue, spsc_head_slot(queue));
+			queue->peeked = 1;
 		}
+		return result;
 	}
 
-	reset = queue->reset;	// set this in critical section so we can look at
-							// it after we unlock the mutex
-	if (!reset)
+	pthread_ext_mutex_lock(&queue->mutex);
+
+	result = queue_wait_msg(queue, deadline);
+	if (0 == result)
 	{
-		/* copy message to queue */
-		memcpy(&queue->buffer[queue->tail * queue->msg_len], msg, queue->msg_len);
-		queue->count += 1;
-		queue->tail = (queue->tail == queue->qsize-1) ? 0 : queue->tail+1;
+		/* hold the slot until release; other consumers wait for it */
+		*pmsg = queue_msg(queue, queue_wrap(queue, queue->head));
+		queue->peeked = 1;
+		queue->peek_gen = queue->resets;
 	}
 
-	/* signal waiting consumer */
 	pthread_mutex_unlock(&queue->mutex);
-	if (!reset)
-		pthread_cond_signal(&queue->empty);
-
-	result = reset ? ECANCELED : 0;
 
 	return result;
 
-} /* pthread_queue_sendmsg */
+} /* pthread_queue_peek_until */
 
 
 /**************************************************************************************************/
-/* pthread_queue_getmsg
- * gets the oldest message in the queue.
- * timeout is PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
- * If timeout == PTHREAD_WAIT and the queue is full, function waits until there is room.
+/* pthread_queue_release
+ * remove the message returned by pthread_queue_peek from the queue.
  */
-
-int pthread_queue_getmsg(pthread_queue_t *queue, void *msg, long timeout)
+int pthread_queue_release(pthread_queue_t *queue)
 {
-	struct timespec abstime;
-
-	if ( (PTHREAD_WAIT != timeout) && (timeout < 0) )
-		return EINVAL;
+	int				result = 0;
+	uint32_t		nwake;
 
-	// convert wait to absolute system time
-	if (timeout > 0)
-		pthread_ext_ms2abs_time(timeout, &abstime);
+	if (queue->flags & PTHREAD_QUEUE_SPSC)
+	{
+		if (!queue->peeked)
+			return EINVAL;
+		queue->peeked = 0;
+		if (queue->stats)
+			queue_stats_got(queue, spsc_head_slot(queue), 1);
+		return spsc_consume(queue, queue->head_last, 1);
+	}
 
-	pthread_mutex_lock(&queue->mutex);
+	pthread_ext_mutex_lock(&queue->mutex);
 
-	/* handle nowait and queue is empty */
-	if ( (PTHREAD_NOWAIT == timeout) && (queue->count == 0) )
+	if (!queue->peeked)
+		result = EINVAL;
+	else
 	{
-		pthread_mutex_unlock(&queue->mutex);
-		return ETIMEDOUT;
+		if (queue->peek_gen != queue->resets)
+			result = ECANCELED;		// queue was reset since the slot was peeked at
+		else if (queue->stats)
+			queue_stats_got(queue, queue_wrap(queue, queue->head), 1);
+		queue_pop(queue, 1);
 	}
+	queue->peeked = 0;
+	nwake = queue->peek_waiters + queue->peek_watches;
+	queue->peek_watches = 0;
+	if (queue->flags & PTHREAD_QUEUE_GROW)
+		queue_shrink(queue);
 
-	/* wait while there is nothing in the buffer */
-	while (queue->count == 0) {
-		int result;
+	/* signal waiting producer, and consumers waiting for the peeked slot */
+	pthread_mutex_unlock(&queue->mutex);
+	if (EINVAL != result)
+		pthread_ext_waitq_wake(&queue->full, 1);
+	if (nwake)
+		pthread_ext_waitq_wake(&queue->empty, nwake);
 
-		pthread_cleanup_push(cleanup_handler, &queue->mutex);
-		if (PTHREAD_WAIT == timeout)
-			result = pthread_cond_wait(&queue->empty, &queue->mutex);
-		else
-			result = pthread_cond_timedwait(&queue->empty, &queue->mutex, &abstime);
-		pthread_cleanup_pop(0);
+	return result;
 
-		if (ETIMEDOUT == result)
-		{
-			pthread_mutex_unlock(&queue->mutex);
-			return ETIMEDOUT;
-		}
+} /* pthread_queue_release */
+
+
+/**************************************************************************************************/
+/* pthread_queue_unpeek
+ * end a peek, leaving the message at the head of the queue.
+ */
+int pthread_queue_unpeek(pthread_queue_t *queue)
+{
+	int				result = 0;
+	uint32_t		nwake;
+
+	if (queue->flags & PTHREAD_QUEUE_SPSC)
+	{
+		if (!queue->peeked)
+			return EINVAL;
+		queue->peeked = 0;
+		return 0;
 	}
 
-	/* copy message from the queue */
-	memcpy(msg, &queue->buffer[queue->head * queue->msg_len], queue->msg_len);
-	queue->count--;
-	queue->head = (queue->head == queue->qsize-1) ? 0 : queue->head+1;
+	pthread_ext_mutex_lock(&queue->mutex);
+	if (!queue->peeked)
+		result = EINVAL;
+	else if (queue->peek_gen != queue->resets)
+	{
+		queue_pop(queue, 1);		// queue was reset: drop the message kept for the peek
+		result = ECANCELED;
+	}
+	queue->peeked = 0;
+	nwake = queue->peek_waiters + queue->peek_watches;
+	queue->peek_watches = 0;
+	pthread_mutex_unlock(&queue->mutex);
 
-	/* signal waiting producer */
+	/* signal a producer waiting for the dropped slot, and consumers waiting for the peeked slot */
+	if (ECANCELED == result)
+		pthread_ext_waitq_wake(&queue->full, 1);
+	if (nwake)
+		pthread_ext_waitq_wake(&queue->empty, nwake);
+
+	return result;
+
+} /* pthread_queue_unpeek */
+
+
+/**************************************************************************************************/
+/* pthread_queue_notify
+ * add a one-shot watch for a message. Under the mutex, so that a watch added while the head
+ * slot is peeked at is counted before the release reads the count.
+ */
+int pthread_queue_notify(pthread_queue_t *queue, pthread_ext_waitq_watch_t *watch,
+						 void (* notify)(pthread_ext_waitq_watch_t * watch))
+{
+	if (queue->flags & PTHREAD_QUEUE_PSHARED)
+		return EINVAL;
+
+	/* the only consumer is the one adding the watch, so nothing else peeks */
+	if (queue->flags & PTHREAD_QUEUE_SPSC)
+	{
+		pthread_ext_waitq_notify(&queue->empty, watch, notify);
+		return 0;
+	}
+
+	pthread_ext_mutex_lock(&queue->mutex);
+	pthread_ext_waitq_notify(&queue->empty, watch, notify);
+	queue->peek_watches += queue->peeked;
 	pthread_mutex_unlock(&queue->mutex);
-	pthread_cond_signal(&queue->full);
 
-	return (0);
+	return 0;
 
-} /* pthread_queue_getmsg */
+} /* pthread_queue_notify */
+
+/**************************************************************************************************/
+/* pthread_queue_set_eventfd
+ * attach or detach a notification descriptor.
+ */
+int pthread_queue_set_eventfd(pthread_queue_t *queue, int fd)
+{
+	if (queue->flags & PTHREAD_QUEUE_PSHARED)
+		return EINVAL;
+
+	__atomic_store_n(&queue->efd_posted, 0, __ATOMIC_SEQ_CST);
+	__atomic_store_n(&queue->efd, fd, __ATOMIC_SEQ_CST);
+
+	/* messages already waiting */
+	if ((fd >= 0) && pthread_queue_count(queue))
+		pthread_queue_eventfd_ack(queue);
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* pthread_queue_eventfd_ack
+ * re-enable notifications, and post again if messages are left. The exchange pairs with
+ * the one in queue_signal_msg: a sender that found the descriptor posted has put its
+ * message on the queue before this, so the count below sees it.
+ */
+int pthread_queue_eventfd_ack(pthread_queue_t *queue)
+{
+	int				efd = __atomic_load_n(&queue->efd, __ATOMIC_RELAXED);
+
+	__atomic_exchange_n(&queue->efd_posted, 0, __ATOMIC_SEQ_CST);
+
+	if ((efd >= 0) && pthread_queue_count(queue) &&
+		(0 == __atomic_exchange_n(&queue->efd_posted, 1, __ATOMIC_SEQ_CST)))
+		pthread_ext_notify_fd(efd);
+
+	return 0;
+}
 
 /**************************************************************************************************/
 /* pthread_queue_count
@@ -240,8 +2097,127 @@ int pthread_queue_getmsg(pthread_queue_t *queue, void *msg, long timeout)
  */
 uint32_t pthread_queue_count(pthread_queue_t * queue)
 {
-	return queue->count;
+	uint32_t		head;
+	uint32_t		used;
+
+	if (queue->flags & PTHREAD_QUEUE_SPSC)
+	{
+		/* read head first, tail never falls behind it */
+		head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+		return __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) - head;
+	}
+
+	/* a resize moves head and tail together */
+	if (queue->flags & PTHREAD_QUEUE_GROW)
+	{
+		pthread_ext_mutex_lock(&queue->mutex);
+		used = queue_used(queue);
+		pthread_mutex_unlock(&queue->mutex);
+		return used;
+	}
+
+	/* unlocked: read head first, then tail, and clamp what a concurrent get or send in
+	 * between can skew */
+	if (queue->flags & PTHREAD_QUEUE_POW2)
+	{
+		head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+		used = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) - head;
+		if ((int32_t) used < 0)
+			return 0;
+		return (used > queue->qsize) ? queue->qsize : used;
+	}
+
+	return __atomic_load_n(&queue->count, __ATOMIC_RELAXED);
+}
+
+/**************************************************************************************************/
+/* pthread_queue_capacity
+ * return number of messages the ring holds now
+ */
+uint32_t pthread_queue_capacity(pthread_queue_t * queue)
+{
+	return __atomic_load_n(&queue->qsize, __ATOMIC_RELAXED);
+}
+
+/**************************************************************************************************/
+/* pthread_queue_drops
+ * return number of messages dropped to make room
+ */
+uint64_t pthread_queue_drops(pthread_queue_t * queue)
+{
+	return __atomic_load_n(&queue->drops, __ATOMIC_RELAXED);
+}
+
+/**************************************************************************************************/
+/* pthread_queue_poll
+ * test for messages and room. Other than an SPSC queue, this reads the queue under the
+ * mutex, which orders it against a sender or receiver that wakes after unlocking.
+ */
+uint32_t pthread_queue_poll(pthread_queue_t * queue, uint32_t events)
+{
+	uint32_t		used;
+	uint32_t		ready = 0;
+
+	if (queue->flags & PTHREAD_QUEUE_SPSC)
+	{
+		used = pthread_queue_count(queue);
+		if (used)
+			ready |= PTHREAD_QUEUE_READABLE;
+		if ((used < queue->qsize) || (queue->flags & PTHREAD_QUEUE_OVERWRITE))
+			ready |= PTHREAD_QUEUE_WRITABLE;
+	}
+	else
+	{
+		pthread_ext_mutex_lock(&queue->mutex);
+		if (queue_used(queue) && !queue->peeked)
+			ready |= PTHREAD_QUEUE_READABLE;
+		if ((!queue_full(queue, (queue->flags & PTHREAD_QUEUE_VARLEN) ? PTHREAD_QUEUE_VARLEN_RECORD(0) : 1) &&
+			 !queue->reserved) || (queue->flags & PTHREAD_QUEUE_OVERWRITE) ||
+			((queue->qsize < queue->qmax) && !queue->reserved && !queue->peeked))
+			ready |= PTHREAD_QUEUE_WRITABLE;
+		pthread_mutex_unlock(&queue->mutex);
+	}
+
+	return ready & events;
 }
+
+/**************************************************************************************************/
+/* pthread_queue_stats
+ * sum the statistics shards.
+ */
+int pthread_queue_stats(pthread_queue_t * queue, pthread_queue_stats_t * stats)
+{
+	queue_shard_t	*shard;
+	uint32_t		i;
+	uint32_t		b;
+
+	if (NULL == queue->stats)
+		return EINVAL;
+
+	memset(stats, 0, sizeof(*stats));
+	for (i = 0; i < PTHREAD_EXT_SHARDS; i++)
+	{
+		shard = &queue->stats->shard[i];
+		stats->sends += __atomic_load_n(&shard->sends, __ATOMIC_RELAXED);
+		stats->gets += __atomic_load_n(&shard->gets, __ATOMIC_RELAXED);
+		stats->blocked_sends += __atomic_load_n(&shard->blocked_sends, __ATOMIC_RELAXED);
+		stats->blocked_gets += __atomic_load_n(&shard->blocked_gets, __ATOMIC_RELAXED);
+		stats->timeouts += __atomic_load_n(&shard->timeouts, __ATOMIC_RELAXED);
+		for (b = 0; b < PTHREAD_EXT_HIST_BUCKETS; b++)
+		{
+			stats->residency[b] += __atomic_load_n(&shard->residency[b], __ATOMIC_RELAXED);
+			stats->wait[b] += __atomic_load_n(&shard->wait[b], __ATOMIC_RELAXED);
+		}
+	}
+
+	stats->resets = __atomic_load_n(&queue->resets, __ATOMIC_RELAXED);
+	stats->drops = pthread_queue_drops(queue);
+	stats->high_water = __atomic_load_n(&queue->stats->high_water, __ATOMIC_RELAXED);
+	stats->count = pthread_queue_count(queue);
+
+	return 0;
+}
+
 /**************************************************************************************************/
 /* pthread_queue_reset
  * clear the queue and prevent any inputs while reset. Wake up all threads
@@ -249,13 +2225,51 @@ uint32_t pthread_queue_count(pthread_queue_t * queue)
  */
 int pthread_queue_reset(pthread_queue_t * queue)
 {
-	pthread_mutex_lock(&queue->mutex);
-	queue->head = 0;
-	queue->tail = 0;
-	queue->count = 0;
-	queue->reset = 1;
+	pthread_ext_mutex_lock(&queue->mutex);
+	if (queue->flags & PTHREAD_QUEUE_SPSC)
+	{
+		uint32_t		head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+		uint32_t		tail;
+
+		/* set reset before discarding, so a producer that saw room stops sending. head only
+		 * moves forward: the consumer may advance it past the tail loaded here */
+		__atomic_store_n(&queue->reset, 1, __ATOMIC_SEQ_CST);
+		do
+			tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+		while (((int32_t)(tail - head) > 0) &&
+			   !__atomic_compare_exchange_n(&queue->head, &head, tail, 0, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE));
+	}
+	else
+	{
+		/* a peeked head slot stays until the peek ends, so that no producer reuses it while
+		 * the consumer reads it; release or unpeek drop it. POW2 keeps one store per change,
+		 * as a shared queue needs */
+		uint32_t		keep = queue->peeked ? 1 : 0;
+
+		queue->head_seq += queue_used(queue) - keep;
+		if (queue->flags & PTHREAD_QUEUE_POW2)
+		{
+			if (keep)
+				queue->tail = queue->head + 1;
+			else
+				queue->head = queue->tail;
+		}
+		else if (keep)
+			queue->tail = queue_wrap(queue, queue->head + 1);
+		else
+		{
+			queue->head = 0;
+			queue->tail = 0;
+		}
+		queue->count = keep;
+		queue->bytes = 0;
+		queue->reset = 1;
+		if (queue->flags & PTHREAD_QUEUE_GROW)
+			queue_resize(queue, queue->qmin);
+	}
+	queue->resets++;
 	pthread_mutex_unlock(&queue->mutex);
-	pthread_cond_broadcast(&queue->full);
+	pthread_ext_waitq_wake(&queue->full, PTHREAD_EXT_WAKE_ALL);
 
 	return 0;
 }
@@ -266,8 +2280,8 @@ int pthread_queue_reset(pthread_queue_t * queue)
  */
 int pthread_queue_unreset(pthread_queue_t * queue)
 {
-	pthread_mutex_lock(&queue->mutex);
-	queue->reset = 0;
+	pthread_ext_mutex_lock(&queue->mutex);
+	__atomic_store_n(&queue->reset, 0, __ATOMIC_RELAXED);
 	pthread_mutex_unlock(&queue->mutex);
 
 	return 0;
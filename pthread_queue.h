@@ -32,25 +32,116 @@ THE SOFTWARE.
 #define PTHREAD_QUEUE_H
 
 #include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "pthread_ext_common.h"
+#include "pthread_ext_wait.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Queue mode flags */
+#define PTHREAD_QUEUE_SPSC	0x0001		/* single producer, single consumer, lock-free */
+#define PTHREAD_QUEUE_VARLEN	0x0002		/* variable length messages packed in a byte ring */
+#define PTHREAD_QUEUE_POW2	0x0004		/* power of two sizes, mask and shift indexing */
+#define PTHREAD_QUEUE_PSHARED	0x0008		/* shared between processes, requires POW2 */
+#define PTHREAD_QUEUE_STATS		0x0010		/* keep statistics, see pthread_queue_stats */
+#define PTHREAD_QUEUE_OVERWRITE	0x0020		/* a send to a full queue drops the oldest messages */
+#define PTHREAD_QUEUE_GROW		0x0040		/* the ring grows under load, up to attr->grow_max */
+
+/** Bytes of PTHREAD_QUEUE_VARLEN ring used by a message of len bytes */
+#define PTHREAD_QUEUE_VARLEN_RECORD(len)	(8 + (((len) + 7) & ~7u))
+
+/* pthread_queue_poll conditions */
+#define PTHREAD_QUEUE_READABLE	0x0001		/* a message can be taken */
+#define PTHREAD_QUEUE_WRITABLE	0x0002		/* a message can be put */
+
+typedef struct pthread_queue_attr_s {
+	uint32_t		flags;		/* PTHREAD_QUEUE_xxx mode flags */
+	pthread_ext_wait_policy_t	wait;	/* how blocked senders and receivers wait */
+	pthread_ext_alloc_attr_t	alloc;	/* how a buffer allocated by the queue is placed */
+	uint32_t		grow_max;	/* GROW: most messages the ring grows to */
+} pthread_queue_attr_t;
+
+/** Statistics of a PTHREAD_QUEUE_STATS queue, see pthread_queue_stats */
+typedef struct pthread_queue_stats_s {
+	uint64_t		sends;		/* messages put on the queue */
+	uint64_t		gets;		/* messages taken off the queue */
+	uint64_t		blocked_sends;	/* sends, reserves that waited for room */
+	uint64_t		blocked_gets;	/* gets, peeks that waited for a message */
+	uint64_t		timeouts;	/* calls that returned ETIMEDOUT, PTHREAD_NOWAIT included */
+	uint64_t		resets;		/* calls to pthread_queue_reset */
+	uint64_t		drops;		/* OVERWRITE: messages dropped to make room */
+	uint32_t		high_water;	/* most messages ever in the queue at once */
+	uint32_t		count;		/* messages in the queue now */
+	uint64_t		residency[PTHREAD_EXT_HIST_BUCKETS];	/* ns from send to get, per message */
+	uint64_t		wait[PTHREAD_EXT_HIST_BUCKETS];		/* ns a blocked call waited */
+} pthread_queue_stats_t;
+
+struct pthread_queue_shards_s;
 
 typedef struct pthread_queue_s {
-	char		  *	buffer;		/* circular buffer */
+	ptrdiff_t		buffer;		/* circular buffer, as an offset from the queue */
 	pthread_mutex_t	mutex;		/* lock the structure */
-	pthread_cond_t	full;		/* full condition */
-	pthread_cond_t	empty;		/* empty condition */
-	uint32_t		head;		/* head of queue (first element) */
-	uint32_t		tail;		/* tail of queue (last element) */
+	pthread_ext_waitq_t	full;	/* full condition */
+	pthread_ext_waitq_t	empty;	/* empty condition */
 	uint32_t		count;		/* number of elements in queue */
-	uint32_t		qsize;		/* max number of elements in queue */
+	uint32_t		bytes;		/* VARLEN: bytes of ring in use */
+	uint32_t		qsize;		/* max number of elements in queue (VARLEN: ring bytes) */
 	uint32_t		msg_len;	/* length of each message */
+	uint32_t		flags;		/* PTHREAD_QUEUE_xxx mode flags */
+	uint32_t		mask;		/* POW2: qsize - 1 */
+	uint32_t		resets;		/* number of resets, invalidates reserved/peeked slots */
 	uint8_t			reset;		/* 0 = not reset, otherwise reset */
 	uint8_t			destroyFree;/* 1 = free memory on destroy */
+	uint8_t			shift;		/* POW2: log2(msg_len) */
+	int				efd;		/* notification descriptor, or -1 */
+	uint32_t		efd_posted;	/* 1 = efd posted and not yet acknowledged */
+	uint32_t		magic;		/* PSHARED: set once the queue is ready to attach */
+	uint64_t		map_len;	/* PSHARED: length of the shared memory mapping */
+	uint64_t		buf_map_len;/* buffer mapped by pthread_ext_alloc: length to unmap, else 0 */
+	uint32_t		qmin;		/* GROW: least qsize, the num_msg passed to create */
+	uint32_t		qmax;		/* GROW: most qsize */
+	pthread_ext_alloc_attr_t	alloc;	/* GROW: placement of a resized buffer */
+	struct pthread_queue_shards_s *stats;	/* STATS: counters, histograms and send times */
+
+	/* consumer side */
+	uint32_t		head PTHREAD_EXT_CACHE_ALIGNED;	/* head of queue (first element) */
+	uint32_t		head_slot;	/* SPSC: buffer index of head */
+	uint32_t		head_last;	/* SPSC: head as last written by the consumer */
+	uint32_t		tail_cache;	/* SPSC: consumer's copy of tail */
+	uint32_t		peek_gen;	/* resets when the head slot was peeked at */
+	uint8_t			peeked;		/* 1 = head slot is being peeked at by a consumer */
+	uint32_t		peek_waiters;	/* consumers blocked while the head slot was peeked at */
+	uint32_t		peek_watches;	/* one-shot watches added while the head slot was peeked at */
+	uint64_t		head_seq;	/* sequence number of the message at head */
+
+	/* producer side */
+	uint32_t		tail PTHREAD_EXT_CACHE_ALIGNED;	/* tail of queue (last element) */
+	uint32_t		tail_slot;	/* SPSC: buffer index of tail */
+	uint32_t		head_cache;	/* SPSC: producer's copy of head */
+	uint32_t		reserve_gen;/* resets when the tail slot was reserved */
+	uint8_t			reserved;	/* 1 = tail slot is reserved by a producer */
+	uint32_t		reserve_waiters;/* producers blocked while the tail slot was reserved */
+	uint64_t		drops;		/* OVERWRITE: messages dropped to make room */
 } pthread_queue_t;
 
 
+/** Initialize queue attributes to the defaults used by pthread_queue_create.
+ *
+ * @param[out] attr			pointer to the attributes
+ * @returns                 0 for success
+ */
+int pthread_queue_attr_init(pthread_queue_attr_t * attr);
+
+
+
 /** Create a message queue with fixed length messages.
  *
- * Set *ppqueue = NULL to allocate memory for the queue. Otherwise, caller allocates memory.
+ * Set *ppqueue = NULL to allocate memory for the queue. Otherwise, caller allocates memory,
+ * aligned to PTHREAD_EXT_CACHE_LINE (posix_memalign or aligned_alloc, not plain malloc).
  *
  * @param[inout] ppqueue		if *ppqueue == NULL, allocate memory for queue. Returns queue pointer.
  * @param[in]	 qstart			pointer to the queue buffer
@@ -59,11 +150,159 @@ typedef struct pthread_queue_s {
  * @returns                   0 for success, otherwise an error number for failure
  * @ERRORS
  *      [ENOMEM]            	memory for queue not available
+ *      [EINVAL]            	caller's queue is not aligned to PTHREAD_EXT_CACHE_LINE
  */
 int pthread_queue_create(pthread_queue_t ** ppqueue, void * qstart, uint32_t num_msg, uint32_t msg_len_bytes);
 
 
 
+/** Create a message queue with fixed length messages and mode attributes.
+ *
+ * Same as pthread_queue_create, with the queue mode and wait policy taken from attr (NULL for defaults).
+ *
+ * PTHREAD_QUEUE_SPSC selects a lock-free ring for exactly one sending thread and one
+ * receiving thread. head and tail are free running counters on separate cache lines, and
+ * the wait queues are only touched when a side has to block. Calls to
+ * pthread_queue_sendmsg from more than one thread (or pthread_queue_getmsg from more
+ * than one thread) at a time are not supported in this mode. A send which races with
+ * pthread_queue_reset may still complete.
+ *
+ * PTHREAD_QUEUE_VARLEN packs messages of any length up to msg_len_bytes into a byte ring of
+ * num_msg bytes (a multiple of 8), so memory scales with the bytes in flight rather than the
+ * number of messages times the largest size. Each message takes
+ * PTHREAD_QUEUE_VARLEN_RECORD(len) bytes of ring. Use pthread_queue_sendmsg_len and
+ * pthread_queue_getmsg_len to pass lengths; pthread_queue_sendmsg sends msg_len_bytes and
+ * pthread_queue_getmsg receives into a buffer of msg_len_bytes. The batch and zero-copy
+ * calls are not available in this mode, and it cannot be combined with PTHREAD_QUEUE_SPSC.
+ *
+ * attr->wait sets how a blocked sender or receiver waits: park at once (the default), or
+ * spin and yield first, for a fixed or adaptive number of spins. See pthread_ext_wait.h.
+ *
+ * PTHREAD_QUEUE_POW2 requires num_msg and msg_len_bytes to be powers of two. Buffer indexes
+ * are then a mask of the position and message offsets a shift, rather than a compare and
+ * branch and a multiply, and head and tail run free so the default mode keeps no separate
+ * count written by both sides: a receive writes only the head cache line and a send only
+ * the tail one, apart from the mutex.
+ * It can be combined with PTHREAD_QUEUE_SPSC, but not with PTHREAD_QUEUE_VARLEN.
+ *
+ * PTHREAD_QUEUE_PSHARED places the queue in memory shared between processes: the caller
+ * passes a queue and qstart inside one shared mapping, and the lock and wait queues are
+ * set up to work across processes. See pthread_queue_create_shared.
+ *
+ * PTHREAD_QUEUE_OVERWRITE makes the queue a lossy ring: a send never waits for room, but
+ * drops the oldest messages to make it, and counts them (see pthread_queue_drops). Every
+ * message sent is numbered in turn from 0, and pthread_queue_getmsg_seq returns the number,
+ * so a consumer sees a gap where messages were dropped (or discarded by
+ * pthread_queue_reset). With PTHREAD_QUEUE_SPSC the producer drops messages with a compare
+ * and swap on head, and a send is wait-free. pthread_queue_reserve and pthread_queue_peek
+ * are not available in this mode.
+ *
+ * PTHREAD_QUEUE_STATS keeps the counters and histograms returned by pthread_queue_stats.
+ * Each thread updates its own shard of them (see pthread_ext_shard), so they add no
+ * contention between threads. Each message is stamped with the time it was sent, which
+ * costs a clock read on each side of the queue. It cannot be combined with
+ * PTHREAD_QUEUE_PSHARED.
+ *
+ * PTHREAD_QUEUE_GROW lets the ring grow under load instead of blocking senders: a send to a
+ * full queue moves the messages, in order, to a buffer at least twice the size, up to
+ * attr->grow_max messages, and wakes any blocked senders. Once a receive leaves the queue at
+ * most a quarter full, the ring halves again, down to num_msg. A resize copies the messages
+ * under the mutex, and waits for a reserved or peeked slot to be given back. Only senders at
+ * grow_max block. It needs the queue to allocate its buffer (*ppqueue == NULL), grow_max
+ * must be a power of two with PTHREAD_QUEUE_POW2, and it cannot be combined with
+ * PTHREAD_QUEUE_SPSC, _VARLEN, _PSHARED, _OVERWRITE or _STATS. See pthread_queue_capacity.
+ *
+ * A queue allocated by the caller must be aligned to PTHREAD_EXT_CACHE_LINE, or create
+ * returns EINVAL.
+ *
+ * attr->alloc sets how the buffer is allocated when *ppqueue == NULL: huge pages, a NUMA
+ * node, pre-faulting (see pthread_ext_alloc). The buffer is always cache line aligned. Any
+ * alloc flag is invalid when the caller provides the memory.
+ *
+ * @param[inout] ppqueue		if *ppqueue == NULL, allocate memory for queue. Returns queue pointer.
+ * @param[in]	 qstart			pointer to the queue buffer
+ * @param[in]    num_msg        maximum number of messages in the queue (VARLEN: ring size in bytes)
+ * @param[in]    msg_len_bytes  maximum size of each message in bytes
+ * @param[in]    attr			queue attributes, or NULL for defaults
+ * @returns                   0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ENOMEM]            	memory for queue not available
+ *      [EINVAL]            	attributes are invalid, or caller's queue is not cache line aligned
+ *      [ENOSYS]            	PTHREAD_EXT_ALLOC_NODE on a system without mbind
+ */
+int pthread_queue_create_ex(pthread_queue_t ** ppqueue, void * qstart, uint32_t num_msg,
+							uint32_t msg_len_bytes, const pthread_queue_attr_t * attr);
+
+
+
+/** Create a message queue in POSIX shared memory, for use by several processes.
+ *
+ * Creates the shared memory object name (see shm_open) holding the queue and its buffer,
+ * and maps it. Other processes map the queue with pthread_queue_attach. Messages are
+ * copied straight from the sender's buffer into the shared ring and from the ring into
+ * the receiver's buffer, and a system call is only made when a side has to block or
+ * wake the other.
+ *
+ * The queue is created with PTHREAD_QUEUE_PSHARED added to attr->flags, and requires
+ * PTHREAD_QUEUE_POW2: every change to the queue state is then a single store, so if a
+ * process dies while it holds the lock the next process to take it (a robust mutex)
+ * carries on from a consistent queue. Messages are never half sent or half received. A
+ * process that dies between pthread_queue_reserve and pthread_queue_commit (or peek and
+ * release) still holds that slot, and other producers (consumers) wait until the queue
+ * is destroyed; avoid the zero-copy calls if peers may crash.
+ *
+ * The queue is destroyed with pthread_queue_destroy by the creating process, once the
+ * others have detached. The name is removed with pthread_queue_unlink.
+ *
+ * @param[out]   ppqueue		returns the queue pointer
+ * @param[in]    name			shared memory object name, "/somename"
+ * @param[in]    num_msg        maximum number of messages in the queue, a power of two
+ * @param[in]    msg_len_bytes  size of each message in bytes, a power of two
+ * @param[in]    attr			queue attributes, or NULL for defaults
+ * @returns                   0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [EEXIST]            	name already exists
+ *      [EINVAL]            	attributes are invalid, or sizes are not powers of two
+ *      other               	errors from shm_open, ftruncate and mmap
+ */
+int pthread_queue_create_shared(pthread_queue_t ** ppqueue, const char * name, uint32_t num_msg,
+								uint32_t msg_len_bytes, const pthread_queue_attr_t * attr);
+
+
+
+/** Attach to a message queue created by pthread_queue_create_shared in another process.
+ *
+ * @param[out]   ppqueue		returns the queue pointer, valid in this process only
+ * @param[in]    name			shared memory object name passed to pthread_queue_create_shared
+ * @returns                   0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ENOENT]            	name does not exist
+ *      [EAGAIN]            	queue is still being created, try again
+ *      other               	errors from shm_open and mmap
+ */
+int pthread_queue_attach(pthread_queue_t ** ppqueue, const char * name);
+
+
+
+/** Detach from a message queue mapped by pthread_queue_attach.
+ *
+ * @param[in]  queue          pointer to the queue
+ * @returns                   nothing
+ */
+void pthread_queue_detach(pthread_queue_t *queue);
+
+
+
+/** Remove the name of a shared message queue. Processes which have the queue mapped can
+ * go on using it.
+ *
+ * @param[in]  name           shared memory object name
+ * @returns                   0 for success, otherwise an error number from shm_unlink
+ */
+int pthread_queue_unlink(const char * name);
+
+
+
 /** Destroy a message queue.
  * 
  * @param[in]  queue          pointer to the queue to destroy
@@ -96,6 +335,102 @@ int pthread_queue_sendmsg(pthread_queue_t *queue, void *msg, long timeout);
 
 
 
+/** Same as pthread_queue_sendmsg, with the timeout in nanoseconds.
+ *
+ * @param[in] timeout_ns	PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ns
+ */
+int pthread_queue_sendmsg_ns(pthread_queue_t *queue, void *msg, long long timeout_ns);
+
+
+
+/** Same as pthread_queue_sendmsg, waiting until an absolute deadline.
+ *
+ * @param[in] deadline		absolute PTHREAD_EXT_CLOCK time, NULL to wait forever, or
+ *                          PTHREAD_EXT_DEADLINE_NOW not to wait
+ */
+int pthread_queue_sendmsg_until(pthread_queue_t *queue, void *msg, const struct timespec * deadline);
+
+
+
+/** Send a variable length message to a PTHREAD_QUEUE_VARLEN queue.
+ *
+ * Same as pthread_queue_sendmsg, for a message of len bytes.
+ *
+ * @param[in] queue         pointer to the queue
+ * @param[in] msg           message to place in the queue
+ * @param[in] len           length of the message in bytes, at most msg_len_bytes
+ * @param[in] timeout       PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ETIMEDOUT]         timeout has passed (or, if PTHREAD_NOWAIT, queue is full)
+ *      [EINVAL]            timeout value is invalid, or queue is not PTHREAD_QUEUE_VARLEN
+ *      [EMSGSIZE]          len is larger than msg_len_bytes
+ *      [ECANCELED]         queue was reset, message was not put in queue
+ */
+int pthread_queue_sendmsg_len(pthread_queue_t *queue, void *msg, uint32_t len, long timeout);
+
+
+
+/** Same as pthread_queue_sendmsg_len, with the timeout in nanoseconds.
+ *
+ * @param[in] timeout_ns	PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ns
+ */
+int pthread_queue_sendmsg_len_ns(pthread_queue_t *queue, void *msg, uint32_t len, long long timeout_ns);
+
+
+
+/** Same as pthread_queue_sendmsg_len, waiting until an absolute deadline.
+ *
+ * @param[in] deadline		absolute PTHREAD_EXT_CLOCK time, NULL to wait forever, or
+ *                          PTHREAD_EXT_DEADLINE_NOW not to wait
+ */
+int pthread_queue_sendmsg_len_until(pthread_queue_t *queue, void *msg, uint32_t len,
+									const struct timespec * deadline);
+
+
+
+/** Send a batch of messages to a queue.
+ *
+ * msgs points to num_msgs messages stored back to back, each msg_len_bytes long. The
+ * function waits, as pthread_queue_sendmsg does, until there is room for at least one
+ * message, then copies as many messages as fit (up to num_msgs) in a single critical
+ * section, and wakes consumers once for the whole batch. Call again with the remaining
+ * messages if *psent < num_msgs.
+ *
+ * @param[in]  queue        pointer to the queue
+ * @param[in]  msgs         messages to place in the queue
+ * @param[in]  num_msgs     number of messages in msgs
+ * @param[out] psent        number of messages placed in the queue
+ * @param[in]  timeout      PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ETIMEDOUT]         timeout has passed (or, if PTHREAD_NOWAIT, queue is full)
+ *      [EINVAL]            timeout value is invalid, or num_msgs is 0
+ *      [ECANCELED]         queue was reset, no messages were put in queue
+ */
+int pthread_queue_sendmsgs(pthread_queue_t *queue, void *msgs, uint32_t num_msgs, uint32_t *psent, long timeout);
+
+
+
+/** Same as pthread_queue_sendmsgs, with the timeout in nanoseconds.
+ *
+ * @param[in] timeout_ns	PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ns
+ */
+int pthread_queue_sendmsgs_ns(pthread_queue_t *queue, void *msgs, uint32_t num_msgs, uint32_t *psent,
+							  long long timeout_ns);
+
+
+
+/** Same as pthread_queue_sendmsgs, waiting until an absolute deadline.
+ *
+ * @param[in] deadline		absolute PTHREAD_EXT_CLOCK time, NULL to wait forever, or
+ *                          PTHREAD_EXT_DEADLINE_NOW not to wait
+ */
+int pthread_queue_sendmsgs_until(pthread_queue_t *queue, void *msgs, uint32_t num_msgs, uint32_t *psent,
+								 const struct timespec * deadline);
+
+
+
 /** Get message from a queue.
  *
  * Message is copied from the queue. Calling function can deallocate local copy of
@@ -121,6 +456,322 @@ int pthread_queue_getmsg(pthread_queue_t *queue, void *msg, long timeout);
 
 
 
+/** Same as pthread_queue_getmsg, with the timeout in nanoseconds.
+ *
+ * @param[in] timeout_ns	PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ns
+ */
+int pthread_queue_getmsg_ns(pthread_queue_t *queue, void *msg, long long timeout_ns);
+
+
+
+/** Same as pthread_queue_getmsg, waiting until an absolute deadline.
+ *
+ * @param[in] deadline		absolute PTHREAD_EXT_CLOCK time, NULL to wait forever, or
+ *                          PTHREAD_EXT_DEADLINE_NOW not to wait
+ */
+int pthread_queue_getmsg_until(pthread_queue_t *queue, void *msg, const struct timespec * deadline);
+
+
+
+/** Get message from a queue, and its sequence number.
+ *
+ * Same as pthread_queue_getmsg. Messages are numbered in the order they are sent, from 0,
+ * so a jump in the number from one message to the next counts the messages dropped
+ * (PTHREAD_QUEUE_OVERWRITE) or discarded by pthread_queue_reset in between.
+ *
+ * @param[in]  queue		pointer to the queue
+ * @param[out] msg			buffer to receive message from the queue
+ * @param[out] pseq			sequence number of the message
+ * @param[in]  timeout		PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ETIMEDOUT]         timeout has passed (or, if PTHREAD_NOWAIT, queue is empty)
+ *      [EINVAL]            timeout value is invalid
+ */
+int pthread_queue_getmsg_seq(pthread_queue_t *queue, void *msg, uint64_t *pseq, long timeout);
+
+
+
+/** Same as pthread_queue_getmsg_seq, with the timeout in nanoseconds.
+ *
+ * @param[in] timeout_ns	PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ns
+ */
+int pthread_queue_getmsg_seq_ns(pthread_queue_t *queue, void *msg, uint64_t *pseq, long long timeout_ns);
+
+
+
+/** Same as pthread_queue_getmsg_seq, waiting until an absolute deadline.
+ *
+ * @param[in] deadline		absolute PTHREAD_EXT_CLOCK time, NULL to wait forever, or
+ *                          PTHREAD_EXT_DEADLINE_NOW not to wait
+ */
+int pthread_queue_getmsg_seq_until(pthread_queue_t *queue, void *msg, uint64_t *pseq,
+								   const struct timespec * deadline);
+
+
+
+/** Get a variable length message from a PTHREAD_QUEUE_VARLEN queue.
+ *
+ * Same as pthread_queue_getmsg, and returns the length of the message in *plen. If the
+ * message is longer than buf_len, it stays on the queue, *plen is set to its length and
+ * EMSGSIZE is returned.
+ *
+ * @param[in]  queue		pointer to the queue
+ * @param[out] msg			buffer to receive message from the queue
+ * @param[in]  buf_len		size of the msg buffer in bytes
+ * @param[out] plen			length of the message in bytes
+ * @param[in]  timeout		PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ETIMEDOUT]         timeout has passed (or, if PTHREAD_NOWAIT, queue is empty)
+ *      [EINVAL]            timeout value is invalid, or queue is not PTHREAD_QUEUE_VARLEN
+ *      [EMSGSIZE]          message is longer than buf_len
+ */
+int pthread_queue_getmsg_len(pthread_queue_t *queue, void *msg, uint32_t buf_len, uint32_t *plen, long timeout);
+
+
+
+/** Same as pthread_queue_getmsg_len, with the timeout in nanoseconds.
+ *
+ * @param[in] timeout_ns	PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ns
+ */
+int pthread_queue_getmsg_len_ns(pthread_queue_t *queue, void *msg, uint32_t buf_len, uint32_t *plen,
+								long long timeout_ns);
+
+
+
+/** Same as pthread_queue_getmsg_len, waiting until an absolute deadline.
+ *
+ * @param[in] deadline		absolute PTHREAD_EXT_CLOCK time, NULL to wait forever, or
+ *                          PTHREAD_EXT_DEADLINE_NOW not to wait
+ */
+int pthread_queue_getmsg_len_until(pthread_queue_t *queue, void *msg, uint32_t buf_len, uint32_t *plen,
+								   const struct timespec * deadline);
+
+
+
+/** Get a batch of messages from a queue.
+ *
+ * The function waits, as pthread_queue_getmsg does, until there is at least one message,
+ * then copies the oldest messages (at least one, up to max_msgs) back to back into msgs in
+ * a single critical section, and wakes producers once for the whole batch. msgs must be at
+ * least max_msgs * msg_len_bytes long.
+ *
+ * @param[in]  queue		pointer to the queue
+ * @param[out] msgs			buffer to receive messages from the queue
+ * @param[in]  max_msgs		maximum number of messages to receive
+ * @param[out] pgot			number of messages received
+ * @param[in]  timeout		PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ETIMEDOUT]         timeout has passed (or, if PTHREAD_NOWAIT, queue is empty)
+ *      [EINVAL]            timeout value is invalid, or max_msgs is 0
+ */
+int pthread_queue_getmsgs(pthread_queue_t *queue, void *msgs, uint32_t max_msgs, uint32_t *pgot, long timeout);
+
+
+
+/** Same as pthread_queue_getmsgs, with the timeout in nanoseconds.
+ *
+ * @param[in] timeout_ns	PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ns
+ */
+int pthread_queue_getmsgs_ns(pthread_queue_t *queue, void *msgs, uint32_t max_msgs, uint32_t *pgot,
+							 long long timeout_ns);
+
+
+
+/** Same as pthread_queue_getmsgs, waiting until an absolute deadline.
+ *
+ * @param[in] deadline		absolute PTHREAD_EXT_CLOCK time, NULL to wait forever, or
+ *                          PTHREAD_EXT_DEADLINE_NOW not to wait
+ */
+int pthread_queue_getmsgs_until(pthread_queue_t *queue, void *msgs, uint32_t max_msgs, uint32_t *pgot,
+								const struct timespec * deadline);
+
+
+
+/** Reserve the slot at the tail of a queue, to build a message in place.
+ *
+ * On success *pmsg points to msg_len_bytes of queue buffer which the caller fills in, then
+ * calls pthread_queue_commit to put the message on the queue. This avoids copying the
+ * message into the queue. Only one reservation may be outstanding per queue: other
+ * producers block (or time out) until it is committed.
+ *
+ * If the queue is full, the function waits as pthread_queue_sendmsg does.
+ *
+ * @param[in]  queue        pointer to the queue
+ * @param[out] pmsg         pointer to the reserved slot
+ * @param[in]  timeout      PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ETIMEDOUT]         timeout has passed (or, if PTHREAD_NOWAIT, queue is full)
+ *      [EINVAL]            timeout value is invalid, or queue is PTHREAD_QUEUE_OVERWRITE
+ *      [ECANCELED]         queue was reset, no slot was reserved
+ */
+int pthread_queue_reserve(pthread_queue_t *queue, void **pmsg, long timeout);
+
+
+
+/** Same as pthread_queue_reserve, with the timeout in nanoseconds.
+ *
+ * @param[in] timeout_ns	PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ns
+ */
+int pthread_queue_reserve_ns(pthread_queue_t *queue, void **pmsg, long long timeout_ns);
+
+
+
+/** Same as pthread_queue_reserve, waiting until an absolute deadline.
+ *
+ * @param[in] deadline		absolute PTHREAD_EXT_CLOCK time, NULL to wait forever, or
+ *                          PTHREAD_EXT_DEADLINE_NOW not to wait
+ */
+int pthread_queue_reserve_until(pthread_queue_t *queue, void **pmsg, const struct timespec * deadline);
+
+
+
+/** Put the message built in the reserved slot on the queue.
+ *
+ * @param[in] queue         pointer to the queue
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [EINVAL]            no slot is reserved
+ *      [ECANCELED]         queue was reset since the slot was reserved, message was discarded
+ */
+int pthread_queue_commit(pthread_queue_t *queue);
+
+
+
+/** Give up the reserved slot without putting a message on the queue, for a producer
+ * that fails to build the message.
+ *
+ * @param[in] queue         pointer to the queue
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [EINVAL]            no slot is reserved
+ */
+int pthread_queue_unreserve(pthread_queue_t *queue);
+
+
+
+/** Get a pointer to the message at the head of a queue without copying it.
+ *
+ * On success *pmsg points to the oldest message in the queue buffer. The caller reads it in
+ * place, then calls pthread_queue_release to remove it from the queue. Only one peek may be
+ * outstanding per queue: other consumers block (or time out) until it is released. A reset
+ * discards the message, but keeps its slot until the peek ends, when pthread_queue_release
+ * or pthread_queue_unpeek returns ECANCELED. With PTHREAD_QUEUE_SPSC the slot is not kept,
+ * and the producer may reuse it before it is released.
+ *
+ * If the queue is empty, the function waits as pthread_queue_getmsg does.
+ *
+ * @param[in]  queue		pointer to the queue
+ * @param[out] pmsg			pointer to the message at the head of the queue
+ * @param[in]  timeout		PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ETIMEDOUT]         timeout has passed (or, if PTHREAD_NOWAIT, queue is empty)
+ *      [EINVAL]            timeout value is invalid, or queue is PTHREAD_QUEUE_OVERWRITE
+ */
+int pthread_queue_peek(pthread_queue_t *queue, void **pmsg, long timeout);
+
+
+
+/** Same as pthread_queue_peek, with the timeout in nanoseconds.
+ *
+ * @param[in] timeout_ns	PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ns
+ */
+int pthread_queue_peek_ns(pthread_queue_t *queue, void **pmsg, long long timeout_ns);
+
+
+
+/** Same as pthread_queue_peek, waiting until an absolute deadline.
+ *
+ * @param[in] deadline		absolute PTHREAD_EXT_CLOCK time, NULL to wait forever, or
+ *                          PTHREAD_EXT_DEADLINE_NOW not to wait
+ */
+int pthread_queue_peek_until(pthread_queue_t *queue, void **pmsg, const struct timespec * deadline);
+
+
+
+/** Remove the message returned by pthread_queue_peek from the queue.
+ *
+ * @param[in] queue			pointer to the queue
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [EINVAL]            no message is being peeked at
+ *      [ECANCELED]         queue was reset since the peek, message was discarded
+ */
+int pthread_queue_release(pthread_queue_t *queue);
+
+
+
+/** End a peek without removing the message, which stays at the head of the queue.
+ *
+ * @param[in] queue			pointer to the queue
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [EINVAL]            no message is being peeked at
+ *      [ECANCELED]         queue was reset since the peek, message was discarded
+ */
+int pthread_queue_unpeek(pthread_queue_t *queue);
+
+
+
+/** Add a one-shot watch for a message, for a consumer which is not a thread.
+ *
+ * A consumer such as a suspended coroutine registers on queue->empty with
+ * pthread_ext_waitq_prepare, adds the watch, and tries pthread_queue_getmsg with
+ * PTHREAD_NOWAIT again. The watch fires as a thread blocked in pthread_queue_getmsg would
+ * wake (see pthread_ext_waitq_notify): each message put on the queue fires one watch,
+ * oldest first, and the end of a peek fires the watches added while the head slot was
+ * peeked at.
+ *
+ * @param[in] queue			pointer to the queue
+ * @param[in] watch			watch to link, owned by the caller
+ * @param[in] notify		function to call when the watch fires
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [EINVAL]            queue is PTHREAD_QUEUE_PSHARED
+ */
+int pthread_queue_notify(pthread_queue_t *queue, pthread_ext_waitq_watch_t *watch,
+						 void (* notify)(pthread_ext_waitq_watch_t * watch));
+
+
+
+/** Attach a notification descriptor, so a queue can be waited for in poll/epoll.
+ *
+ * fd is normally an eventfd (EFD_NONBLOCK). It becomes readable when messages are put on
+ * the queue, including messages already there when it is attached. Notifications are
+ * coalesced: after one write to fd, further sends do not write again until
+ * pthread_queue_eventfd_ack, so a burst of sends costs one write. A reactor thread:
+ *
+ *   1. waits for fd to become readable and reads it,
+ *   2. receives messages with PTHREAD_NOWAIT, as many as it likes,
+ *   3. calls pthread_queue_eventfd_ack, which posts fd again if messages are left.
+ *
+ * One descriptor may serve several queues; acknowledge each of them after reading it.
+ * The caller owns fd and closes it after detaching it (fd = -1) or destroying the queue.
+ * Not available for PTHREAD_QUEUE_PSHARED queues.
+ *
+ * @param[in] queue			pointer to the queue
+ * @param[in] fd			eventfd (or any descriptor that takes an 8 byte write), or -1 to detach
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [EINVAL]            queue is PTHREAD_QUEUE_PSHARED
+ */
+int pthread_queue_set_eventfd(pthread_queue_t *queue, int fd);
+
+
+
+/** Acknowledge a notification, see pthread_queue_set_eventfd.
+ *
+ * @param[in] queue			pointer to the queue
+ * @returns                 0 for success
+ */
+int pthread_queue_eventfd_ack(pthread_queue_t *queue);
+
+
+
 /** Return number of messages in a queue.
  *
  * @param[in] queue			pointer to the queue
@@ -129,6 +780,54 @@ uint32_t pthread_queue_count(pthread_queue_t * queue);
 
 
 
+/** Return the number of messages a queue holds now: num_msg, or for a PTHREAD_QUEUE_GROW
+ * queue the current size of its ring.
+ *
+ * @param[in] queue			pointer to the queue
+ */
+uint32_t pthread_queue_capacity(pthread_queue_t * queue);
+
+
+
+/** Return number of messages dropped by a PTHREAD_QUEUE_OVERWRITE queue to make room.
+ *
+ * @param[in] queue			pointer to the queue
+ */
+uint64_t pthread_queue_drops(pthread_queue_t * queue);
+
+
+
+/** Return which of the conditions in events hold now, without waiting.
+ *
+ * PTHREAD_QUEUE_READABLE holds when there is a message to get, and PTHREAD_QUEUE_WRITABLE
+ * when there is room for a message (for PTHREAD_QUEUE_VARLEN, an empty one). The answer
+ * may be out of date as soon as it is returned, when other threads use the queue.
+ *
+ * @param[in] queue			pointer to the queue
+ * @param[in] events		PTHREAD_QUEUE_READABLE and/or PTHREAD_QUEUE_WRITABLE
+ * @returns                 the conditions of events which hold
+ */
+uint32_t pthread_queue_poll(pthread_queue_t * queue, uint32_t events);
+
+
+
+/** Take a snapshot of the statistics of a PTHREAD_QUEUE_STATS queue.
+ *
+ * The counters run from the creation of the queue. The snapshot is summed from the
+ * per-thread shards without stopping other threads, so it may include part of a call that
+ * is going on at the same time. A message discarded by pthread_queue_reset counts as
+ * sent but not got. Percentiles of the histograms are given by pthread_ext_hist_percentile.
+ *
+ * @param[in]  queue		pointer to the queue
+ * @param[out] stats		returns the statistics
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [EINVAL]            queue was not created with PTHREAD_QUEUE_STATS
+ */
+int pthread_queue_stats(pthread_queue_t * queue, pthread_queue_stats_t * stats);
+
+
+
 /** Reset queue, discarding all messages, prevent further message inputs.
  *
  * @param[in] queue			pointer to the queue
@@ -143,4 +842,8 @@ int pthread_queue_reset(pthread_queue_t * queue);
  */
 int pthread_queue_unreset(pthread_queue_t * queue);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif /* PTHREAD_QUEUE_H */
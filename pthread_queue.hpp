@@ -0,0 +1,322 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014, Stephen Scott
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/** @file pthread_queue.hpp
+ * @brief C++ typed pthread message queue with compile-time message size and capacity
+ */
+
+#ifndef PTHREAD_QUEUE_HPP
+#define PTHREAD_QUEUE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
+#include <new>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include "pthread_queue.h"
+
+namespace pthread_ext {
+
+/** true if n is a power of two */
+constexpr bool is_pow2(uint64_t n)
+{
+	return (0 != n) && (0 == (n & (n - 1)));
+}
+
+/** A pthread_queue_t of messages of type T, header only.
+ *
+ * The message size and capacity are compile-time constants, and the ring is stored in the
+ * object itself. A trivially copyable T is copied with pthread_queue_sendmsg and
+ * pthread_queue_getmsg, which take the queue mutex once per call. Any other T is built in
+ * place in the ring through pthread_queue_reserve and pthread_queue_commit, and moved out
+ * through pthread_queue_peek and pthread_queue_release, then destroyed in the ring; a send
+ * or get takes the mutex twice, once to claim the slot and once to hand it over.
+ *
+ * When Capacity and sizeof(T) are both powers of two the queue uses PTHREAD_QUEUE_POW2
+ * indexing. Flags may add PTHREAD_QUEUE_SPSC, where no call takes a lock, and
+ * PTHREAD_QUEUE_STATS.
+ *
+ * If building or moving a message throws, the exception is passed on: send leaves the queue
+ * as it was, and get leaves the message at the head of the queue.
+ *
+ * Calls return 0 or an error number, as the C functions do. The constructor throws
+ * std::system_error if the queue cannot be created. A Queue is cache line aligned; create
+ * one on the heap with C++17 new, which honours that, or inside an aligned allocation.
+ */
+template <typename T, uint32_t Capacity, uint32_t Flags = 0>
+class Queue
+{
+public:
+	static constexpr uint32_t	capacity = Capacity;
+	static constexpr uint32_t	msg_len = (uint32_t) sizeof(T);
+	static constexpr uint32_t	flags = Flags | ((is_pow2(Capacity) && is_pow2(sizeof(T))) ? PTHREAD_QUEUE_POW2 : 0);
+
+	static_assert(Capacity > 0, "Queue needs a capacity");
+	static_assert(0 == (Flags & ~(PTHREAD_QUEUE_SPSC | PTHREAD_QUEUE_POW2 | PTHREAD_QUEUE_STATS)),
+				  "Queue supports PTHREAD_QUEUE_SPSC, _POW2 and _STATS only");
+	static_assert(!(Flags & PTHREAD_QUEUE_POW2) || (is_pow2(Capacity) && is_pow2(sizeof(T))),
+				  "PTHREAD_QUEUE_POW2 needs Capacity and sizeof(T) to be powers of two");
+	static_assert(alignof(T) <= PTHREAD_EXT_CACHE_LINE, "T is aligned beyond a cache line");
+
+	/** Create the queue.
+	 *
+	 * @param[in] wait		wait policy of blocked senders and receivers, or nullptr for the default
+	 */
+	explicit Queue(const pthread_ext_wait_policy_t * wait = nullptr)
+	{
+		pthread_queue_attr_t	attr;
+		pthread_queue_t * queue = &queue_;
+		int				result;
+
+		pthread_queue_attr_init(&attr);
+		attr.flags = flags;
+		if (wait)
+			attr.wait = *wait;
+
+		result = pthread_queue_create_ex(&queue, buffer_, Capacity, msg_len, &attr);
+		if (result)
+			throw std::system_error(result, std::generic_category(), "pthread_queue_create_ex");
+	}
+
+	/** Destroy the queue, and any messages left in it. */
+	~Queue()
+	{
+		void		  *	slot;
+
+		if (!std::is_trivially_destructible<T>::value)
+		{
+			while (0 == pthread_queue_peek(&queue_, &slot, PTHREAD_NOWAIT))
+			{
+				static_cast<T *>(slot)->~T();
+				pthread_queue_release(&queue_);
+			}
+		}
+		pthread_queue_destroy(&queue_);
+	}
+
+	Queue(const Queue &) = delete;
+	Queue & operator=(const Queue &) = delete;
+
+	/** Send a message, see pthread_queue_sendmsg. timeout is PTHREAD_WAIT, PTHREAD_NOWAIT or ms. */
+	int send(const T & msg, long timeout = PTHREAD_WAIT)
+	{
+		struct timespec	abstime;
+
+		if ((PTHREAD_WAIT != timeout) && (timeout < 0))
+			return EINVAL;
+
+		return put(msg, pthread_ext_deadline_ms(timeout, &abstime));
+	}
+
+	/** Send a message, moving it into the queue. */
+	int send(T && msg, long timeout = PTHREAD_WAIT)
+	{
+		struct timespec	abstime;
+
+		if ((PTHREAD_WAIT != timeout) && (timeout < 0))
+			return EINVAL;
+
+		return put(std::move(msg), pthread_ext_deadline_ms(timeout, &abstime));
+	}
+
+	/** Same as send, with the timeout in nanoseconds. */
+	int send_ns(const T & msg, long long timeout_ns)
+	{
+		struct timespec	abstime;
+
+		if ((PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0))
+			return EINVAL;
+
+		return put(msg, pthread_ext_deadline_ns(timeout_ns, &abstime));
+	}
+
+	int send_ns(T && msg, long long timeout_ns)
+	{
+		struct timespec	abstime;
+
+		if ((PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0))
+			return EINVAL;
+
+		return put(std::move(msg), pthread_ext_deadline_ns(timeout_ns, &abstime));
+	}
+
+	/** Same as send, waiting until an absolute deadline (see pthread_queue_sendmsg_until). */
+	int send_until(const T & msg, const struct timespec * deadline)
+	{
+		return put(msg, deadline);
+	}
+
+	int send_until(T && msg, const struct timespec * deadline)
+	{
+		return put(std::move(msg), deadline);
+	}
+
+	/** Get the oldest message, see pthread_queue_getmsg. timeout is PTHREAD_WAIT, PTHREAD_NOWAIT or ms. */
+	int get(T & msg, long timeout = PTHREAD_WAIT)
+	{
+		struct timespec	abstime;
+
+		if ((PTHREAD_WAIT != timeout) && (timeout < 0))
+			return EINVAL;
+
+		return take(msg, pthread_ext_deadline_ms(timeout, &abstime));
+	}
+
+	/** Same as get, with the timeout in nanoseconds. */
+	int get_ns(T & msg, long long timeout_ns)
+	{
+		struct timespec	abstime;
+
+		if ((PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0))
+			return EINVAL;
+
+		return take(msg, pthread_ext_deadline_ns(timeout_ns, &abstime));
+	}
+
+	/** Same as get, waiting until an absolute deadline (see pthread_queue_getmsg_until). */
+	int get_until(T & msg, const struct timespec * deadline)
+	{
+		return take(msg, deadline);
+	}
+
+	/** Number of messages in the queue. */
+	uint32_t count()
+	{
+		return pthread_queue_count(&queue_);
+	}
+
+	/** Discard all messages and stop sends, see pthread_queue_reset. The messages are
+	 * dropped without running destructors, so only for trivially destructible T. A get
+	 * which was moving a message out when the queue was reset returns ECANCELED. */
+	int reset()
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "reset would leak messages of type T");
+		static_assert(copyable || !(Flags & PTHREAD_QUEUE_SPSC),
+					  "PTHREAD_QUEUE_SPSC reset would let a send reuse the slot a get moves from");
+		return pthread_queue_reset(&queue_);
+	}
+
+	/** Let sends in again after reset. */
+	int unreset()
+	{
+		return pthread_queue_unreset(&queue_);
+	}
+
+	/** The underlying queue, for the C functions that take no message, such as
+	 * pthread_queue_poll, pthread_queue_set_eventfd or pthread_queue_stats. */
+	pthread_queue_t * native_handle()
+	{
+		return &queue_;
+	}
+
+private:
+	static constexpr bool	copyable = std::is_trivially_copyable<T>::value;
+
+	/* build the message in the tail slot. If the queue was reset meanwhile, the commit
+	 * fails with ECANCELED and the message is dropped, as reset drops those in the queue */
+	template <typename U>
+	int put(U && msg, const struct timespec * deadline)
+	{
+		void		  *	slot;
+		int				result;
+
+		if (copyable)
+			return pthread_queue_sendmsg_until(&queue_, const_cast<T *>(&msg), deadline);
+
+		result = pthread_queue_reserve_until(&queue_, &slot, deadline);
+		if (result)
+			return result;
+
+		try
+		{
+			new (slot) T(std::forward<U>(msg));
+		}
+		catch (...)
+		{
+			pthread_queue_unreserve(&queue_);
+			throw;
+		}
+		result = pthread_queue_commit(&queue_);
+		if (result)
+			static_cast<T *>(slot)->~T();
+
+		return result;
+	}
+
+	/* move the message out of the head slot and hand the slot back. A reset keeps the
+	 * peeked slot until the release, which then fails with ECANCELED: the message is
+	 * dropped, as reset drops those in the queue. It is not moved out if the reset came
+	 * first, and a send cannot build a new message in the slot meanwhile */
+	int take(T & msg, const struct timespec * deadline)
+	{
+		void		  *	slot;
+		T			  *	head;
+		int				result;
+
+		if (copyable)
+			return pthread_queue_getmsg_until(&queue_, &msg, deadline);
+
+		result = pthread_queue_peek_until(&queue_, &slot, deadline);
+		if (result)
+			return result;
+
+		head = static_cast<T *>(slot);
+		if (queue_.peek_gen != __atomic_load_n(&queue_.resets, __ATOMIC_ACQUIRE))
+			return pthread_queue_release(&queue_);
+
+		try
+		{
+			msg = std::move(*head);
+		}
+		catch (...)
+		{
+			pthread_queue_unpeek(&queue_);
+			throw;
+		}
+		head->~T();
+
+		return pthread_queue_release(&queue_);
+	}
+
+	pthread_queue_t	queue_;
+	alignas(PTHREAD_EXT_CACHE_LINE) unsigned char buffer_[(size_t) Capacity * sizeof(T)];
+};
+
+template <typename T, uint32_t Capacity, uint32_t Flags>
+constexpr uint32_t Queue<T, Capacity, Flags>::capacity;
+
+template <typename T, uint32_t Capacity, uint32_t Flags>
+constexpr uint32_t Queue<T, Capacity, Flags>::msg_len;
+
+template <typename T, uint32_t Capacity, uint32_t Flags>
+constexpr uint32_t Queue<T, Capacity, Flags>::flags;
+
+} /* namespace pthread_ext */
+
+#endif /* PTHREAD_QUEUE_HPP */
@@ -0,0 +1,411 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014, Stephen Scott
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/* 
+ * pthread_waitset implementation
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <errno.h>
+
+#include "pthread_waitset.h"
+#include "pthread_ext_common.h"
+
+/**************************************************************************************************/
+/* member_link
+ * link the watches of a member into the wait queues of its object.
+ */
+static void member_link(pthread_waitset_t *ws, pthread_waitset_member_t *m)
+{
+	pthread_queue_t *queue = (pthread_queue_t *) m->object;
+
+	if (m->events & PTHREAD_WAITSET_EVENT)
+		pthread_ext_waitq_watch(&((pthread_event_t *) m->object)->cond, &m->watch[0], &ws->wq);
+	else
+	{
+		if (m->events & PTHREAD_WAITSET_READABLE)
+			pthread_ext_waitq_watch(&queue->empty, &m->watch[0], &ws->wq);
+		if (m->events & PTHREAD_WAITSET_WRITABLE)
+			pthread_ext_waitq_watch(&queue->full, &m->watch[1], &ws->wq);
+	}
+}
+
+/**************************************************************************************************/
+/* member_unlink
+ * unlink the watches of a member.
+ */
+static void member_unlink(pthread_waitset_member_t *m)
+{
+	pthread_queue_t *queue = (pthread_queue_t *) m->object;
+
+	if (m->events & PTHREAD_WAITSET_EVENT)
+		pthread_ext_waitq_unwatch(&((pthread_event_t *) m->object)->cond, &m->watch[0]);
+	else
+	{
+		if (m->events & PTHREAD_WAITSET_READABLE)
+			pthread_ext_waitq_unwatch(&queue->empty, &m->watch[0]);
+		if (m->events & PTHREAD_WAITSET_WRITABLE)
+			pthread_ext_waitq_unwatch(&queue->full, &m->watch[1]);
+	}
+}
+
+/**************************************************************************************************/
+/* members_prepare
+ * register as a waiter on the wait queues of all members, so their wakes reach the watches.
+ */
+static void members_prepare(pthread_waitset_t *ws)
+{
+	pthread_waitset_member_t *m;
+	pthread_queue_t *queue;
+
+	for (m = ws->members; m < ws->members + ws->nmembers; m++)
+	{
+		queue = (pthread_queue_t *) m->object;
+		if (m->events & PTHREAD_WAITSET_EVENT)
+			pthread_ext_waitq_prepare(&((pthread_event_t *) m->object)->cond);
+		else
+		{
+			if (m->events & PTHREAD_WAITSET_READABLE)
+				pthread_ext_waitq_prepare(&queue->empty);
+			if (m->events & PTHREAD_WAITSET_WRITABLE)
+				pthread_ext_waitq_prepare(&queue->full);
+		}
+	}
+}
+
+/**************************************************************************************************/
+/* members_cancel
+ * withdraw the registrations of members_prepare. Also the cancellation handler of a wait.
+ */
+static void members_cancel(void *arg)
+{
+	pthread_waitset_t *ws = (pthread_waitset_t *) arg;
+	pthread_waitset_member_t *m;
+	pthread_queue_t *queue;
+
+	for (m = ws->members; m < ws->members + ws->nmembers; m++)
+	{
+		queue = (pthread_queue_t *) m->object;
+		if (m->events & PTHREAD_WAITSET_EVENT)
+			pthread_ext_waitq_cancel(&((pthread_event_t *) m->object)->cond);
+		else
+		{
+			if (m->events & PTHREAD_WAITSET_READABLE)
+				pthread_ext_waitq_cancel(&queue->empty);
+			if (m->events & PTHREAD_WAITSET_WRITABLE)
+				pthread_ext_waitq_cancel(&queue->full);
+		}
+	}
+}
+
+/**************************************************************************************************/
+/* members_ready
+ * collect up to max_ready ready members. Returns the number collected.
+ */
+static uint32_t members_ready(pthread_waitset_t *ws, pthread_waitset_ready_t *ready, uint32_t max_ready)
+{
+	pthread_waitset_member_t *m;
+	uint32_t		events;
+	uint32_t		n = 0;
+
+	for (m = ws->members; (m < ws->members + ws->nmembers) && (n < max_ready); m++)
+	{
+		if (m->events & PTHREAD_WAITSET_EVENT)
+			events = pthread_event_poll((pthread_event_t *) m->object, m->mask, m->nwords, m->test) ?
+					 PTHREAD_WAITSET_EVENT : 0;
+		else
+			events = pthread_queue_poll((pthread_queue_t *) m->object, m->events);
+
+		if (events)
+		{
+			ready[n].object = m->object;
+			ready[n].user = m->user;
+			ready[n].events = events;
+			n++;
+		}
+	}
+
+	return n;
+}
+
+/**************************************************************************************************/
+/* member_find
+ * return the member for object, or NULL.
+ */
+static pthread_waitset_member_t *member_find(pthread_waitset_t *ws, void *object)
+{
+	uint32_t		i;
+
+	for (i = 0; i < ws->nmembers; i++)
+		if (ws->members[i].object == object)
+			return &ws->members[i];
+
+	return NULL;
+}
+
+/**************************************************************************************************/
+/* pthread_waitset_create
+ * create and initialize a new wait set.
+ */
+int pthread_waitset_create(pthread_waitset_t ** ppws, uint32_t max_members)
+{
+	pthread_waitset_t * ws;
+	pthread_waitset_member_t * members;
+
+	if (0 == max_members)
+		return EINVAL;
+
+	members = (pthread_waitset_member_t *) calloc(max_members, sizeof(pthread_waitset_member_t));
+	if (NULL == members)
+		return ENOMEM;
+
+	if (NULL == *ppws)
+	{
+		ws = (pthread_waitset_t *) malloc(sizeof(pthread_waitset_t));
+		if (NULL == ws)
+		{
+			free(members);
+			return ENOMEM;
+		}
+
+		*ppws = ws;
+		ws->destroyFree = 1;
+	}
+	else
+	{
+		ws = *ppws;
+		ws->destroyFree = 0;
+	}
+
+	pthread_ext_waitq_init(&ws->wq);
+	ws->members = members;
+	ws->nmembers = 0;
+	ws->max_members = max_members;
+
+	return 0;
+
+} /* pthread_waitset_create */
+
+/**************************************************************************************************/
+/* pthread_waitset_destroy
+ * remove all members and free a wait set.
+ */
+void pthread_waitset_destroy(pthread_waitset_t * ws)
+{
+	while (ws->nmembers)
+		pthread_waitset_remove(ws, ws->members[ws->nmembers - 1].object);
+
+	free(ws->members);
+	pthread_ext_waitq_destroy(&ws->wq);
+	if (ws->destroyFree)
+		free(ws);
+
+} /* pthread_waitset_destroy */
+
+/**************************************************************************************************/
+/* pthread_waitset_add_queue
+ * add a queue member.
+ */
+int pthread_waitset_add_queue(pthread_waitset_t * ws, pthread_queue_t * queue, uint32_t events, void * user)
+{
+	pthread_waitset_member_t *m;
+
+	if ( (0 == events) || (events & ~(PTHREAD_WAITSET_READABLE | PTHREAD_WAITSET_WRITABLE)) ||
+		 (queue->flags & PTHREAD_QUEUE_PSHARED) )
+		return EINVAL;
+
+	if (member_find(ws, queue))
+		return EEXIST;
+
+	if (ws->nmembers == ws->max_members)
+		return ENOSPC;
+
+	m = &ws->members[ws->nmembers];
+	m->object = queue;
+	m->user = user;
+	m->events = events;
+	m->mask = NULL;
+	m->nwords = 0;
+	member_link(ws, m);
+	ws->nmembers++;
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* pthread_waitset_add_event
+ * add an event member.
+ */
+int pthread_waitset_add_event(pthread_waitset_t * ws, pthread_event_t * event, const pthread_event_mask64 * mask,
+							  unsigned nwords, pthread_event_test test, void * user)
+{
+	pthread_waitset_member_t *m;
+
+	if ( (0 == nwords) || (nwords > event->nwords) )
+		return EINVAL;
+
+	if (member_find(ws, event))
+		return EEXIST;
+
+	if (ws->nmembers == ws->max_members)
+		return ENOSPC;
+
+	m = &ws->members[ws->nmembers];
+	m->mask = (pthread_event_mask64 *) malloc(nwords * sizeof(pthread_event_mask64));
+	if (NULL == m->mask)
+		return ENOMEM;
+
+	memcpy(m->mask, mask, nwords * sizeof(pthread_event_mask64));
+	m->nwords = nwords;
+	m->test = test;
+	m->object = event;
+	m->user = user;
+	m->events = PTHREAD_WAITSET_EVENT;
+	member_link(ws, m);
+	ws->nmembers++;
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* pthread_waitset_remove
+ * remove a member. The watches of the members behind it are linked into their wait queues,
+ * so they are unlinked around the move which closes the gap.
+ */
+int pthread_waitset_remove(pthread_waitset_t * ws, void * object)
+{
+	pthread_waitset_member_t *m = member_find(ws, object);
+	pthread_waitset_member_t *last = ws->members + ws->nmembers - 1;
+	pthread_waitset_member_t *p;
+
+	if (NULL == m)
+		return ENOENT;
+
+	for (p = m; p <= last; p++)
+		member_unlink(p);
+	free(m->mask);
+
+	memmove(m, m + 1, (last - m) * sizeof(pthread_waitset_member_t));
+	ws->nmembers--;
+
+	for (p = m; p < last; p++)
+		member_link(ws, p);
+
+	return 0;
+}
+
+/**************************************************************************************************/
+/* waitset_block
+ * wait on the wait set's own queue, and unregister from the members afterwards, also if
+ * the thread is cancelled. A function of its own, so the cancellation jump buffer does not
+ * share a frame with the caller's loop variables.
+ */
+static int waitset_block(pthread_waitset_t * ws, uint32_t seq, const struct timespec *deadline)
+{
+	int				result;
+
+	pthread_cleanup_push(members_cancel, ws);
+	result = pthread_ext_waitq_wait(&ws->wq, seq, deadline);
+	pthread_cleanup_pop(1);
+
+	return result;
+}
+
+/**************************************************************************************************/
+/* pthread_waitset_wait
+ * wait until a member is ready. The thread registers on its own wait queue first, then
+ * on those of all members, and only then tests the members: a change after the test wakes
+ * a member wait queue which has a registered waiter, whose watch wakes the wait set.
+ */
+int pthread_waitset_wait(pthread_waitset_t * ws, pthread_waitset_ready_t * ready, uint32_t max_ready,
+						 uint32_t * pnready, long timeout)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout) && (timeout < 0) )
+		return EINVAL;
+
+	return pthread_waitset_wait_until(ws, ready, max_ready, pnready, pthread_ext_deadline_ms(timeout, &abstime));
+
+} /* pthread_waitset_wait */
+
+
+/**************************************************************************************************/
+/* pthread_waitset_wait_ns
+ * as pthread_waitset_wait, with the timeout in nanoseconds.
+ */
+int pthread_waitset_wait_ns(pthread_waitset_t * ws, pthread_waitset_ready_t * ready, uint32_t max_ready,
+						 uint32_t * pnready, long long timeout_ns)
+{
+	struct timespec abstime;
+
+	if ( (PTHREAD_WAIT != timeout_ns) && (timeout_ns < 0) )
+		return EINVAL;
+
+	return pthread_waitset_wait_until(ws, ready, max_ready, pnready, pthread_ext_deadline_ns(timeout_ns, &abstime));
+
+} /* pthread_waitset_wait_ns */
+
+
+/**************************************************************************************************/
+/* pthread_waitset_wait_until
+ * as pthread_waitset_wait, waiting until an absolute PTHREAD_EXT_CLOCK deadline.
+ */
+int pthread_waitset_wait_until(pthread_waitset_t * ws, pthread_waitset_ready_t * ready, uint32_t max_ready,
+						 uint32_t * pnready, const struct timespec *deadline)
+{
+	uint32_t		seq;
+	uint32_t		n;
+	int				result = 0;
+
+	*pnready = 0;
+
+	if (0 == max_ready)
+		return EINVAL;
+
+	for (;;)
+	{
+		seq = pthread_ext_waitq_prepare(&ws->wq);
+		members_prepare(ws);
+
+		n = members_ready(ws, ready, max_ready);
+		if (n || (PTHREAD_EXT_DEADLINE_NOW == deadline) || result)
+		{
+			members_cancel(ws);
+			pthread_ext_waitq_cancel(&ws->wq);
+			break;
+		}
+
+		result = waitset_block(ws, seq, deadline);
+	}
+
+	*pnready = n;
+
+	return n ? 0 : ETIMEDOUT;
+
+} /* pthread_waitset_wait_until */
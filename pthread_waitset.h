@@ -0,0 +1,205 @@
+/*
+The MIT License (MIT)
+
+Copyright (c) 2014, Stephen Scott
+All rights reserved.
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*/
+
+/** @file pthread_waitset.h
+ * @brief wait for any of several pthread queues and events
+ */
+
+#ifndef PTHREAD_WAITSET_H
+#define PTHREAD_WAITSET_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "pthread_ext_common.h"
+#include "pthread_ext_wait.h"
+#include "pthread_queue.h"
+#include "pthread_event.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A wait set blocks one thread on a collection of queues and events with a single
+ * timeout, and reports which of them are ready. Each member links a watch into the wait
+ * queues of its object (see pthread_ext_waitq_watch), so a send, receive or set that
+ * wakes the object's waiters also wakes the wait set; nothing is polled while the thread
+ * waits. A wait set is used by one thread at a time. Being ready is a hint, as for poll:
+ * another thread may take the message or the bits first, so the owner follows up with
+ * PTHREAD_NOWAIT calls.
+ */
+
+/* member kinds; a queue member may watch both conditions */
+#define PTHREAD_WAITSET_READABLE	PTHREAD_QUEUE_READABLE	/* queue has a message */
+#define PTHREAD_WAITSET_WRITABLE	PTHREAD_QUEUE_WRITABLE	/* queue has room */
+#define PTHREAD_WAITSET_EVENT		0x0004		/* event test is satisfied */
+
+typedef struct pthread_waitset_member_s {
+	void				  *	object;			/* pthread_queue_t or pthread_event_t */
+	void				  *	user;			/* caller's tag, returned with the member */
+	uint32_t				events;			/* PTHREAD_WAITSET_xxx conditions to wait for */
+	pthread_event_test		test;			/* event: PTHREAD_EVENT_ANY or PTHREAD_EVENT_ALL */
+	unsigned				nwords;			/* event: words in mask */
+	pthread_event_mask64	  *	mask;			/* event: bits to test */
+	pthread_ext_waitq_watch_t	watch[2];	/* links into the object's wait queues */
+} pthread_waitset_member_t;
+
+/** A ready member, filled in by pthread_waitset_wait */
+typedef struct pthread_waitset_ready_s {
+	void				  *	object;			/* the queue or event */
+	void				  *	user;			/* tag given when it was added */
+	uint32_t				events;			/* PTHREAD_WAITSET_xxx conditions which hold */
+} pthread_waitset_ready_t;
+
+typedef struct pthread_waitset_s {
+	pthread_ext_waitq_t		wq;				/* woken through the members' watches */
+	pthread_waitset_member_t * members;
+	uint32_t				nmembers;		/* members in use */
+	uint32_t				max_members;	/* size of members */
+	uint8_t					destroyFree;	/* 1 = free memory on destroy */
+} pthread_waitset_t;
+
+/** Create a wait set.
+ *
+ * Set *ppws = NULL to allocate memory for the wait set. Otherwise, caller allocates memory.
+ *
+ * @param[inout] ppws		if *ppws == NULL, allocate memory for the wait set. Returns wait set pointer.
+ * @param[in]    max_members	most members the wait set can hold
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ENOMEM]            memory for wait set not available
+ *      [EINVAL]            max_members is 0
+ */
+int pthread_waitset_create(pthread_waitset_t ** ppws, uint32_t max_members);
+
+
+
+/** Destroy a wait set, removing all its members.
+ *
+ * @param[in] ws			pointer to the wait set
+ */
+void pthread_waitset_destroy(pthread_waitset_t * ws);
+
+
+
+/** Add a queue to a wait set.
+ *
+ * The queue must stay valid until it is removed again or the wait set is destroyed.
+ *
+ * @param[in] ws			pointer to the wait set
+ * @param[in] queue			queue to watch
+ * @param[in] events		PTHREAD_WAITSET_READABLE and/or PTHREAD_WAITSET_WRITABLE
+ * @param[in] user			tag returned with the member when it is ready
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [EINVAL]            events is invalid, or queue is PTHREAD_QUEUE_PSHARED
+ *      [EEXIST]            queue is already a member
+ *      [ENOSPC]            wait set is full
+ */
+int pthread_waitset_add_queue(pthread_waitset_t * ws, pthread_queue_t * queue, uint32_t events, void * user);
+
+
+
+/** Add an event to a wait set.
+ *
+ * The member is ready when the event mask satisfies the test, as for pthread_event_waitv.
+ * mask is copied. The event must stay valid until it is removed again or the wait set is
+ * destroyed.
+ *
+ * @param[in] ws			pointer to the wait set
+ * @param[in] event			event to watch
+ * @param[in] mask			bits to test
+ * @param[in] nwords		number of words in mask, 1 up to the words in the event
+ * @param[in] test			PTHREAD_EVENT_ANY (logical OR), PTHREAD_EVENT_ALL (logical AND)
+ * @param[in] user			tag returned with the member when it is ready
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [EINVAL]            nwords is invalid
+ *      [EEXIST]            event is already a member
+ *      [ENOSPC]            wait set is full
+ *      [ENOMEM]            memory for mask not available
+ */
+int pthread_waitset_add_event(pthread_waitset_t * ws, pthread_event_t * event, const pthread_event_mask64 * mask,
+							  unsigned nwords, pthread_event_test test, void * user);
+
+
+
+/** Remove a queue or event from a wait set.
+ *
+ * @param[in] ws			pointer to the wait set
+ * @param[in] object		queue or event to remove
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ENOENT]            object is not a member
+ */
+int pthread_waitset_remove(pthread_waitset_t * ws, void * object);
+
+
+
+/** Wait until at least one member is ready.
+ *
+ * timeout is PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms. Up to max_ready ready
+ * members are stored in ready, in the order they were added, and their number in
+ * *pnready.
+ *
+ * @param[in]  ws			pointer to the wait set
+ * @param[out] ready		receives the ready members
+ * @param[in]  max_ready	size of ready, at least 1
+ * @param[out] pnready		number of ready members stored
+ * @param[in]  timeout		PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ms
+ * @returns                 0 for success, otherwise an error number for failure
+ * @ERRORS
+ *      [ETIMEDOUT]         timeout has passed (or, if PTHREAD_NOWAIT, no member is ready)
+ *      [EINVAL]            timeout value or max_ready is invalid
+ */
+int pthread_waitset_wait(pthread_waitset_t * ws, pthread_waitset_ready_t * ready, uint32_t max_ready,
+						 uint32_t * pnready, long timeout);
+
+
+
+/** Same as pthread_waitset_wait, with the timeout in nanoseconds.
+ *
+ * @param[in] timeout_ns	PTHREAD_WAIT or PTHREAD_NOWAIT or timeout in ns
+ */
+int pthread_waitset_wait_ns(pthread_waitset_t * ws, pthread_waitset_ready_t * ready, uint32_t max_ready,
+							uint32_t * pnready, long long timeout_ns);
+
+
+
+/** Same as pthread_waitset_wait, waiting until an absolute deadline.
+ *
+ * @param[in] deadline		absolute PTHREAD_EXT_CLOCK time, NULL to wait forever, or
+ *                          PTHREAD_EXT_DEADLINE_NOW not to wait
+ */
+int pthread_waitset_wait_until(pthread_waitset_t * ws, pthread_waitset_ready_t * ready, uint32_t max_ready,
+							   uint32_t * pnready, const struct timespec * deadline);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* PTHREAD_WAITSET_H */